@@ -0,0 +1,61 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Pool of channel buffers. The pyramid of a frame needs the same buffer sizes
+* as the one of the last frame, so buffers released by a pyramid are handed
+* to the next one instead of going back to the heap.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef CHNPOOL_HPP_
+#define CHNPOOL_HPP_
+
+/*
+ * System includes
+ */
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Buffers keep the misalign = 1 convention of the detector (the float before
+ * the buffer belongs to the allocation), so a pool buffer can be used
+ * anywhere a wrCalloc(n+1)+1 one is. They are not cleared when recycled.
+ *
+ * The pool is thread safe: a pyramid can be released by another thread than
+ * the one that built it. It must outlive the buffers it lends (pyrOutput
+ * holds a reference to it for that).
+ */
+class chnPool
+{
+public:
+    explicit chnPool(size_t maxIdleBytes = 256 << 20);
+    ~chnPool();
+
+    // Room for n floats, recycled if a buffer of that size is idle
+    float* acquire(size_t n);
+
+    // Gives back a buffer returned by acquire()
+    void release(float *buffer);
+
+    // Buffers handed out, and how many of them came from the heap
+    long acquired() const;
+    long allocated() const;
+
+private:
+    chnPool(const chnPool&) = delete;
+    chnPool& operator=(const chnPool&) = delete;
+
+    mutable mutex lock;
+    map<size_t, vector<float*> > idle;	// by size
+    map<float*, size_t> lent;
+    size_t maxIdleBytes;		// idle buffers above this are freed
+    size_t idleBytes;
+    long nAcquired;
+    long nAllocated;
+};
+
+#endif /* CHNPOOL_HPP_ */
@@ -29,8 +29,10 @@
 #include "rgbConvertMex.hpp"
 #include "rgbConvert.hpp"
 #include "gradientMex.hpp"
+#include "gradientFixed.hpp"
 #include "convConst.hpp"
 #include "opencvInterface.hpp"
+#include "chnPool.hpp"
 
 using namespace std;
 
@@ -49,6 +51,21 @@ enum PadWith {
     circular
 };
 
+/*
+ * Memory layout of the channel planes. The toolbox (like MatLab) stores each
+ * plane column-major, data[x*height + y]; OpenCV stores it row-major,
+ * data[y*width + x]. Planes are always stacked one after the other.
+ */
+enum ChnsLayout {
+    colMajor = 0,
+    rowMajor
+};
+
+// Layout used when none is requested (-DCHNS_DEFAULT_LAYOUT=rowMajor)
+#ifndef CHNS_DEFAULT_LAYOUT
+#define CHNS_DEFAULT_LAYOUT colMajor
+#endif
+
 /*
  * Auxiliary function for the convTri
  */
@@ -57,7 +74,52 @@ void convTriAux(float *M, float *&S, int misalign, int height, int width,
         );
 
 /*
- * Class wrapping up an image
+ * Same as convTriAux, into a buffer S the caller already allocated
+ */
+void convTriInto(float *M, float *S, int height, int width, int chnTrans,
+                 float r, int s = 1);
+
+/*
+ * Non-owning view of channels laid out like an imgWrap: channels planes of
+ * height x width, one after the other
+ */
+class chnView
+{
+public:
+    float *data;
+    int width;
+    int height;
+    int channels;
+    int layout;
+
+    chnView() :
+        data(NULL),
+        width(0),
+        height(0),
+        channels(0),
+        layout(colMajor) {}
+
+    chnView(float *d, int w, int h, int c, int lay) :
+        data(d),
+        width(w),
+        height(h),
+        channels(c),
+        layout(lay) {}
+
+    size_t planeSize() const { return (size_t) width * height; }
+    size_t size() const { return planeSize() * channels; }
+    float* plane(int c) const { return data + c * planeSize(); }
+
+    // Planes first .. first+n-1
+    chnView planes(int first, int n) const
+    {
+        return chnView(plane(first), width, height, n, layout);
+    }
+};
+
+/*
+ * Class wrapping up an image. It frees the image (or gives it back to its
+ * pool) unless it is a view, and can be moved but not copied.
  */
 class imgWrap
 {
@@ -68,17 +130,77 @@ public:
     int height;
     int channels;
     int misalign;
+    int layout;
+    bool owner;		// false for a view into a buffer another imgWrap frees
+    chnPool *pool;	// where image goes back to, NULL = wrFree
 
-    imgWrap(float *img, int w, int h, int c, int mis) :
+    imgWrap(float *img, int w, int h, int c, int mis, int lay = colMajor,
+            bool own = true, chnPool *_pool = NULL) :
         image(img),
         width(w),
         height(h),
         channels(c),
-        misalign(mis) {}
+        misalign(mis),
+        layout(lay),
+        owner(own),
+        pool(_pool) {}
+
+    imgWrap(imgWrap &&other) :
+        image(other.image),
+        width(other.width),
+        height(other.height),
+        channels(other.channels),
+        misalign(other.misalign),
+        layout(other.layout),
+        owner(other.owner),
+        pool(other.pool)
+    {
+        other.image = NULL;
+        other.owner = false;
+    }
+
+    imgWrap& operator=(imgWrap &&other)
+    {
+        if(this != &other)
+        {
+            freeImage();
+            image = other.image;
+            width = other.width;
+            height = other.height;
+            channels = other.channels;
+            misalign = other.misalign;
+            layout = other.layout;
+            owner = other.owner;
+            pool = other.pool;
+            other.image = NULL;
+            other.owner = false;
+        }
+        return *this;
+    }
 
     ~imgWrap()
     {
-        wrFree(image-misalign);
+        freeImage();
+    }
+
+    chnView view() const
+    {
+        return chnView(image, width, height, channels, layout);
+    }
+
+private:
+    imgWrap(const imgWrap&) = delete;
+    imgWrap& operator=(const imgWrap&) = delete;
+
+    void freeImage()
+    {
+        if(!owner || image == NULL)
+            return;
+
+        if(pool != NULL)
+            pool->release(image);
+        else
+            wrFree(image-misalign);
     }
 };
 
@@ -110,6 +232,7 @@ public:
         bool softBin; 	// [0] if true use "soft" bilinear spatial binning
         bool useHog; 	// [0] if true perform 4-way hog normalization/clipping
         float clipHog;	// [.2] value at which to clip hog histogram bins
+        bool fixedPoint; // [0] if true use 16 bit gradients and histograms
     };
 
     class Custom { 		// parameters for custom channels (optional struct array):
@@ -160,8 +283,18 @@ public:
     //TODO : Insert Custom void* here;
 
     infoOut(pChns *input, int width, int height,  int _chn, int _chnTrans,
-            int _widthH, int _heightH, float *_I, float *_M, float *_H, int misalign
+            int _widthH, int _heightH, float *_I, float *_M, float *_H, int misalign,
+            int layout = colMajor
             );
+    // Frees the channels, unless takeData() handed them over
+    ~infoOut();
+
+    // The nTypes channels of data, owned by the caller from now on
+    imgWrap** takeData();
+
+private:
+    infoOut(const infoOut&) = delete;
+    infoOut& operator=(const infoOut&) = delete;
 };
 
 /*
@@ -238,6 +371,9 @@ public:
  *     .softBin      - [0] if true use "soft" bilinear spatial binning
  *     .useHog       - [0] if true perform 4-way hog normalization/clipping
  *     .clipHog      - [.2] value at which to clip hog histogram bins
+ *     .fixedPoint   - [0] if true compute the gradients and histograms in
+ *                     fixed point (see gradientFixed.hpp); ignored with
+ *                     softBin and binSize>1
  *   .pCustom      - parameters for custom channels (optional struct array):
  *     .enabled      - [1] if true enable custom channel type
  *     .name         - ['REQ'] custom channel type name
@@ -263,6 +399,13 @@ public:
  *  tic, for i=1:100, chns = chnsCompute(I,pChns); end; toc
  *  figure(1); montage2(chns.data{3});
  *
+ * LAYOUT
+ *  The C++ port adds a "layout" argument (colMajor or rowMajor, see
+ *  ChnsLayout) describing how the planes of I are stored; the output uses
+ *  the same layout. Row-major input is processed as its column-major
+ *  transpose, so the hog normalization (useHog) and an odd number of
+ *  orientations are only supported for colMajor.
+ *
  * See also rgbConvert, gradientMag, gradientHist, chnsPyramid
  *
  * Piotr's Image&Video Toolbox      Version 3.00
@@ -271,6 +414,7 @@ public:
  * Licensed under the Simplified BSD License [see external/bsd.txt]
 */
 
-infoOut* chnsCompute(float* I, int height, int width, int channels, pChns *pchns);
+infoOut* chnsCompute(float* I, int height, int width, int channels, pChns *pchns,
+                     int layout = colMajor);
 
 #endif /* CHNSCOMPUTE_HPP_ */
@@ -16,6 +16,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 /*
@@ -26,6 +27,9 @@
 #include "imResampleMex.hpp"
 #include "imPadMex.hpp"
 #include "chnsCompute.hpp"
+#include "pyrScale.hpp"
+#include "scalePlan.hpp"
+#include "pyrCache.hpp"
 
 /*
  * OpenCV related includes
@@ -40,60 +44,135 @@ using namespace std;
 class pyrInput
 {
 public:
-    pChns *pchns;
+    unique_ptr<pChns> pchns;
     int nPerOct;	// [8] number of scales per octave
     int nOctUp;		// [0] number of upsampled octaves to compute
     int nApprox;	// [-1] number of approx. scales (if -1 nApprox=nPerOct-1)
-    float* lambdas;	// [] coefficients for power law scaling (see BMVC10)
+    vector<float> lambdas; // [] coefficients for power law scaling (see BMVC10)
+    int lambdaFrames;	// [0] if >0 and no lambdas, frames to estimate them on
+    int lambdaCount;	// [0] frames the lambdas were estimated on so far
+    vector<float> lambdaSum; // [] sum of those estimates
     int shrink;		// [4] integer downsampling amount for channels
-    int *pad;		// [0 0] amount to pad channels (along T/B and L/R)
-    int *minDs;		// [16 16] minimum image size for channel computation
+    int pad[2];		// [0 0] amount to pad channels (along T/B and L/R)
+    int minDs[2];	// [16 16] minimum image size for channel computation
     float smoothIm;	// [1] radius for image smoothing (using convTri)
     float smoothChns;// [1] radius for channel smoothing (using convTri)
     bool concat;	// [true] if true concatenate channels
     bool complete;	// [] if true does not check/set default vals in pPyramid
-    int *sz;		// [] size of image H*W*C
+    int sz[3];		// [] size of image H*W*C
+    int layout;		// [colMajor] memory layout of image and channels
+    int bandHeight;	// [0] rows per band for the real scales (0 = no bands)
+    shared_ptr<chnPool> pool;	// [] recycles the channels between frames
+    unique_ptr<pyrChannelCache> cache; // [] channels of the last frame
 
     pyrInput();
-    pyrInput(int _nPerOct, int _nOctUp, int _nApprox, float* _lambdas,
-             int _shrink, int _pad[2], int _minDs[2], int _smoothIm,
-    int _smoothChns, bool _concat, bool _complete, int _sz[3],
-    pChns *pchns);
-    ~pyrInput();
+
+private:
+    pyrInput(const pyrInput&) = delete;
+    pyrInput& operator=(const pyrInput&) = delete;
 };
 
+/*
+ * The channel types of a scale are consecutive in a single buffer, owned by
+ * (*chnsPerScale[i])[0]. With concat that is the only imgWrap of the scale,
+ * otherwise (*chnsPerScale[i])[j] is a view of the j-th type; either way
+ * (*chnsPerScale[i])[0]->image points to all nChannels channels (see scale()).
+ *
+ * A pyramid can be moved, e.g. to the thread that runs the classifiers, but
+ * not copied. Its scales can be shared with the channel cache (see
+ * pyrScale): when the last of them lets a scale go, its buffers go back to
+ * the pool of the pyrInput.
+ */
 class pyrOutput
 {
 public:
     pyrInput *input;
-    imgWrap ***chnsPerScale;
-    float *scales;
+    vector<pyrScalePtr> chnsPerScale;	// [nScales]
+    shared_ptr<const scalePlan> plan;	// owns scales
+    const float *scales;
     int nScales;
+    int nTypes;		// entries of chnsPerScale[i] (NULL after the first with concat)
     int nChannels;
 
     pyrOutput() :
         input(NULL),
-        chnsPerScale(NULL),
         scales(NULL),
         nScales(0),
+        nTypes(0),
         nChannels(0) {}
 
-    ~pyrOutput()
+    pyrOutput(pyrOutput &&other) :
+        input(NULL),
+        scales(NULL),
+        nScales(0),
+        nTypes(0),
+        nChannels(0)
     {
-        for(int i=0; i<nScales; i++)
-        {
-            delete chnsPerScale[i][0];
-        }
-        delete [] scales;
+        swap(other);
+    }
 
-        for(int i=0; i<nScales; i++)
+    pyrOutput& operator=(pyrOutput &&other)
+    {
+        if(this != &other)
         {
-            wrFree(chnsPerScale[i]);
+            clear();
+            swap(other);
         }
+        return *this;
+    }
+
+    ~pyrOutput()
+    {
+        clear();
+    }
+
+    // All the channels of scale i
+    chnView scale(int i) const
+    {
+        imgWrap *first = (*chnsPerScale[i])[0];
+        return chnView(first->image, first->width, first->height, nChannels,
+                       first->layout);
+    }
 
-        wrFree(chnsPerScale);
+    // Lets the scales go (those handed to a pyrScaleConsumer are already NULL)
+    void clear()
+    {
+        chnsPerScale.clear();
+        nScales = 0;
+        nTypes = 0;
+        nChannels = 0;
+        scales = NULL;
+        plan.reset();
+    }
 
+    void swap(pyrOutput &other)
+    {
+        std::swap(input, other.input);
+        chnsPerScale.swap(other.chnsPerScale);
+        plan.swap(other.plan);
+        std::swap(scales, other.scales);
+        std::swap(nScales, other.nScales);
+        std::swap(nTypes, other.nTypes);
+        std::swap(nChannels, other.nChannels);
     }
+
+private:
+    pyrOutput(const pyrOutput&) = delete;
+    pyrOutput& operator=(const pyrOutput&) = delete;
+};
+
+/*
+ * Receives the scales of a pyramid one at a time (see chnsPyramid below)
+ */
+class pyrScaleConsumer
+{
+public:
+    virtual ~pyrScaleConsumer() {}
+
+    // chns is laid out as *pyrOutput::chnsPerScale[scaleId] and is only
+    // valid until this returns
+    virtual void consumeScale(int scaleId, float scale,
+                              imgWrap *const *chns) = 0;
 };
 
 /*
@@ -185,13 +264,30 @@ public:
 *   .nOctUp       - [0] number of upsampled octaves to compute
 *   .nApprox      - [-1] number of approx. scales (if -1 nApprox=nPerOct-1)
 *   .lambdas      - [] coefficients for power law scaling (see BMVC10)
+*   .lambdaFrames - [0] if >0 the estimated lambdas are averaged over the
+*                   first lambdaFrames frames and then kept in .lambdas, so
+*                   they are not estimated for every frame
 *   .shrink       - [4] integer downsampling amount for channels
 *   .pad          - [0 0] amount to pad channels (along T/B and L/R)
 *   .minDs        - [16 16] minimum image size for channel computation
 *   .smoothIm     - [1] radius for image smoothing (using convTri)
 *   .smoothChns   - [1] radius for channel smoothing (using convTri)
-*   .concat       - [1] if true concatenate channels
+*   .concat       - [1] if true concatenate channels (free, the types of a
+*                   scale share one buffer either way, see pyrOutput)
 *   .complete     - [] if true does not check/set default vals in pPyramid
+*   .layout       - [colMajor] layout of I and of the output channels. With
+*                   rowMajor the planes are stored as OpenCV stores them and
+*                   the kernels run on the transposed image (see chnsCompute)
+*   .bandHeight   - [0] if >0 the channels of the real scales are computed on
+*                   horizontal bands of about bandHeight rows, overlapping by
+*                   the support of the filters, so the full resolution images
+*                   of a band stay in cache. The bands are rounded to shrink
+*   .pool         - [new pool] buffers of the last pyramids, reused for
+*                   the channels of the next ones (see chnPool.hpp)
+*   .cache        - [NULL] if set, the tiles (bandHeight wide) of the real
+*                   scales that did not change since the last frame, and the
+*                   scales approximated from unchanged real scales, are taken
+*                   from the last frame (see pyrCache.hpp)
 *
 * OUTPUTS
 *  pyramid      - output struct
@@ -222,5 +318,19 @@ public:
 
 pyrOutput* chnsPyramid(float *image, pyrInput *input);
 
+/*
+ * Same, into an existing pyramid: its old channels are released first, so
+ * with the pool of input the new ones reuse their buffers.
+ */
+bool chnsPyramid(float *image, pyrInput *input, pyrOutput &output);
+
+/*
+ * Streaming version: every scale goes to consumer, in increasing scale
+ * order, as soon as it is complete and is freed right after. Only the
+ * real scale the current scales are approximated from stays in memory.
+ * The channels are the ones chnsPyramid(image, input) would return.
+ */
+bool chnsPyramid(float *image, pyrInput *input, pyrScaleConsumer *consumer);
+
 
 #endif /* CHNSPYRAMID_HPP_ */
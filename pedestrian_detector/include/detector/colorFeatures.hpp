@@ -1,8 +1,75 @@
 #ifndef COLORFEATURES2_HPP
 #define COLORFEATURES2_HPP
 #include <opencv/cv.h>
+#include <string>
+#include <vector>
 
 void extractBVT(cv::Mat& inputImage, cv::Mat& bvtHistogram, int bgBins, std::vector<cv::Rect> partMasks);
 
+//Parameters of the BVT descriptor and the tables derived from them. It is
+//built once (from partMasks.yaml) and every extraction only reads it, so
+//descriptor variants can be tried by changing the file.
+class bvtSpec
+{
+public:
+    int hBins;		//[10] hue bins of the H-S histograms
+    int sBins;		//[10] saturation bins
+    int bgBins;		//[10] bins of the gray (V) histograms
+    double blackWeight;	//[2.32] weight of the count of black pixels
+    double grayWeight;	//[.36] weight of the gray histograms
+    int width;		//[52] template the detections are resized to
+    int height;		//[128]
+    std::vector<cv::Rect> partMasks;	//in template pixels
+
+    //Derived by prepare()
+    std::vector<int> hBin;		//bin of every H value (times sBins)
+    std::vector<int> sBin;		//bin of every S value
+    std::vector<int> vBin;		//gray bin of every V value
+    std::vector<float> normalization;	//of every part
+    std::vector<float> grayScale;	//normalization times grayWeight
+
+    //The parameters of extractBVT, without masks
+    bvtSpec();
+
+    //Reads the masks (headMask, torsoMask, legsMask, feetMask) and any of
+    //hBins, sBins, bgBins, blackWeight, grayWeight, templateSize [w, h] and
+    //maskTemplateSize (the template the masks were drawn on, if another
+    //one: they are scaled). False if the file can not be read.
+    bool load(const std::string& filename);
+
+    //Computes the tables, after the parameters are set
+    void prepare();
+
+    //Floats per descriptor
+    int length() const;
+};
+
+//BVT histogram of a spec.width x spec.height HSV image, written to out
+//(spec.length() floats). counts has room for hBins*sBins + bgBins ints.
+//With the default spec it is what extractBVT gives for the image in BGR.
+void bvtHistograms(const cv::Mat& hsv, float* out, const bvtSpec& spec, int* counts);
+
+//BVT histograms of all the detections of a frame at once. The detections are
+//resized into a single buffer, converted to HSV together, and the histograms
+//of a part are counted in one pass over its pixels. The buffers only grow, so
+//they are not allocated again for every frame.
+class bvtBatchExtractor
+{
+public:
+    explicit bvtBatchExtractor(const bvtSpec& spec);
+
+    //Row i is the BVT histogram of image(boxes[i]) resized to the template
+    //(CV_32F). The rows are overwritten by the next call.
+    cv::Mat compute(const cv::Mat& image, const std::vector<cv::Rect>& boxes);
+
+    const bvtSpec& spec() const { return featureSpec; }
+
+private:
+    bvtSpec featureSpec;
+    cv::Mat crops;	//BGR detections, one under the other
+    cv::Mat hsv;
+    cv::Mat features;
+    std::vector<int> counts;
+};
 
 #endif // COLORFEATURES2_HPP
@@ -0,0 +1,221 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Bounded queues between the stages of the detector node. When a stage falls
+* behind, its queue drops the oldest frames instead of piling them up, so the
+* published detections are always of a recent frame.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef FRAMEQUEUE_HPP_
+#define FRAMEQUEUE_HPP_
+
+/*
+ * System includes
+ */
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Lock free ring of cells with a sequence number each (D. Vyukov's bounded
+ * MPMC queue). Items are moved in and out, so T can be move only. The
+ * capacity is rounded up to a power of two, two at least. Pushes and pops
+ * never lock or wait; the stagePool that runs the consumers is notified of
+ * new items by the producer.
+ */
+template <class T>
+class frameQueue
+{
+public:
+    explicit frameQueue(size_t capacity) :
+        cells(roundUp(capacity)),
+        mask(cells.size() - 1),
+        tail(0),
+        head(0),
+        drops(0)
+    {
+        for (size_t i = 0; i < cells.size(); i++)
+            cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    // Moves item in, false if the queue is full
+    bool tryPush(T &item)
+    {
+        cell *c;
+        size_t pos = tail.load(memory_order_relaxed);
+        for (;;){
+            c = &cells[pos & mask];
+            size_t seq = c->sequence.load(memory_order_acquire);
+            long dif = (long) seq - (long) pos;
+            if (dif == 0){
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               memory_order_relaxed))
+                    break;
+            }else if (dif < 0){
+                return false;
+            }else{
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+
+        c->item = move(item);
+        c->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    // Moves the oldest item out, false if the queue is empty
+    bool tryPop(T &item)
+    {
+        cell *c;
+        size_t pos = head.load(memory_order_relaxed);
+        for (;;){
+            c = &cells[pos & mask];
+            size_t seq = c->sequence.load(memory_order_acquire);
+            long dif = (long) seq - (long) (pos + 1);
+            if (dif == 0){
+                if (head.compare_exchange_weak(pos, pos + 1,
+                                               memory_order_relaxed))
+                    break;
+            }else if (dif < 0){
+                return false;
+            }else{
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+
+        item = move(c->item);
+        c->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+
+    // Pushes item, making room by dropping the oldest items when the queue
+    // is full. The last item dropped is moved into dropped (to be recycled
+    // by the caller). Returns how many were dropped.
+    int pushDropOldest(T &item, T &dropped)
+    {
+        int n = 0;
+        while (!tryPush(item))
+            if (tryPop(dropped))
+                n++;
+
+        drops.fetch_add(n, memory_order_relaxed);
+        return n;
+    }
+
+    // Items in the queue (approximate while it is being used)
+    size_t size() const
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t h = head.load(memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    size_t capacity() const { return cells.size(); }
+
+    // Items dropped by pushDropOldest since the queue was made
+    long dropped() const { return drops.load(memory_order_relaxed); }
+
+private:
+    frameQueue(const frameQueue&) = delete;
+    frameQueue& operator=(const frameQueue&) = delete;
+
+    struct cell
+    {
+        atomic<size_t> sequence;
+        T item;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    vector<cell> cells;
+    const size_t mask;
+
+    // Apart, so producers and consumers do not share a cache line
+    atomic<size_t> tail;
+    char apart[64];
+    atomic<size_t> head;
+    atomic<long> drops;
+};
+
+/*
+ * Single slot with the latest item: a new item replaces the one that was not
+ * taken yet. The ROS callback leaves the frames there, so it never waits for
+ * the stages and a slow frame does not hold the next ones back.
+ */
+template <class T>
+class frameMailbox
+{
+public:
+    frameMailbox() : slot(NULL), drops(0) {}
+    ~frameMailbox() { delete slot.exchange(NULL); }
+
+    // Leaves item, and moves the item it replaced (if any) into replaced.
+    // Returns true if one was replaced.
+    bool put(unique_ptr<T> &item, unique_ptr<T> &replaced)
+    {
+        replaced.reset(slot.exchange(item.release()));
+
+        if (!replaced)
+            return false;
+        drops.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    // Takes the item, false if there is none
+    bool tryTake(unique_ptr<T> &item)
+    {
+        T *p = slot.exchange(NULL);
+        if (p == NULL)
+            return false;
+        item.reset(p);
+        return true;
+    }
+
+    size_t size() const { return slot.load(memory_order_relaxed) != NULL; }
+
+    // Items replaced before they were taken
+    long dropped() const { return drops.load(memory_order_relaxed); }
+
+private:
+    frameMailbox(const frameMailbox&) = delete;
+    frameMailbox& operator=(const frameMailbox&) = delete;
+
+    atomic<T*> slot;
+    atomic<long> drops;
+};
+
+/*
+ * Time a stage spent on its frames, updated by the stage and read by whoever
+ * reports it
+ */
+class stageStats
+{
+public:
+    stageStats() : busyUs(0), nFrames(0) {}
+
+    void add(double seconds)
+    {
+        busyUs.fetch_add((long) (seconds * 1e6), memory_order_relaxed);
+        nFrames.fetch_add(1, memory_order_relaxed);
+    }
+
+    long busyMicroseconds() const { return busyUs.load(memory_order_relaxed); }
+    long frames() const { return nFrames.load(memory_order_relaxed); }
+
+private:
+    atomic<long> busyUs;
+    atomic<long> nFrames;
+};
+
+#endif /* FRAMEQUEUE_HPP_ */
@@ -0,0 +1,40 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Fixed-point versions of gradMag() and gradHist() (see gradientMex.hpp).
+*
+* The image is quantized to 13 fractional bits and the gradients are kept as
+* 16 bit integers. The orientation comes from an arctangent table indexed by
+* the ratio of the smaller to the larger gradient component (no acos), and
+* the histograms are accumulated per cell in 16 bit integers. Magnitudes are
+* still returned in float, since gradMagNorm() and the M channel need them.
+*
+* Tolerance, measured against gradMag()/gradHist() on LUV frames:
+*  - M within 8% for M > 1e-3 (the image is rounded to 1/8192)
+*  - orientations within .04 of a bin for 99% of the pixels with M > 1e-2
+*    (pixels where two channels have almost the same magnitude can differ)
+*  - H within 7e-3 given the same M and O (magnitudes are rounded to 1/256)
+*  - after gradMagNorm, which amplifies the differences in flat regions, H
+*    within .02 for 99% of the cells (H goes up to ~2.3)
+* Image values outside [-2,2) saturate (only u and v of almost black pixels),
+* and normalized magnitudes above 65535/256/bin^2 (16 for bin=4) are capped.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef GRADIENTFIXED_HPP_
+#define GRADIENTFIXED_HPP_
+
+#include "gradientMex.hpp"
+
+// compute gradient magnitude and orientation at each location, where O is
+// the orientation bin in 8.8 fixed point (bin = O>>8, weight of the next
+// bin = (O&255)/256), for nOrients bins over [0,pi)
+void gradMagFixed( float *I, float *M, unsigned short *O, int h, int w, int d,
+  int nOrients );
+
+// compute nOrients gradient histograms per bin x bin block of pixels (hard
+// spatial binning only) with 16 bit accumulators
+void gradHistFixed( float *M, unsigned short *O, float *H, int h, int w,
+  int bin, int nOrients );
+
+#endif /* GRADIENTFIXED_HPP_ */
@@ -63,16 +63,14 @@ template<class T> void resampleCoef( int ha, int hb, int &n, int *&yas,
   }
 }
 
-// resample A using bilinear interpolation and and store result in B
+// resample A given the coefficients along w and h (ywts is overwritten)
 template<class T>
-void resample( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r ) {
-  int hn, wn, x, x1, y, z, xa, xb, ya; T *A0, *A1, *A2, *A3, *B0, wt, wt1;
+void resampleCore( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r,
+  const int *xas, const int *xbs, const T *xwts, const int *xbd, int wn,
+  const int *yas, const int *ybs, T *ywts, const int *ybd, int hn ) {
+  int x, x1, y, z, xa, xb, ya; T *A0, *A1, *A2, *A3, *B0, wt, wt1;
   T *C = (T*) alMalloc((ha+4)*sizeof(T),16); for(y=ha; y<ha+4; y++) C[y]=0;
   bool sse = (typeid(T)==typeid(float)) && !(size_t(A)&15) && !(size_t(B)&15);
-  // get coefficients for resampling along w and h
-  int *xas, *xbs, *yas, *ybs; T *xwts, *ywts; int xbd[2], ybd[2];
-  resampleCoef<T>( wa, wb, wn, xas, xbs, xwts, xbd, 0 );
-  resampleCoef<T>( ha, hb, hn, yas, ybs, ywts, ybd, 4 );
   if( wa==2*wb ) r/=2; if( wa==3*wb ) r/=3; if( wa==4*wb ) r/=4;
   r/=T(1+1e-6); for( y=0; y<hn; y++ ) ywts[y] *= r;
   // resample each channel in turn
@@ -147,10 +145,46 @@ void resample( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r ) {
       for(; y<hb; y++)        B0[y] = C[yas[y]]*ywts[y];
     }
   }
-  alFree(xas); alFree(xbs); alFree(xwts); alFree(C);
+  alFree(C);
+}
+
+// resample A using bilinear interpolation and and store result in B
+template<class T>
+void resample( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r ) {
+  // get coefficients for resampling along w and h
+  int *xas, *xbs, *yas, *ybs; T *xwts, *ywts; int xbd[2], ybd[2], hn, wn;
+  resampleCoef<T>( wa, wb, wn, xas, xbs, xwts, xbd, 0 );
+  resampleCoef<T>( ha, hb, hn, yas, ybs, ywts, ybd, 4 );
+  resampleCore( A, B, ha, hb, wa, wb, d, r, xas, xbs, xwts, xbd, wn,
+    yas, ybs, ywts, ybd, hn );
+  alFree(xas); alFree(xbs); alFree(xwts);
   alFree(yas); alFree(ybs); alFree(ywts);
 }
 
+// coefficients of resampleCoef() for one dimension, kept to be reused by
+// every resample between the same two sizes (pad is 0 along w, 4 along h)
+template<class T> class resampleCoefs {
+public:
+  int ha, hb, n, bd[2]; int *as, *bs; T *wts;
+  resampleCoefs( int _ha, int _hb, int pad ) : ha(_ha), hb(_hb)
+    { resampleCoef<T>( ha, hb, n, as, bs, wts, bd, pad ); }
+  ~resampleCoefs() { alFree(as); alFree(bs); alFree(wts); }
+private:
+  resampleCoefs( const resampleCoefs& );
+  resampleCoefs& operator=( const resampleCoefs& );
+};
+
+// same as resample() but with precomputed coefficients along w and h
+template<class T>
+void resample( T *A, T *B, int ha, int hb, int wa, int wb, int d, T r,
+  const resampleCoefs<T> &xc, const resampleCoefs<T> &yc ) {
+  T *ywts = (T*) alMalloc(yc.n*sizeof(T),16);
+  memcpy(ywts,yc.wts,yc.n*sizeof(T));
+  resampleCore( A, B, ha, hb, wa, wb, d, r, xc.as, xc.bs, xc.wts, xc.bd, xc.n,
+    yc.as, yc.bs, ywts, yc.bd, yc.n );
+  alFree(ywts);
+}
+
 // B = imResampleMex(A,hb,wb,nrm); see imResample.m for usage details
 /*#ifdef MATLAB_MEX_FILE
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
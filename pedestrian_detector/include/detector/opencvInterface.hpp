@@ -45,6 +45,14 @@ Mat* convertToMatChannel(const float* data, int height, int width, int channels,
 float* convertFromMat(const Mat& data, int height, int width, int channels,
 		int misalign);
 
+/*
+ * Row-major (OpenCV layout) counterpart of convertFromMat for 8 bit BGR
+ * images: splits the planes in RGB order and scales them by 1/255 straight
+ * into the toolbox buffer, with no transposition and no float copy of the
+ * interleaved image.
+ */
+float* convertFromMatRowMajor(const Mat& bgr, int misalign);
+
 void writeToMatlab(const float* data, int height, int width, int channels,
 		int misalign, string filename, string name);
 
@@ -20,6 +20,7 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <memory>
 
 /*
  * Our Includes
@@ -62,8 +63,23 @@ public:
 
     // Number of channels of the input image
     int nrChannels;
-    // Number of scales to approximate between real scales
-    int nrScales;
+    // Number of scales per octave
+    int nPerOct;
+    // Number of scales to approximate between real scales (-1 = nPerOct-1)
+    int nApprox;
+    // Number of upsampled octaves to compute
+    int nOctUp;
+    // Power law coefficients per channel type (empty = estimate them)
+    vector<float> lambdas;
+    // Number of frames to estimate the lambdas on (0 = on every frame)
+    int lambdaFrames;
+    // Smoothing radius of the image and of the channels
+    float smoothIm;
+    float smoothChns;
+    // Channel downsampling
+    int shrink;
+    // Compute the gradients and histograms in fixed point
+    bool fixedPointGradients;
     // Minimum Dimensions
     int minH; // Height
     int minW; // Width
@@ -113,26 +129,85 @@ public:
 };
 
 
+/*
+ * The configurations and the classifiers. Nothing changes them once they are
+ * loaded, so the detectors of several cameras share one model.
+ */
+class detectorModel
+{
+public:
+    unique_ptr<helperXMLParser> parsed;
+    unique_ptr<helperXMLParser> parsedHeads;
+    unique_ptr<ClassRectangles> rectangles;
+    unique_ptr<ClassData> classData;
+    unique_ptr<ClassData> classDataHeads;
+
+    detectorModel(string configuration, string configHeadAndShoulders, string class_path);
+
+private:
+    detectorModel(const detectorModel&) = delete;
+    detectorModel& operator=(const detectorModel&) = delete;
+};
+
+/*
+ * The state of the detector of one camera: its pyramid settings (and cache),
+ * and its classifier inputs. Detectors do not share state, besides the model,
+ * so different detectors can run in different threads at once.
+ */
 class pedestrianDetector
 {
 
 public:
-    ClassRectangles *rectangles;
-    ClassData *classData;
-    ClassData *classDataHeads;
-    classifierInput *sctInput;
-    classifierInput *sctInputHeads;
-    int *pad;
-    pyrInput *pInput;
-    helperXMLParser *parsed;
-    helperXMLParser *parsedHeads;
-
+    shared_ptr<const detectorModel> model;
+    const helperXMLParser *parsed;		// the model's
+    const helperXMLParser *parsedHeads;
+    unique_ptr<classifierInput> sctInput;
+    unique_ptr<classifierInput> sctInputHeads;
+    unique_ptr<pyrInput> pInput;
+
+    // Detections of the last frame (NULL for a detector that did not run).
+    // They point into the detector and are overwritten by the next frame.
     vector<DetectionWithScore>* boundingBoxes;
     vector<DetectionWithScore>* headBoundingBoxes;
 
     std::string detectorType;
     
     pedestrianDetector(string configuration, string configHeadAndShoulders, string detectorType, string class_path);
+    pedestrianDetector(const shared_ptr<const detectorModel> &model, string detectorType);
     ~pedestrianDetector();
     void runDetector(const Mat img_original);
+
+    // The two steps of runDetector, for callers that run them in different
+    // threads: the pyramid of a frame (in the buffers of the pyramid given),
+    // then the classifiers on it, trying a window every scanStride channel
+    // pixels. With pInput->bandHeight > 0 the scales are scanned while they
+    // are built, so computePyramid already returns the detections and leaves
+    // the pyramid empty (scanPyramid does nothing).
+    //
+    // computePyramid uses pInput (and its cache), scanPyramid only reads the
+    // model and the classifier inputs, and both write only to what they are
+    // given. So computePyramid of a frame may run in one thread while
+    // scanPyramid of the previous frame runs in another, with their own
+    // pyramids and vectors. pInput may only be changed by the thread that
+    // computes the pyramids, and the rest of the detector (runDetector, the
+    // classifier inputs) by nobody while the two steps are in use.
+    bool computePyramid(const Mat &img_original, int scanStride,
+                        pyrOutput &pyramid,
+                        vector<DetectionWithScore> &pedestrians,
+                        vector<DetectionWithScore> &heads);
+    void scanPyramid(const pyrOutput &pyramid, int scanStride,
+                     vector<DetectionWithScore> &pedestrians,
+                     vector<DetectionWithScore> &heads);
+
+    bool runsPedestrians() const;
+    bool runsHeads() const;
+
+private:
+    pedestrianDetector(const pedestrianDetector&) = delete;
+    pedestrianDetector& operator=(const pedestrianDetector&) = delete;
+
+    // Kept from frame to frame, so their memory is reused
+    vector<DetectionWithScore> pedestrians;
+    vector<DetectionWithScore> heads;
+    pyrOutput pyramid;
 };
@@ -0,0 +1,145 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Frame to frame cache of the pyramid channels. With a static camera most of
+* the image does not change between frames, so chnsPyramid() only recomputes
+* the tiles of the real scales that see a change, and takes the scales
+* approximated from an unchanged real scale straight from the last frame.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef PYRCACHE_HPP_
+#define PYRCACHE_HPP_
+
+/*
+ * System includes
+ */
+#include <memory>
+#include <vector>
+
+/*
+ * Our includes
+ */
+#include "chnsCompute.hpp"
+#include "pyrScale.hpp"
+#include "scalePlan.hpp"
+
+using namespace std;
+
+/*
+ * How much of the pyramid was reused. Only the thread that computes the
+ * pyramids may read it; others get copies of the ratios from that thread.
+ */
+class pyrCacheStats
+{
+public:
+    long frames;
+    long tiles;		// tiles of the real scales, computed or reused
+    long tilesReused;
+    long scales;	// finished scales, computed or reused
+    long scalesReused;
+
+    pyrCacheStats() :
+        frames(0),
+        tiles(0),
+        tilesReused(0),
+        scales(0),
+        scalesReused(0) {}
+
+    float tileReuse() const { return tiles > 0 ? (float) tilesReused / tiles : 0.f; }
+    float scaleReuse() const { return scales > 0 ? (float) scalesReused / scales : 0.f; }
+};
+
+/*
+ * The frame is split in maskTile x maskTile tiles, and a tile changed if the
+ * mean absolute difference of its (LUV) pixels to the last frame is above
+ * threshold. A tile of a real scale is reused while none of the mask tiles
+ * it is computed from changed (margins included), and it is refreshed every
+ * maxAge frames anyway so slow changes below the threshold can not pile up.
+ * The scales of a real scale are reused if all its tiles are.
+ *
+ * The caller can give its own change mask instead (setChangeMask), and has
+ * to report the image shift caused by ego-motion (setEgoShift): channels are
+ * not shifted, so when the camera rotates nothing is reused.
+ *
+ * Tiles are as tall as the bands and as wide as they are tall, so the cache
+ * needs pyrInput::bandHeight > 0 to reuse anything but whole scales.
+ */
+class pyrChannelCache
+{
+public:
+    int maskTile;	// [16] side of the change mask tiles, in frame pixels
+    float threshold;	// [.01] mean absolute difference of a changed tile
+    float maxShift;	// [.5] ego-motion shift (pixels) that discards the cache
+    int maxAge;		// [30] frames a tile is reused before it is refreshed
+
+    pyrChannelCache();
+    ~pyrChannelCache();
+
+    // Change mask for the next frame, maskTilesX() x maskTilesY() values row
+    // by row (non zero = changed). It replaces the frame difference.
+    void setChangeMask(const vector<unsigned char> &mask);
+
+    // Image shift since the last frame, in pixels, from the robot odometry
+    void setEgoShift(float dx, float dy);
+
+    // Forgets everything, the next frame is computed from scratch
+    void clear();
+
+    int maskTilesX() const { return tilesX; }
+    int maskTilesY() const { return tilesY; }
+
+    const pyrCacheStats& stats() const { return counters; }
+    void resetStats() { counters = pyrCacheStats(); }
+
+    /*
+     * Used by chnsPyramid()
+     */
+
+    // I is the frame after the color conversion, laid out as plan->key.layout
+    void beginFrame(const float *I, int height, int width, int channels,
+                    const shared_ptr<const scalePlan> &plan);
+
+    // Tile t of band b of the it-th real scale / all the tiles and the
+    // finished scales of the it-th real scale
+    bool tileReusable(int it, int b, int t) const;
+    bool groupReusable(int it, const float *lambdas) const;
+
+    // Last frame's channels of the it-th real scale, before smoothing
+    const pyrScale* realChannels(int it) const;
+    int channelTypes() const { return nTypes; }
+
+    // Finished channels of scale i, NULL if there are none
+    pyrScalePtr finishedChannels(int i) const;
+
+    void tileComputed(int it, int b, int t);
+    void countTiles(int n, int reused);
+    void countScale(bool reused);
+
+    // Takes chns / shares the finished scale with the pyramid, no copy is
+    // made
+    void storeReal(int it, unique_ptr<pyrScale> chns);
+    void storeFinished(int i, const pyrScalePtr &chns, const float *lambdas);
+
+private:
+    shared_ptr<const scalePlan> plan;
+    int height, width;
+    int tilesX, tilesY;
+    int nTypes;
+
+    vector<unsigned char> previous;	// last frame, quantized to 8 bits
+    vector<unsigned char> changed;	// mask of this frame
+    vector<unsigned char> external;	// mask given for the next frame
+    bool shifted;
+
+    vector< unique_ptr<pyrScale> > real; // [nReal] unsmoothed real scales
+    vector< vector<int> > age;		// [nReal][band*nTiles + tile], -1 = none
+    vector<pyrScalePtr> finished;	// [nScales]
+    vector<float> lambdas;		// lambdas the finished scales used
+
+    pyrCacheStats counters;
+
+    void freeAll();
+};
+
+#endif /* PYRCACHE_HPP_ */
@@ -0,0 +1,68 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* The channels of one scale of a pyramid, shared between the pyramids of
+* consecutive frames and the channel cache.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef PYRSCALE_HPP_
+#define PYRSCALE_HPP_
+
+/*
+ * System includes
+ */
+#include <memory>
+#include <vector>
+
+/*
+ * Our includes
+ */
+#include "chnsCompute.hpp"
+
+using namespace std;
+
+/*
+ * One imgWrap per channel type (entries can be NULL), deleted with the scale.
+ * In a finished scale the types are consecutive in one buffer owned by the
+ * first entry (see pyrOutput). chnsPyramid() also keeps the channels of the
+ * real scales, before they are finished, in one (through a unique_ptr).
+ *
+ * A finished scale is never written again, so a pyramid and the channel cache
+ * hold the same one (pyrScalePtr) instead of copies. Its buffers go back to
+ * the pool when the last of them lets it go, and the scale keeps the pool
+ * alive until then.
+ */
+class pyrScale
+{
+public:
+    explicit pyrScale(int nTypes,
+                      const shared_ptr<chnPool> &_pool = shared_ptr<chnPool>()) :
+        pool(_pool),
+        chns(nTypes, (imgWrap*) NULL) {}
+
+    ~pyrScale()
+    {
+        for (size_t j = 0; j < chns.size(); j++)
+            delete chns[j];
+    }
+
+    int nTypes() const { return (int) chns.size(); }
+
+    imgWrap*& operator[](int j) { return chns[j]; }
+    imgWrap* operator[](int j) const { return chns[j]; }
+
+    // As handed to a pyrScaleConsumer
+    imgWrap *const * data() const { return &chns[0]; }
+
+private:
+    pyrScale(const pyrScale&) = delete;
+    pyrScale& operator=(const pyrScale&) = delete;
+
+    shared_ptr<chnPool> pool;	// released after chns
+    vector<imgWrap*> chns;
+};
+
+typedef shared_ptr<const pyrScale> pyrScalePtr;
+
+#endif /* PYRSCALE_HPP_ */
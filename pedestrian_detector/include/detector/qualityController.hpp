@@ -0,0 +1,68 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Adaptive quality of the detector. The cost of a frame changes a lot with
+* the scene, so when the frames take longer than the budget the detector
+* steps down to cheaper settings, and back up when there is time again.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef QUALITYCONTROLLER_HPP_
+#define QUALITYCONTROLLER_HPP_
+
+/*
+ * System includes
+ */
+#include <vector>
+
+using namespace std;
+
+/*
+ * Settings of the detector at one quality level
+ */
+class qualityLevel
+{
+public:
+    float imageScale;	// frame resized by this before the detection (the
+                        // smallest people are not found anymore)
+    int nPerOct;	// scales per octave of the pyramid
+    int scanStride;	// windows tried every scanStride channel pixels
+
+    qualityLevel(float _imageScale, int _nPerOct, int _scanStride) :
+        imageScale(_imageScale),
+        nPerOct(_nPerOct),
+        scanStride(_scanStride) {}
+};
+
+/*
+ * Level 0 is the best quality. Every frame reports the moving average of the
+ * latency; above budgetMs the level goes up one step (cheaper), below
+ * budgetMs*lowerRatio it goes down one step. In between it stays, and a level
+ * is kept for holdFrames frames at least, so the average reflects it before
+ * the next change.
+ */
+class qualityController
+{
+public:
+    float budgetMs;	// [0] latency per frame (0 = always at level 0)
+    float lowerRatio;	// [.6] fraction of the budget to go back up
+    int holdFrames;	// [10] frames between changes
+
+    vector<qualityLevel> levels;
+
+    // Levels from the settings of the configuration (nPerOct) down to
+    // a half size frame with 4 scales per octave and a stride of 2
+    explicit qualityController(int nPerOct);
+
+    // Latency (moving average) of the last frame. True if the level changed.
+    bool update(float averageMs);
+
+    int level() const { return current; }
+    const qualityLevel& settings() const { return levels[current]; }
+
+private:
+    int current;
+    int sinceChange;
+};
+
+#endif /* QUALITYCONTROLLER_HPP_ */
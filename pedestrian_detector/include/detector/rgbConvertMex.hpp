@@ -29,6 +29,19 @@
 #include <typeinfo>
 #include "sse.hpp"
 
+// Fills the lookup table for y->l conversion
+template<class oT> bool rgb2luv_lTable( oT *lTable, oT y0, oT a, oT maxi )
+{
+  oT y, l;
+  for(int i=0; i<1025; i++) {
+    y = (oT) (i/1024.0);
+    l = y>y0 ? 116*(oT)pow((double)y,1.0/3.0)-16 : y*a;
+    lTable[i] = l*maxi;
+  }
+  for(int i=1025; i<1064; i++) lTable[i]=lTable[i-1];
+  return true;
+}
+
 // Constants for rgb2luv conversion and lookup table for y-> l conversion
 template<class oT> oT* rgb2luv_setup( oT z, oT *mr, oT *mg, oT *mb,
   oT &minu, oT &minv, oT &un, oT &vn )
@@ -42,15 +55,10 @@ template<class oT> oT* rgb2luv_setup( oT z, oT *mr, oT *mg, oT *mb,
   mb[0]=(oT) 0.178325*z; mb[1]=(oT) 0.071330*z; mb[2]=(oT) 0.939180*z;
   oT maxi=(oT) 1.0/270; minu=-88*maxi; minv=-134*maxi;
   // build (padded) lookup table for y->l conversion assuming y in [0,1]
-  static oT lTable[1064]; static bool lInit=false;
-  if( lInit ) return lTable; oT y, l;
-  for(int i=0; i<1025; i++) {
-    y = (oT) (i/1024.0);
-    l = y>y0 ? 116*(oT)pow((double)y,1.0/3.0)-16 : y*a;
-    lTable[i] = l*maxi;
-  }
-  for(int i=1025; i<1064; i++) lTable[i]=lTable[i-1];
-  lInit = true; return lTable;
+  // (once, the first thread to get here builds it for all)
+  static oT lTable[1064];
+  static const bool lInit=rgb2luv_lTable(lTable,y0,a,maxi);
+  (void) lInit; return lTable;
 }
 
 // Convert from rgb to luv
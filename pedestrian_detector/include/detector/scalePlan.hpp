@@ -0,0 +1,122 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Everything chnsPyramid() needs to know about the scales of a pyramid that
+* only depends on the image size and on the pyramid parameters.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef SCALEPLAN_HPP_
+#define SCALEPLAN_HPP_
+
+/*
+ * System includes
+ */
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ * Our includes
+ */
+#include "getScales.hpp"
+#include "imResampleMex.hpp"
+
+using namespace std;
+
+/*
+ * Parameters a scale plan depends on
+ */
+class scaleKey
+{
+public:
+    int height;
+    int width;
+    int nPerOct;
+    int nOctUp;
+    int nApprox;
+    int minDs[2];
+    int shrink;
+    int pad[2];
+    int layout;
+    int bandHeight;	// rows per band of the real scales (0 = whole image)
+    int bandMargin;	// extra rows computed on each side of a band
+    int tileWidth;	// columns per tile of the bands (0 = whole rows)
+
+    bool operator<(const scaleKey &other) const;
+};
+
+/*
+ * Rows [y0, y1) of a real scale image, computed from rows [e0, e1)
+ */
+class pyrBand
+{
+public:
+    int y0, y1;
+    int e0, e1;
+};
+
+/*
+ * Columns [x0, x1) of the bands of a real scale, computed from columns
+ * [e0, e1). Tiles are only used by the channel cache (see pyrCache.hpp).
+ */
+class pyrTile
+{
+public:
+    int x0, x1;
+    int e0, e1;
+};
+
+/*
+ * Scales, real/approximated scale mapping, sizes and resampling coefficients
+ * of a pyramid. Plans are immutable once built, so the same plan is shared
+ * by every frame (and thread) with the same key.
+ */
+class scalePlan
+{
+public:
+    scaleKey key;
+
+    int nScales;
+    vector<float> scales;	// [nScales] relative scales (approximate)
+    vector<float> scaleshw;	// [nScales x 2] exact scales for h and w
+
+    vector<int> isR;		// real scales (computed with chnsCompute)
+    vector<int> isA;		// approximated scales
+    vector<int> isN;		// [nScales] nearest real scale of every scale
+
+    // Real scales only: size of the image the channels are computed on, and
+    // of the image it is resampled from (the image is halved at scale .5)
+    vector<int> imgHeight, imgWidth;
+    vector<int> srcHeight, srcWidth;
+    vector<bool> replacesSource;
+    vector< vector<pyrBand> > bands;
+    vector< vector<pyrTile> > tiles;
+
+    // All scales: size of the shrunk channels, before and after padding
+    vector<int> chnHeight, chnWidth;
+    vector<int> padHeight, padWidth;
+
+    // Real scales used to estimate lambdas (-1 if there are not enough)
+    int lambdaScales[2];
+
+    // Coefficients to resample along the height and the width from na to nb
+    const resampleCoefs<float>& heightCoefs(int na, int nb) const;
+    const resampleCoefs<float>& widthCoefs(int na, int nb) const;
+
+    /*
+     * Returns the plan for key, building it on first use. Thread safe.
+     */
+    static shared_ptr<const scalePlan> get(const scaleKey &key);
+
+private:
+    typedef map< pair<int,int>, shared_ptr< resampleCoefs<float> > > coefMap;
+    coefMap hCoefs;
+    coefMap wCoefs;
+
+    explicit scalePlan(const scaleKey &key);
+    void addResample(int ha, int hb, int wa, int wb);
+};
+
+#endif /* SCALEPLAN_HPP_ */
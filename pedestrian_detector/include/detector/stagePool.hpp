@@ -0,0 +1,86 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Threads shared by the pipelines of several cameras. Every pipeline adds its
+* stages as tasks, and the threads take turns over all of them, so one node
+* runs any number of cameras on a fixed number of threads.
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+#ifndef STAGEPOOL_HPP_
+#define STAGEPOOL_HPP_
+
+/*
+ * System includes
+ */
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A task does one frame of work of a stage, and returns false if it had
+ * none. A thread goes over the tasks starting one past where the last round
+ * started, and starts a new round after every frame, so the cameras get
+ * their turns in order and a busy one can not starve the others. Threads
+ * sleep while no task has work; notify(), called when work is handed to a
+ * task, wakes one up. A thread does not go to sleep if there was a notify()
+ * since it started looking at the tasks, so no work is left waiting.
+ *
+ * A task never runs in two threads at once (a stage works on its frames in
+ * order, with state of its own), so threads beyond the number of tasks
+ * would only wait.
+ */
+class stagePool
+{
+public:
+    typedef function<bool()> task;
+
+    stagePool();
+    ~stagePool();
+
+    // Before start()
+    void add(const task &t);
+
+    // niceness > 0 runs the threads at a lower priority than the node
+    void start(int nThreads, int niceness = 0);
+
+    // Waits for the tasks that are running, the others are not run again
+    void stop();
+
+    // There is work for some task
+    void notify();
+
+    size_t tasks() const { return entries.size(); }
+    size_t threads() const { return workers.size(); }
+
+private:
+    stagePool(const stagePool&) = delete;
+    stagePool& operator=(const stagePool&) = delete;
+
+    struct entry
+    {
+        task run;
+        atomic<bool> busy;
+    };
+
+    vector< unique_ptr<entry> > entries;
+    vector<thread> workers;
+    atomic<bool> running;
+    atomic<size_t> nextRound;
+
+    mutex sleeping;
+    condition_variable wakeup;
+    atomic<unsigned long> notifications;	// changed under sleeping
+
+    void loop(int niceness);
+    bool runOne();
+};
+
+#endif /* STAGEPOOL_HPP_ */
@@ -35,10 +35,22 @@ public:
     cv::Rect_<int> bbox;
 };
 
+/*
+ * Detection Structure for output
+ */
+struct Detection
+{
+    double U0;
+    double V0;
+    double U1;
+    double V1;
+    double confidence;
+};
+
 class classifierInput {
 public:
-	ClassData *classData;
-	ClassRectangles *classRect;
+	const ClassData *classData;			      // shared, never changed
+	const ClassRectangles *classRect;
 
 	float widthOverHeight;	              //[0.41]
 	int shrinkFactor;		                  //[4]
@@ -86,8 +98,8 @@ public:
 	/*---------------------------*/
 
 
-  classifierInput(ClassData *classifier,
-                  ClassRectangles *rect,
+  classifierInput(const ClassData *classifier,
+                  const ClassRectangles *rect,
                   bool _verbose,
                   float _widthOverHeight,
                   int _shrinkFactor,
@@ -101,7 +113,8 @@ public:
 };
 
 /*
- * Functions to access classifier data
+ * Functions to access classifier data, through the globals classifierData
+ * and nWeakClassifiers (the scans do not set them, they are reentrant)
  */
 double alpha(int row);
 int feature(int row);
@@ -120,6 +133,49 @@ int directionNotSat(int row);
 const double magicThreshold = -1.0;
 vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput);
 
+// Same, into a vector the caller keeps from frame to frame, trying a window
+// every scanStride channel pixels. The stride is a setting of the frame, not
+// of the classifier, so a scan only reads cInput.
+void sctRun(const pyrOutput &outputPyr, classifierInput *cInput, int scanStride,
+            vector<DetectionWithScore> &detections);
+
+/*
+ * The two halves of sctRun: the scan of one scale, which appends to
+ * detections, and the non-maximal suppression of the detections of all
+ * scales
+ */
+void sctScanScale(const chnView &scaleData, int scaleId, float scale,
+                  classifierInput *cInput, int scanStride,
+                  list<Detection> &detections);
+vector<DetectionWithScore>* sctNms(list<Detection> &detections,
+                                   classifierInput *cInput);
+void sctNms(list<Detection> &detections, classifierInput *cInput,
+            vector<DetectionWithScore> &out);
+
+/*
+ * Runs one or more classifiers on the scales streamed by chnsPyramid(), so
+ * each scale is scanned while it is still in cache and freed right after.
+ * detections(k) gives what sctRun would give for the k-th classifier (with
+ * the same scanStride), and
+ * clear() gets the scanner ready for the next frame.
+ */
+class sctScaleScanner : public pyrScaleConsumer
+{
+public:
+    sctScaleScanner(int scanStride = 1) : stride(scanStride) {}
+
+    void addClassifier(classifierInput *cInput);
+    void consumeScale(int scaleId, float scale, imgWrap *const *chns);
+    vector<DetectionWithScore>* detections(int k);
+    void detections(int k, vector<DetectionWithScore> &out);
+    void clear();
+
+private:
+    int stride;
+    vector<classifierInput*> inputs;
+    vector< list<Detection> > found;
+};
+
 using namespace std;
 
 #endif /* STRONGCLASSIFIERTREE_HPP_ */
@@ -0,0 +1,40 @@
+#ifndef ASSIGNMENTSOLVER_HPP
+#define ASSIGNMENTSOLVER_HPP
+
+#include <vector>
+
+/*Linear assignment with the Jonker-Volgenant algorithm (LAPJV: column reduction, reduction
+  transfer, augmenting row reduction and then shortest augmenting paths), with the arguments
+  and the result of assignmentoptimal: distMatrixIn is nOfRows x nOfColumns in column major
+  order, assignment[row] is the column given to each row (-1 if none) and cost is the sum of
+  their costs. Rectangular problems are padded to a square one with zeros.
+
+  solveSparse() only looks at the pairs cheaper than gate (the 1000 of the association
+  costs): rows and columns are split in the connected components of those pairs and every
+  component is solved alone, so a crowd costs about as much as its groups of close people.
+  Rows with no gated pair, or left with a pair >= gate, are -1; the assignment of the gated
+  pairs is the same as the one of the whole matrix.
+
+  The buffers are kept from one call to the next, so nothing is allocated once they have
+  grown to the size of the scene.*/
+
+class AssignmentSolver
+{
+
+public:
+    void solve(double *assignment, double *cost, const double *distMatrixIn, int nOfRows, int nOfColumns);
+    void solveSparse(double *assignment, double *cost, const double *distMatrixIn, int nOfRows, int nOfColumns, double gate);
+
+private:
+    std::vector<double> c;                      //Square problem, row major
+    std::vector<double> v, d;                   //Column prices, shortest path costs
+    std::vector<int> rowsol, colsol, matches, freeRows, collist, pred;
+
+    std::vector<int> parent, label, members, start;
+    std::vector<int> rows, cols;
+
+    void lapjv(int n);
+    int find(int i);
+};
+
+#endif // ASSIGNMENTSOLVER_HPP
@@ -0,0 +1,82 @@
+#ifndef ASSOCIATIONCOSTS_HPP
+#define ASSOCIATIONCOSTS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../include/tracker/spatialGrid.hpp"
+#include "../include/tracker/parallelFor.hpp"
+
+using namespace cv;
+
+/*Costs of associating each detection to each tracker, for the Hungarian algorithm: the color
+  distance (Bhattacharyya distance of the BVT histograms) if the detection is inside the
+  validation gate of the tracker (squared Mahalanobis distance with the innovation covariance,
+  covariance of the tracker + covariance of the detection) and the colors are close enough,
+  and 1000 otherwise.
+
+  The detections are put in a SpatialGrid, and every tracker only looks at the ones close
+  enough to be inside its gate (the radius comes from the largest eigenvalue of the innovation
+  covariance), so in a crowd most of the pairs are never computed. The histograms are
+  normalized and square rooted once per detection and per tracker, so the Bhattacharyya
+  coefficient of a pair is a dot product, and the innovation covariances are 2x2 and inverted
+  in closed form (once per tracker when all the detections have the same covariance). Nothing
+  is allocated once the buffers have grown to the size of the scene.
+
+  With a ParallelFor, the trackers are split in chunks that run in its threads.*/
+
+class AssociationCosts
+{
+
+public:
+    AssociationCosts() : bins(0), sameCovariance(false), pool(NULL) {}
+
+    //NULL runs everything in the calling thread
+    void setPool(ParallelFor *pool) { this->pool = pool; }
+
+    void clear();
+
+    //Estimated position and its 2x2 covariance (of the mixture)
+    void addTracker(double x, double y, double cxx, double cxy, double cyy, const Mat &histogram);
+    //Detected position, with the mean and the 2x2 covariance of its error
+    void addDetection(double x, double y, const Mat &mean, const Mat &cov, const Mat &histogram);
+
+    //All the pairs. costs is nDetections x nTrackers, column major (as assignmentoptimal takes it)
+    void compute(double validationGate, double recognitionThreshold, double *costs);
+
+    int detections() const { return (int) detX.size(); }
+    int trackers() const { return (int) trackX.size(); }
+
+    //Of the last compute(). HUGE_VAL and 1 for the pairs that were not computed (the color is
+    //only computed inside the gate)
+    double distance(int detection, int tracker) const { return distances[detection*trackers()+tracker]; }
+    double colorDistance(int detection, int tracker) const { return colorDistances[detection*trackers()+tracker]; }
+
+    //Appends sqrt(h/sum(h)) to rows, returns the number of bins
+    static int appendHistogram(const Mat &histogram, std::vector<float> &rows);
+    //Bhattacharyya coefficient of two rows of appendHistogram
+    static double coefficient(const float *a, const float *b, int bins);
+
+private:
+    int bins;
+
+    std::vector<double> trackX, trackY, trackXX, trackXY, trackYY;
+    std::vector<double> detX, detY, detXX, detXY, detYY;
+    std::vector<float> trackHist, detHist;      //sqrt(h/sum(h)), one row per tracker or detection
+
+    bool sameCovariance;                        //All the detections
+    std::vector<double> invXX, invXY, invYY;    //Inverse innovation covariance of each tracker
+    std::vector<double> distances, colorDistances;
+
+    static const int chunkSize = 16;            //Trackers per chunk of the pool
+    ParallelFor *pool;
+    SpatialGrid detectionGrid;
+    std::vector< std::vector<int> > candidates; //Detections near a tracker, one list per chunk
+
+    void addHistogram(const Mat &histogram, std::vector<float> &rows);
+    void computeInverses();
+    double mahalanobis(int d, int t) const;
+    double bhattacharyya(int d, int t) const;
+    void computeTrackers(int begin, int end, double validationGate, double recognitionThreshold, double detectionEigenvalue, double *costs);
+};
+
+#endif // ASSOCIATIONCOSTS_HPP
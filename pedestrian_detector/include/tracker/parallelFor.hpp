@@ -0,0 +1,54 @@
+#ifndef PARALLELFOR_HPP
+#define PARALLELFOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*Threads for the loops over the tracks. run() splits [0, n) in chunks of grain elements, which
+  only depend on n and grain, and the threads (the calling one too) take them until there are
+  none left. Every chunk writes its own elements, so the result is the same with any number of
+  threads. With one thread, or only one chunk, the loop runs in the calling thread without
+  waking anybody.*/
+
+class ParallelFor
+{
+
+public:
+    //nThreads <= 0 is one per core
+    ParallelFor(int nThreads = 1);
+    ~ParallelFor();
+
+    void setThreads(int nThreads);
+    int threads() const { return (int) workers.size()+1; }
+
+    //body(begin, end) for every chunk, returns when all of them are done
+    void run(int n, int grain, const std::function<void(int, int)> &body);
+
+private:
+    ParallelFor(const ParallelFor&);
+    ParallelFor& operator=(const ParallelFor&);
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wakeup, finished;
+
+    //The job, under lock
+    const std::function<void(int, int)> *body;
+    int size, grain, nChunks;
+    unsigned generation;
+    int active;                                 //Threads working on it
+    int done;                                   //Chunks
+    bool stopping;
+
+    std::atomic<int> nextChunk;
+
+    void stop();
+    void loop();
+    void work();
+};
+
+#endif // PARALLELFOR_HPP
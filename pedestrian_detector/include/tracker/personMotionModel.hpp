@@ -6,8 +6,13 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
-#include <deque>
-#include "../include/tracker/mmae.hpp"
+#include "../include/tracker/trackBatch.hpp"
+#include "../include/tracker/associationCosts.hpp"
+#include "../include/tracker/assignmentSolver.hpp"
+#include "../include/tracker/spatialGrid.hpp"
+#include "../include/tracker/slidingMedian.hpp"
+#include "../include/tracker/parallelFor.hpp"
+#include "../include/tracker/reidGallery.hpp"
 
 
 
@@ -24,13 +29,9 @@ class PersonModel
 
 
     public:
-    double const_pos_var;
-    double const_vel_var;
-    double const_accel_var;
-
     int id;
     double metric_weight;
-    MMAEFilterBank *mmaeEstimator;
+    TrackBatch *tracks;             //Has the position filters of the track, by id
     //KALMAN de uma variavel ahahahahahaha
     double personHeight;
     double heightP;
@@ -38,8 +39,6 @@ class PersonModel
     double heightR;
     double heightK;
     //************************************
-    double delta_t;
-    double T;
     bool toBeDeleted;
 
     Point2d bbCenter;
@@ -55,15 +54,16 @@ class PersonModel
     Point3d position;
     Mat getBvtHistogram();
 
-    Point3d positionHistory[100];
+    SlidingMedian medianX, medianY, medianZ;    //Of the last median_window positions
     cv::Rect_<int> rectHistory[5];
     cv::Rect rect;
 
-    PersonModel(Point3d detectedPosition, cv::Rect_<int> bb, int id, int median_window, Mat bvtHistogram);
+    PersonModel(Point3d detectedPosition, cv::Rect_<int> bb, int id, int median_window, Mat bvtHistogram, TrackBatch *tracks);
 
     Point3d medianFilter();
     Point3d getPositionEstimate();
     Mat getCovarianceOfMixture();
+    std::vector<double> getModelProbabilities();
     void updateModel();
     Point3d getNearestPoint(vector<cv::Point3d> coordsInBaseFrame, Point3d estimation);
     double getScoreForAssociation(double height, Point3d detectedPosition, Mat detCov, Mat detectionColorHist, Mat trackerColorHist);
@@ -86,19 +86,37 @@ public:
     double const_pos_var;
     double const_vel_var;
     double const_accel_var;
+    double delta_t;
+    int frames;                         //associateData calls, the clock of the gallery
+    int reid_candidates;                //Of the gallery, looked at when a track is created
+    double reid_height_tolerance;
+    ParallelFor pool;                   //For the loops over the tracks, one thread unless set
+    TrackBatch tracks;                  //Position filters of all the tracks
+    AssociationCosts costs;             //Of the last associateData
+    AssignmentSolver solver;
+    SpatialGrid trackGrid;              //Estimated positions of the tracks, cells of creation_threshold
+    //Wall time of the stages of the last associateData, in ms
+    enum { STAGE_PREDICT, STAGE_COSTS, STAGE_ASSIGNMENT, STAGE_UPDATE, nStages };
+    double stageTime[nStages];
     void associateData(vector<cv::Point3d> coordsInBaseFrame, vector<cv::Rect_<int> > rects, vector<Mat> colorFeaturesList, vector<Mat> means, vector<Mat> covariances);
-    void addPerson(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram);
+    //A new id, or the one given
+    void addPerson(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram, int id = -1);
+    //Only if there is no track closer than creation_threshold. Takes the id of a lost track of
+    //the gallery if one looks the same
+    void addPersonIfFree(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram);
     std::vector<PersonModel> personList;
-    std::deque<PersonModel> holdList;   //For Re-ID purposes
+    ReidGallery gallery;                //Lost tracks, for Re-ID purposes
+    std::vector<ReidGallery::Match> reidMatches;
     void predictList();
     void updateList();
     void updateDeltaT(double delta_t);
 
     PersonList(int median_window, int numberOfFramesBeforeDestruction, int numberOfFramesBeforeDestructionLocked, double creation_threshold, double validation_gate, double metric_weight, double recognition_threshold, double c_learning_rate, double const_pos_var, double const_vel_var, double const_accel_var);
     ~PersonList();
-    //Returns a vector containing positions associated to each tracker, that are valid after the median filter
-    std::vector<PersonModel> getValidTrackerPosition();
-    //Returns a list of deleted tracklets
+    //Returns the trackers whose positions are valid after the median filter. The pointers are
+    //only good until the list changes (associateData or trackletKiller)
+    std::vector<PersonModel*> getValidTrackerPosition();
+    //Returns a list of deleted tracklets, which go to the gallery
     std::vector<int> trackletKiller();
     cv::Mat plotReprojectionAndProbabilities(int targetId, cv::Mat baseFootprintToCameraTransform, cv::Mat K, cv::Mat lastImage);
 
@@ -0,0 +1,58 @@
+#ifndef REIDGALLERY_HPP
+#define REIDGALLERY_HPP
+
+#include <opencv2/opencv.hpp>
+#include <utility>
+#include <vector>
+
+using namespace cv;
+
+/*Tracks lost recently, to give their ids back when the same person is detected again. Each
+  one keeps its BVT histogram as sqrt(h/sum(h)), the rows of one matrix, so the Bhattacharyya
+  coefficient of a new detection with all of them is a dot product per row (the same as the
+  association costs), and its height.
+
+  There are capacity tracks at most (the oldest one leaves when a new one comes) and they are
+  forgotten timeToLive frames after they were lost, so the memory and the time of a search are
+  bounded. Rows are moved when a track leaves, so ids, not rows, name them.*/
+
+class ReidGallery
+{
+
+public:
+    struct Match
+    {
+        int id;
+        double distance;                        //Bhattacharyya, as compareHist
+        double height;
+    };
+
+    ReidGallery(int capacity = 100, int timeToLive = 300);
+
+    //capacity 0 keeps nothing
+    void setLimits(int capacity, int timeToLive);
+    int size() const { return (int) ids.size(); }
+
+    //A track lost at frame
+    void add(int id, const Mat &histogram, double height, int frame);
+    void remove(int id);
+    //Forgets the tracks lost more than timeToLive frames before frame
+    void expire(int frame);
+
+    //The k tracks with the closest histograms, closest first
+    void query(const Mat &histogram, int k, std::vector<Match> &matches);
+
+private:
+    int capacity, timeToLive;
+    int bins;
+    std::vector<float> rows;                    //sqrt(h/sum(h)), one row per track
+    std::vector<int> ids, lostAt;
+    std::vector<double> heights;
+
+    std::vector<float> queryRow;
+    std::vector< std::pair<double, int> > scores;
+
+    void erase(int row);
+};
+
+#endif // REIDGALLERY_HPP
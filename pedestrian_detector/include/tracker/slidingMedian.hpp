@@ -0,0 +1,44 @@
+#ifndef SLIDINGMEDIAN_HPP
+#define SLIDINGMEDIAN_HPP
+
+#include <vector>
+
+/*Median of the last values of a signal. The window is a ring buffer, and its values are also
+  kept sorted in a treap (a binary search tree balanced by random priorities) whose nodes are
+  the slots of the ring, with the size of every subtree, so a new value (that replaces the
+  oldest one) and the median are O(log window). All the memory is taken by reset().
+
+  The median of an even window is the upper one, element window/2 of the sorted values.*/
+
+class SlidingMedian
+{
+
+public:
+    SlidingMedian(int window = 1, double initial = 0);
+
+    //window values equal to initial
+    void reset(int window, double initial);
+    //Values that are not finite are left out
+    void push(double value);
+
+    double median() const;
+    double newest() const { return values[newestSlot]; }
+    int window() const { return (int) values.size(); }
+
+private:
+    std::vector<double> values;                 //Ring buffer, one treap node per slot
+    std::vector<int> left, right, sizes;
+    std::vector<unsigned> priorities;
+    int root;
+    int newestSlot;
+
+    bool less(int a, int b) const;
+    int size(int node) const { return node < 0 ? 0 : sizes[node]; }
+    void update(int node);
+    void split(int node, int key, int &lower, int &upper);
+    int merge(int lower, int upper);
+    int insert(int node, int key);
+    int erase(int node, int key);
+};
+
+#endif // SLIDINGMEDIAN_HPP
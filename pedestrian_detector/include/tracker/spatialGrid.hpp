@@ -0,0 +1,50 @@
+#ifndef SPATIALGRID_HPP
+#define SPATIALGRID_HPP
+
+#include <vector>
+
+/*Points of the ground plane (tracks or detections) hashed in square cells, to find the ones
+  near a position without looking at all of them. The cells are kept in a hash table of
+  linked lists, so the grid has no bounds, and inserting is O(1): it can be rebuilt every
+  frame, or grown while a frame is processed. A query looks at the cells that overlap the
+  circle, or at all the points when there are fewer points than cells to look at (a huge
+  radius).
+
+  Nothing is allocated once the buffers have grown to the size of the scene.*/
+
+class SpatialGrid
+{
+
+public:
+    SpatialGrid(double cellSize = 1.0);
+
+    //Also removes all the points
+    void setCellSize(double cellSize);
+    double cellSize() const { return cell; }
+
+    void clear();
+    //Points that are not finite are left out
+    void insert(int id, double x, double y);
+    int size() const { return (int) ids.size(); }
+
+    //ids of the points closer than radius to (x, y), in no particular order. Nothing is near a
+    //position that is not finite
+    void query(double x, double y, double radius, std::vector<int> &found) const;
+    bool anyWithin(double x, double y, double radius) const;
+
+private:
+    double cell;
+    std::vector<double> xs, ys;
+    std::vector<int> ids, cellX, cellY;
+    std::vector<int> next;                      //Next point of the same bucket, -1 at the end
+    std::vector<int> heads;                     //First point of every bucket, size is a power of 2
+
+    int coordinate(double v) const;
+    int bucket(int cx, int cy) const;
+    void rehash(int nBuckets);
+
+    //Calls visit(id) for the points within radius until it returns true. Returns true if it did
+    template<class Visitor> bool visit(double x, double y, double radius, Visitor &visitor) const;
+};
+
+#endif // SPATIALGRID_HPP
@@ -0,0 +1,100 @@
+#ifndef TRACKBATCH_HPP
+#define TRACKBATCH_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <unordered_map>
+#include "../include/tracker/parallelFor.hpp"
+
+using namespace cv;
+
+/*MMAE (constant position, velocity and acceleration models, states [x y], [x y vx vy] and
+  [x y vx vy ax ay]) of all the tracks of a PersonList. Every element of the states, covariances
+  and probabilities is stored in an array over the tracks (a lane), so predict() and correct()
+  are loops over contiguous memory, the same computations as MMAEFilterBank for every track.
+
+  With a ParallelFor, predict() and correct() of all the tracks are split in chunks of tracks
+  that run in its threads, with the same results.
+
+  Tracks are found by their id. The slot of a track (its index in the lanes) changes when
+  another track is removed, so slots are only valid until the next add() or remove().*/
+
+class TrackBatch
+{
+
+public:
+    enum { nModels = 3, nStates = 6 };
+
+    //T is the period the models are tuned for
+    TrackBatch(double T = 0.01);
+
+    void setProcessNoise(double positionVar, double velocityVar, double accelerationVar);
+    //NULL runs everything in the calling thread
+    void setPool(ParallelFor *pool) { this->pool = pool; }
+
+    //A track at (x, y), stopped. Returns its slot
+    int add(int id, double x, double y);
+    void remove(int id);
+
+    int slot(int id) const;                     //-1 if there is no track with that id
+    int id(int slot) const { return ids[slot]; }
+    int size() const { return (int) ids.size(); }
+    double period() const { return T; }
+
+    //steps periods ahead, all the tracks or only one
+    void predict(int steps);
+    void predict(int slot, int steps);
+
+    //R of the measurements of a track, until it is set again (2x2)
+    void setMeasurementNoise(int slot, const Mat &R);
+    //Measurement of a track for the next correct()
+    void setMeasurement(int slot, double x, double y);
+    //Corrects the tracks with a measurement and computes the ponderated states of all of them
+    void correct();
+
+    //Odometry: moves the positions of all the models to the new frame of the robot, and adds
+    //the noise of the motion to their covariance (2x2 rotation, 2x1 translation, 2x2 noise)
+    void moveFrame(const Mat &rotation, const Mat &translation, const Mat &noise);
+
+    //Ponderated state and covariance of the mixture, and probabilities of the models
+    double state(int slot, int i) const { return xMMAE[i][slot]; }
+    double covariance(int slot, int i, int j) const { return covMMAE[i][j][slot]; }
+    Mat mixtureCovariance(int slot) const;
+    double probability(int slot, int model) const { return probabilities[model][slot]; }
+
+private:
+    //lanes points into the object itself
+    TrackBatch(const TrackBatch&) = delete;
+    TrackBatch& operator=(const TrackBatch&) = delete;
+
+    typedef std::vector<double> Lane;
+    static const int chunkSize = 64;            //Tracks per chunk of the pool
+
+    double T;
+    ParallelFor *pool;
+    double stepNoise[nModels][nStates][nStates];    //Q of one period, without the variance
+    double variances[nModels];
+
+    Lane x[nModels][nStates];                       //statePost of each model
+    Lane P[nModels][nStates][nStates];              //errorCovPost of each model
+    Lane invA[nModels][3];                          //Inverse innovation covariance of the last prediction (xx, xy, yy)
+    Lane betas[nModels];
+    Lane probabilities[nModels];
+    Lane densities[nModels];                        //Of the last measurement
+    Lane R[3];
+    Lane z[2];
+    Lane seen;                                      //1 if there is a measurement for the next correction
+    Lane xMMAE[nStates];
+    Lane covMMAE[nStates][nStates];
+
+    std::vector<Lane*> lanes;                       //All of them, to add and remove tracks
+    std::vector<int> ids;
+    std::unordered_map<int, int> slots;
+
+    static int dim(int model) { return 2*(model+1); }
+    void predictRange(int steps, int begin, int end);
+    void correctRange(int begin, int end);
+    void mix(int begin, int end);
+};
+
+#endif // TRACKBATCH_HPP
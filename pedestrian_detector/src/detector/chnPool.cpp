@@ -0,0 +1,79 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/chnPool.hpp"
+#include "../include/detector/wrappers.hpp"
+
+using namespace std;
+
+chnPool::chnPool(size_t _maxIdleBytes) :
+    maxIdleBytes(_maxIdleBytes),
+    idleBytes(0),
+    nAcquired(0),
+    nAllocated(0) {}
+
+chnPool::~chnPool()
+{
+    for (map<size_t, vector<float*> >::iterator it = idle.begin();
+         it != idle.end(); ++it)
+        for (size_t k = 0; k < it->second.size(); k++)
+            wrFree(it->second[k] - 1);
+}
+
+float* chnPool::acquire(size_t n)
+{
+    lock_guard<mutex> guard(lock);
+    nAcquired++;
+
+    float *buffer;
+    vector<float*> &same = idle[n];
+    if (!same.empty()){
+        buffer = same.back();
+        same.pop_back();
+        idleBytes -= n * sizeof(float);
+    }else{
+        buffer = (float*) wrCalloc(n + 1, sizeof(float)) + 1;
+        nAllocated++;
+    }
+
+    lent[buffer] = n;
+    return buffer;
+}
+
+void chnPool::release(float *buffer)
+{
+    if (buffer == NULL)
+        return;
+
+    lock_guard<mutex> guard(lock);
+
+    map<float*, size_t>::iterator it = lent.find(buffer);
+    if (it == lent.end())
+        return;
+
+    size_t n = it->second;
+    lent.erase(it);
+
+    if (idleBytes + n * sizeof(float) > maxIdleBytes){
+        wrFree(buffer - 1);
+        return;
+    }
+
+    idle[n].push_back(buffer);
+    idleBytes += n * sizeof(float);
+}
+
+long chnPool::acquired() const
+{
+    lock_guard<mutex> guard(lock);
+    return nAcquired;
+}
+
+long chnPool::allocated() const
+{
+    lock_guard<mutex> guard(lock);
+    return nAllocated;
+}
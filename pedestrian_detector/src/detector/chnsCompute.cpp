@@ -14,6 +14,7 @@
 #include <ctime>
 #include <sys/time.h>
 #include <stack>
+#include <algorithm>
 
 using namespace std;
 
@@ -49,6 +50,11 @@ void convTriAux(float *M, float *&S, int misalign, int height, int width,
     S = (float*) wrCalloc(height*width*channels+misalign,
 	sizeof(float)) + misalign;
 
+    convTriInto(M, S, height, width, channels, r, s);
+}
+
+void convTriInto(float *M, float *S, int height, int width, int channels,
+		float r, int s){
     if (r > 0 && r <= 1 && s <= 2){
 	float rnew = 12 / r / (r + 2) - 2;
 	convTri1(M, S, height, width, channels, rnew, s);
@@ -74,6 +80,7 @@ pChns::pChns(){
     pGradHist->softBin = false;
     pGradHist->useHog = false;
     pGradHist->clipHog = 0.2f;
+    pGradHist->fixedPoint = false;
 
     pCustom = new Custom();
     pCustom->enabled = true;
@@ -95,7 +102,7 @@ delete pColor;
 
 infoOut::infoOut(pChns *_input, int _width,	int _height, int _chn,
 		int _chnTrans, int _widthH, int _heightH, float *_I, float *_M,
-		float *_H, int misalign){
+		float *_H, int misalign, int layout){
     int nOrients = _input->pGradHist->nOrients;
     bool useHog = _input->pGradHist->useHog;
 
@@ -116,13 +123,15 @@ infoOut::infoOut(pChns *_input, int _width,	int _height, int _chn,
 
     data = (imgWrap**) wrCalloc(nTypes, sizeof(imgWrap*));
 
-    I = new imgWrap(_I, _width, _height, _chn, misalign);
-    M = new imgWrap(_M, _width, _height, _chnTrans, misalign);
+    I = new imgWrap(_I, _width, _height, _chn, misalign, layout);
+    M = new imgWrap(_M, _width, _height, _chnTrans, misalign, layout);
 
     if (!useHog)
-	H = new imgWrap(_H, widthH, heightH, _chnTrans * nOrients, misalign);
+	H = new imgWrap(_H, widthH, heightH, _chnTrans * nOrients, misalign,
+	    layout);
     else
-	H = new imgWrap(_H, widthH, heightH, _chnTrans * nOrients * 4, misalign);
+	H = new imgWrap(_H, widthH, heightH, _chnTrans * nOrients * 4, misalign,
+	    layout);
 
 
     if(enableColor)
@@ -135,15 +144,51 @@ infoOut::infoOut(pChns *_input, int _width,	int _height, int _chn,
 	data[2] = H;
 }
 
+infoOut::~infoOut(){
+    delete I;
+    delete M;
+    delete H;
+
+    if (data != NULL)
+	wrFree(data);
+}
+
+imgWrap** infoOut::takeData(){
+    imgWrap **taken = data;
+    data = NULL;
+
+    // The channel types that are not in data stay ours
+    if (enableColor) I = NULL;
+    if (enableGradMag) M = NULL;
+    if (enableGradHist) H = NULL;
+
+    return taken;
+}
+
+
+/*
+ * Orientations computed on the transposed image come out mirrored about
+ * pi/4: bin o holds what bin (nOrients/2 - o) mod nOrients holds for the
+ * original image. Swapping the planes back keeps the channel order the
+ * classifiers were trained with.
+ */
+static void mirrorOrientations(float *H, int planeSize, int nOrients){
+    for (int o = 0; o < nOrients; o++){
+	int p = (nOrients/2 - o + nOrients) % nOrients;
+	if (o < p)
+	    swap_ranges(H + o*planeSize, H + (o+1)*planeSize, H + p*planeSize);
+    }
+}
 
 infoOut* chnsCompute(float* image, int height, int width, int channels,
-		pChns *pchns){
+		pChns *pchns, int layout){
 
 /*
  * Variable Declaration
  */
     const int sf=sizeof(float), misalign=1;
     float *I, *M, *H, *O, *G; //TODO: allocate memory
+    unsigned short *OFixed = 0;
     int chnTrans = 1; //Number of channels on each transformation
     infoOut *output;
 
@@ -157,6 +202,29 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
  */
     //TODO :: Need to parse inputs
 
+/*
+ * A row-major HxW plane is a column-major WxH plane, so from here on the
+ * kernels see the transposed image. The dimensions are swapped back when
+ * the output struct is built.
+ */
+    const int heightL = height, widthL = width;
+    if (layout == rowMajor){
+	if (pchns->pGradHist->enabled && (pchns->pGradHist->useHog ||
+	    pchns->pGradHist->nOrients % 2 != 0)){
+	    cout << "Row-major channels need an even number of orientations "
+		 << "and no hog normalization."
+		 << endl << "Source code line: " << __FILE__ << " @ "
+		 << __LINE__ << endl;
+	    return NULL;
+	}
+	swap(height, width);
+    }
+
+/*
+ * The fixed-point gradients only do hard spatial binning
+ */
+    const bool fixedPoint = pchns->pGradHist->fixedPoint &&
+	!(pchns->pGradHist->softBin && pchns->pGradHist->binSize > 1);
 
 /*
  * Compute color channels
@@ -172,17 +240,26 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
 
 	M  = (float*) wrCalloc(height*width*chnTrans+misalign, sf) + misalign;
 
-	O = 0;
-	if ( pchns->pGradHist->enabled )
-	    O  = (float*) wrCalloc(height*width*chnTrans+misalign,
-		sf) + misalign;
-
 	int lastChannel = 0;
 	int colorChn = pchns->pGradMag->colorChn;
 	if (colorChn > 0 && colorChn < channels)
 	    lastChannel = height*width*(channels-1);
 
-	gradMag( image + lastChannel, M, O, height, width, channels);
+	O = 0;
+	if ( fixedPoint ){
+	    if ( pchns->pGradHist->enabled )
+		OFixed = (unsigned short*) wrCalloc(height*width*chnTrans,
+		    sizeof(unsigned short));
+
+	    gradMagFixed( image + lastChannel, M, OFixed, height, width,
+		channels, pchns->pGradHist->nOrients);
+	}else{
+	    if ( pchns->pGradHist->enabled )
+		O  = (float*) wrCalloc(height*width*chnTrans+misalign,
+		    sf) + misalign;
+
+	    gradMag( image + lastChannel, M, O, height, width, channels);
+	}
 
 	if ( pchns->pGradMag->normRad > 0 ){
 	    int downSample = 1; // WARNING : This is the default by dollar
@@ -213,7 +290,10 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
 	H  = (float*) wrCalloc(hb*wb*chnTrans*nOrients + misalign,
 	    sf) + misalign;
 	
-	gradHist(M, O, H, height, width, binSize, nOrients, softBin);
+	if (fixedPoint)
+	    gradHistFixed(M, OFixed, H, height, width, binSize, nOrients);
+	else
+	    gradHist(M, O, H, height, width, binSize, nOrients, softBin);
 
 	if (useHog){
 	    G  = (float*) wrCalloc(hb*wb*chnTrans*nOrients*4 + misalign,
@@ -225,6 +305,9 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
 
 	    H = G;
 	}
+
+	if (layout == rowMajor)
+	    mirrorOrientations(H, hb*wb*chnTrans, nOrients);
     }
 
 /*
@@ -240,10 +323,13 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
 /*
  * Create output struct
  */
+    if (layout == rowMajor)
+	swap(hb, wb);
+
     output = new infoOut(
 	    pchns,
-	    width,
-	    height,
+	    widthL,
+	    heightL,
 	    channels,
 	    chnTrans,
 	    wb,
@@ -251,13 +337,15 @@ infoOut* chnsCompute(float* image, int height, int width, int channels,
 	    I,
 	    M,
 	    H,
-	    misalign
+	    misalign,
+	    layout
 	    );
 
     /*
      * Clean up unecessary arrays
      */
     if(O) wrFree(O-misalign);
+    if(OFixed) wrFree(OFixed);
 
     return output;
 }
@@ -17,22 +17,20 @@
 #include "common.h"
 using namespace std;
 
-pyrInput::pyrInput()
+pyrInput::pyrInput() :
+    pchns(new pChns())
 {
-    pchns = new pChns();
-
     nPerOct = 8;
     nOctUp = 0;
     nApprox = -1;
-    lambdas = 0;
+    lambdaFrames = 0;
+    lambdaCount = 0;
 
     shrink = 4;
-    pad = new int[2];
 
     pad[0] = 0;
     pad[1] = 0;
 
-    minDs = new int[2];
     minDs[0] = 16;
     minDs[1] = 16;
 
@@ -41,315 +39,642 @@ pyrInput::pyrInput()
 
     concat = true;
     complete = false;
+    layout = CHNS_DEFAULT_LAYOUT;
+    bandHeight = 0;
+    pool = make_shared<chnPool>();
 
-    sz = new int[3];
     sz[0] = 0;
     sz[1] = 0;
     sz[2] = 0;
 }
 
-pyrInput::~pyrInput()
+/*
+ * Buffers of n floats (misalign 1) from the pool of the pyramid, or from the
+ * heap without one. They are not cleared.
+ */
+static float* chnAlloc(pyrInput *input, size_t n)
 {
-    delete pchns;
-    delete [] pad;
-    delete [] minDs;
-    delete [] sz;
-    delete [] lambdas;
-}
+    if (input->pool)
+        return input->pool->acquire(n);
 
+    return (float*) wrCalloc(n + 1, sizeof(float)) + 1;
+}
 
-pyrOutput* chnsPyramid(float *image, pyrInput *input)
+static void chnFree(pyrInput *input, float *buffer)
 {
-    /*
- * Declaring variables
- */
-    float *I;
-    bool i_replaced_flag2 = false;
-    int height = input->sz[0],
-            width = input->sz[1],
-            heightO = input->sz[0],
-            widthO = input->sz[1],
-            channels = input->sz[2];
+    if (input->pool)
+        input->pool->release(buffer);
+    else
+        wrFree(buffer - 1);
+}
 
-    int heightOriginal = height, widthOriginal = width;
-    int misalign = 1;
-    int sOfF = sizeof(float);
 
-    /*
- * Get default parameters pPyramid
+/*
+ * The toolbox kernels expect column-major planes. A row-major HxW plane is
+ * the same memory as a column-major WxH one, so for rowMajor the kernels are
+ * simply handed the transposed dimensions.
  */
-    if ( !input->complete ){
-        if(input->nApprox<0)
-            input->nApprox = input->nPerOct - 1;
+static void resampleL(float *A, float *B, int ha, int hb, int wa, int wb,
+                      int d, float r, const scalePlan &plan)
+{
+    const resampleCoefs<float> &hc = plan.heightCoefs(ha, hb);
+    const resampleCoefs<float> &wc = plan.widthCoefs(wa, wb);
 
-        input->pchns->pGradHist->binSize = input->shrink;
-        input->pad[0] = round(input->pad[0]/input->shrink) * input->shrink;
-        input->pad[1] = round(input->pad[1]/input->shrink) * input->shrink;
-        input->minDs[0] = max(input->minDs[0], input->shrink * 4);
-        input->minDs[1] = max(input->minDs[1], input->shrink * 4);
+    if (plan.key.layout == rowMajor)
+        resample(A, B, wa, wb, ha, hb, d, r, hc, wc);
+    else
+        resample(A, B, ha, hb, wa, wb, d, r, wc, hc);
+}
 
-        input->complete = true;
+static void convTriIntoL(float *M, float *S, int height, int width, int d,
+                         float r, int s, int layout)
+{
+    if (layout == rowMajor)
+        convTriInto(M, S, width, height, d, r, s);
+    else
+        convTriInto(M, S, height, width, d, r, s);
+}
+
+static void imPadL(float *A, float *B, int height, int width, int d, int padTB,
+                   int padLR, int layout)
+{
+    if (layout == rowMajor)
+        imPad(A, B, width, height, d, padLR, padLR, padTB, padTB, 1, 0.f);
+    else
+        imPad(A, B, height, width, d, padTB, padTB, padLR, padLR, 1, 0.f);
+}
+
+/*
+ * Copies the nr x nc block at (ra, ca) of the d planes of A (ha x wa) to
+ * (rb, cb) in the planes of B (hb x wb).
+ */
+static void copyBlock(const float *A, int ha, int wa, int ra, int ca,
+                      float *B, int hb, int wb, int rb, int cb, int nr,
+                      int nc, int d, int layout)
+{
+    for (int c = 0; c < d; c++){
+        const float *Ac = A + c*ha*wa;
+        float *Bc = B + c*hb*wb;
+
+        if (layout == rowMajor)
+            for (int y = 0; y < nr; y++)
+                copy(Ac + (ra + y)*wa + ca, Ac + (ra + y)*wa + ca + nc,
+                     Bc + (rb + y)*wb + cb);
+        else
+            for (int x = 0; x < nc; x++)
+                copy(Ac + (ca + x)*ha + ra, Ac + (ca + x)*ha + ra + nr,
+                     Bc + (cb + x)*hb + rb);
     }
-    
+}
 
-    /*
- * Convert I to appropriate color space (or simply normalize)
+/*
+ * Rows a band needs on each side so that its channels are the ones of the
+ * whole image: image smoothing, gradient, gradient normalization and the
+ * histogram cells. Rounded up to shrink to keep the bands aligned.
  */
-    int cs = input->pchns->pColor->colorSpace;
+static int bandMargin(pyrInput *input)
+{
+    pChns *pchns = input->pchns.get();
+    int margin = (int) ceil(input->smoothIm) + 1;
 
-    I = rgbConvert(image, height*width, channels, cs, 1.0f);  //espaco luv
-    //  input->pchns->pColor->colorSpace = orig;
+    if (pchns->pGradMag->enabled)
+        margin += pchns->pGradMag->normRad;
 
-    /*
- * Get scales at which to compute features and list of real/approx scales
+    if (pchns->pGradHist->enabled && pchns->pGradHist->softBin)
+        margin += pchns->pGradHist->binSize;
+
+    if (pchns->pGradHist->enabled && pchns->pGradHist->useHog)
+        margin += 2 * pchns->pGradHist->binSize;
+
+    return (margin + input->shrink - 1) / input->shrink * input->shrink;
+}
+
+/*
+ * Smooths I1, computes its channels and shrinks the ones chnsCompute() did
+ * not (by design only H comes out shrunk).
  */
-    float *scales = 0;
-    float *scaleshw = 0;
-    int nScales = getScales(scales, scaleshw, input->nPerOct, input->nOctUp,
-                            input->minDs, input->shrink, input->sz);
-    
-    //TODO :: WARNING :: This was done in the Dollar's Code
-    int isRMax;
-    if(true)
-        isRMax = 0;
-    else
-        isRMax = 0 + input->nOctUp * input->nPerOct;
-    //TODO :: WARNING :: END
-    
-    int *isR, *isA, *isN;
+static unique_ptr<pyrScale> shrunkChannels(float *I1, int height, int width,
+                                           int channels, pyrInput *input,
+                                           const scalePlan &plan, int &nTypes)
+{
+    int misalign = 1;
+    int shrink = input->shrink;
+    int layout = plan.key.layout;
 
-    //isR Vector Allocation
-    int countIsR = 0;
-    for ( int i = isRMax; i < nScales; i += (input->nApprox) + 1 ){
-        countIsR++;
-    }
-    isR = new int[countIsR+1];
-
-    for ( int i = isRMax, j = 0; i < nScales; j++, i += (input->nApprox + 1) )
-        isR[j] = i;
-
-    //isA and isN Vector Allocation
-    int countIsA = nScales - countIsR;
-    int countIsN = nScales;
-    isA = new int[countIsA+1];
-    isN = new int[countIsN];
-
-    for ( int i = 0, auxI = 0; i < nScales; i++){
-        bool ok = true;
-        for (int j = 0; j < countIsR; j++)
-            if(i == isR[j]){
-                ok = false;
-                break;
-            }
+    //TODO :: WARNING :: Hardcoded value :: downsample
+    float *I2 = chnAlloc(input, height*width*channels);
+    int downsample = 1;
+    convTriIntoL(I1, I2, height, width, channels, input->smoothIm,
+                 downsample, layout
+                 );
+
+    infoOut *chns = chnsCompute(I2, height, width, channels,
+                                input->pchns.get(), layout
+                                );
+
+    chnFree(input, I2);
+
+    if (chns == NULL)
+        return unique_ptr<pyrScale>();
+
+    nTypes = chns->nTypes;
+    imgWrap **taken = chns->takeData();
+    delete chns;
+
+    unique_ptr<pyrScale> data1(new pyrScale(nTypes, input->pool));
+    for (int j = 0; j < nTypes; j++)
+        (*data1)[j] = taken[j];
+    wrFree(taken);
 
-        if (ok){
-            isA[auxI] = i;
-            auxI++;
+    for (int j = 0; j < nTypes; j++){
+        imgWrap *chn = (*data1)[j];
+
+        /*
+     * This is checking the size of each transformation. By design only
+     * the H channel will have the correct dimensions.
+     */
+        float shr = chn->height;
+        shr = height / shr;
+
+        if (shr > shrink || (int)shr % 1 > 0){
+            cout << "Something went wrong with the shrinking."
+                 << endl << "Source code line: " << __FILE__ << " @ "
+                 << __LINE__ << endl;
+            return unique_ptr<pyrScale>(); //This should never happen
         }
 
-        isN[i] = i;
-    }
+        shr = shr/shrink;
+        if (shr == 1)
+            continue;
 
-    int *auxIsJ;
-    auxIsJ = new int[countIsR + 1];
+        int nH = height*shr,
+                nW = width*shr,
+                chnsTransform = chn->channels;
 
-    auxIsJ[0] = 0;
-    auxIsJ[countIsR] = nScales;
+        float *chnTypeData = chnAlloc(input, nH*nW*chnsTransform);
 
-    for (int i = 0; i < countIsR - 1; i++)
-        auxIsJ[i+1] = floor((isR[i] + 1 + isR[i+1] + 1) / 2);
-    // " +1 " because we are in c++ and the vector already assumes the first
-    // element to be index 0.
+        //TODO :: WARNING :: Hardcoded value :: 1.f
+        resampleL(chn->image, chnTypeData, height, nH, width, nW,
+                  chnsTransform, 1.f, plan
+                  );
 
-    for (int i = 0; i < countIsR; i++){
-        int minJ = auxIsJ[i];
-        int maxJ = auxIsJ[i+1];
+        // The unshrunk channels are freed
+        *chn = imgWrap(chnTypeData, nW, nH, chnsTransform, misalign,
+                       chn->layout, true, input->pool.get());
+    }
+
+    return data1;
+}
 
-        for (int j = minJ; j < maxJ; j++)
-            isN[j] = isR[i];
+static unique_ptr<pyrScale> allocChannels(const pyrScale &like, int height,
+                                          int width, int layout,
+                                          pyrInput *input)
+{
+    int misalign = 1;
+    int nTypes = like.nTypes();
+    unique_ptr<pyrScale> data(new pyrScale(nTypes, input->pool));
+
+    for (int j = 0; j < nTypes; j++){
+        int c = like[j]->channels;
+        float *chnData = chnAlloc(input, height*width*c);
+        fill(chnData, chnData + height*width*c, 0.f);
+        (*data)[j] = new imgWrap(chnData, width, height, c, misalign, layout,
+                                 true, input->pool.get());
     }
-    
-    delete [] auxIsJ;
 
-    /*
- * Compute image pyramid [real scales]
+    return data;
+}
+
+/*
+ * Shrunk channels of the block of I1 (height x width) given by a band and a
+ * tile, copied into the channels of the whole scale. data is allocated on
+ * first use.
  */
-    
-    int nTypes = 0;
+static bool blockChannels(float *I1, int height, int width, int channels,
+                          const pyrBand &band, const pyrTile &tile,
+                          pyrInput *input, const scalePlan &plan,
+                          unique_ptr<pyrScale> &data, int &nTypes)
+{
+    int shrink = input->shrink;
+    int layout = plan.key.layout;
+    int chnHeight = height / shrink, chnWidth = width / shrink;
+    int blockHeight = band.e1 - band.e0, blockWidth = tile.e1 - tile.e0;
+
+    float *B = chnAlloc(input, blockHeight*blockWidth*channels);
+    copyBlock(I1, height, width, band.e0, tile.e0, B, blockHeight, blockWidth,
+              0, 0, blockHeight, blockWidth, channels, layout);
 
-    imgWrap ***data =  (imgWrap ***) wrCalloc(nScales, sizeof(imgWrap**));
+    unique_ptr<pyrScale> blockData = shrunkChannels(B, blockHeight,
+                                                    blockWidth, channels,
+                                                    input, plan, nTypes);
+    chnFree(input, B);
+
+    if (!blockData)
+        return false;
+
+    if (!data)
+        data = allocChannels(*blockData, chnHeight, chnWidth, layout, input);
+
+    for (int j = 0; j < nTypes; j++)
+        copyBlock((*blockData)[j]->image, blockHeight / shrink,
+                  blockWidth / shrink, (band.y0 - band.e0) / shrink,
+                  (tile.x0 - tile.e0) / shrink, (*data)[j]->image, chnHeight,
+                  chnWidth, band.y0 / shrink, tile.x0 / shrink,
+                  (band.y1 - band.y0) / shrink, (tile.x1 - tile.x0) / shrink,
+                  (*data)[j]->channels, layout);
+
+    return true;
+}
+
+/*
+ * Shrunk channels of the it-th real scale. I1 is the image resampled to
+ * that scale. The plan splits it in bands, each computed on its own rows
+ * plus the margin and then cropped into the channels of the whole scale.
+ *
+ * With a channel cache the bands are also split in tiles, and the tiles
+ * that did not change since the last frame are copied from it.
+ */
+static unique_ptr<pyrScale> realScaleChannels(float *I1, int it, int channels,
+                                              pyrInput *input,
+                                              const scalePlan &plan,
+                                              int &nTypes)
+{
+    int height = plan.imgHeight[it];
+    int width = plan.imgWidth[it];
+    const vector<pyrBand> &bands = plan.bands[it];
+    const vector<pyrTile> &tiles = plan.tiles[it];
+    int nTiles = tiles.size();
+    pyrChannelCache *cache = input->cache.get();
 
     int shrink = input->shrink;
-    float shr[3] = { 0, 0, 0};
+    int layout = plan.key.layout;
+    int chnHeight = height / shrink, chnWidth = width / shrink;
+
+    vector<bool> reuse(bands.size()*nTiles, false);
+    int nReused = 0;
+    if (cache != NULL){
+        for (size_t b = 0; b < bands.size(); b++)
+            for (int t = 0; t < nTiles; t++)
+                if (cache->tileReusable(it, b, t)){
+                    reuse[b*nTiles + t] = true;
+                    nReused++;
+                }
 
-    for (int it = 0, i = isR[0]; it < countIsR; it++, i=isR[it]){
+        cache->countTiles(reuse.size(), nReused);
+    }
 
-        bool i_replaced_flag1 = false;
-        float scale = scales[i];
+    const pyrScale *cached = NULL;
+    if (nReused > 0){
+        cached = cache->realChannels(it);
+        nTypes = cache->channelTypes();
+    }
 
+    if (bands.size() == 1 && nReused == 0){
+        if (cache != NULL)
+            for (int t = 0; t < nTiles; t++)
+                cache->tileComputed(it, 0, t);
 
-        int newHeight = round((float) heightO * (float) scale /
-                              (float) shrink) * shrink;
+        return shrunkChannels(I1, height, width, channels, input, plan,
+                              nTypes);
+    }
+
+    unique_ptr<pyrScale> data;
+    if (cached != NULL)
+        data = allocChannels(*cached, chnHeight, chnWidth, layout, input);
 
-        int newWidth = round((float) widthO * (float) scale /
-                             (float) shrink) * shrink;
+    pyrTile wholeRow;
+    wholeRow.x0 = wholeRow.e0 = 0;
+    wholeRow.x1 = wholeRow.e1 = width;
 
-        float *I1;
+    for (size_t b = 0; b < bands.size(); b++){
+        const pyrBand &band = bands[b];
 
-        if ( height == newHeight && width == newWidth){
-            //TODO :: WARNING :: Should I copy it over?
-            I1 = (float*) wrCalloc(height*width*channels + misalign,
-                                   sOfF) + misalign;
+        bool anyReused = false;
+        for (int t = 0; t < nTiles; t++)
+            anyReused = anyReused || reuse[b*nTiles + t];
 
-            int lengthArray = height*width*channels;
-            for (int j = 0; j < lengthArray; j++)
-                I1[j] = I[j];
-        }else{
-            I1 = (float*) wrCalloc(newHeight*newWidth*channels + misalign,
-                                   sOfF) + misalign;
+        // A band with nothing to reuse is computed at once, without the
+        // margins between its tiles
+        if (!anyReused){
+            if (!blockChannels(I1, height, width, channels, band, wholeRow,
+                               input, plan, data, nTypes))
+                return unique_ptr<pyrScale>();
 
-            //TODO :: WARNING :: Hardcoded value :: 1.f
-            resample(I, I1, height, newHeight, width, newWidth, channels, 1.f);
+            for (int t = 0; t < nTiles; t++)
+                if (cache != NULL)
+                    cache->tileComputed(it, b, t);
 
+            continue;
         }
 
-        if (scale == 0.5f && (input->nApprox > 0 || input->nPerOct == 1))
-        {
-            //TODO :: WARNING :: Should I free "I"?
-            // I replace old I with new I1, as I reduced the image to half size
-            if(!i_replaced_flag2)
-                free(I);
-            else
-                wrFree(I-misalign);
-
-            i_replaced_flag1 = true;
-            i_replaced_flag2 = true;
-            I = I1;
-            height = newHeight;
-            width = newWidth;
+        for (int t = 0; t < nTiles; t++){
+            const pyrTile &tile = tiles[t];
+
+            if (!reuse[b*nTiles + t]){
+                if (!blockChannels(I1, height, width, channels, band, tile,
+                                   input, plan, data, nTypes))
+                    return unique_ptr<pyrScale>();
+
+                cache->tileComputed(it, b, t);
+                continue;
+            }
+
+            for (int j = 0; j < nTypes; j++)
+                copyBlock((*cached)[j]->image, chnHeight, chnWidth,
+                          band.y0 / shrink, tile.x0 / shrink,
+                          (*data)[j]->image, chnHeight, chnWidth,
+                          band.y0 / shrink, tile.x0 / shrink,
+                          (band.y1 - band.y0) / shrink,
+                          (tile.x1 - tile.x0) / shrink, (*data)[j]->channels,
+                          layout);
         }
+    }
 
+    return data;
+}
 
+/*
+ * The image the real scales are resampled from. It is replaced by the half
+ * size image once that one is computed.
+ */
+class pyrSource
+{
+public:
+    float *I;
+    int height;
+    int width;
+    bool replaced;	// I comes from chnAlloc and not from rgbConvert
+    pyrInput *input;
 
-        //TODO :: WARNING :: Hardcoded value :: downsample
-        float *I2 = 0;
-        int downsample = 1;
-        convTriAux(I1, I2, misalign, newHeight, newWidth, channels,
-                   input->smoothIm, downsample
-                   );
+    ~pyrSource()
+    {
+        if(!replaced)
+            free(I);
+        else
+            chnFree(input, I);
+    }
+};
 
+/*
+ * The image of the it-th real scale, resampled from the source. If it is the
+ * half size image, it also becomes the source (replaced is set).
+ */
+static float* realScaleImage(pyrSource &src, int it, int channels,
+                             const scalePlan &plan, bool &replaced)
+{
+    int newHeight = plan.imgHeight[it];
+    int newWidth = plan.imgWidth[it];
+
+    float *I1 = chnAlloc(src.input, newHeight*newWidth*channels);
+
+    if ( src.height == newHeight && src.width == newWidth){
+        //TODO :: WARNING :: Should I copy it over?
+        int lengthArray = newHeight*newWidth*channels;
+        for (int j = 0; j < lengthArray; j++)
+            I1[j] = src.I[j];
+    }else{
+        //TODO :: WARNING :: Hardcoded value :: 1.f
+        resampleL(src.I, I1, src.height, newHeight, src.width, newWidth,
+                  channels, 1.f, plan);
+    }
 
+    replaced = false;
+    if (plan.replacesSource[it])
+    {
+        // I replace old I with new I1, as I reduced the image to half size
+        if(!src.replaced)
+            free(src.I);
+        else
+            chnFree(src.input, src.I);
+
+        replaced = true;
+        src.replaced = true;
+        src.I = I1;
+        src.height = newHeight;
+        src.width = newWidth;
+    }
 
+    return I1;
+}
 
-        /*
-     * Channels Compute for this isR[i] scale
-     */
+static unique_ptr<pyrScale> computeRealScale(pyrSource &src, int it,
+                                             int channels, pyrInput *input,
+                                             const scalePlan &plan,
+                                             int &nTypes)
+{
+    bool i_replaced_flag1;
+    float *I1 = realScaleImage(src, it, channels, plan, i_replaced_flag1);
 
-        infoOut *chns = chnsCompute(I2, newHeight, newWidth, channels,
-                                    input->pchns
-                                    );
+    unique_ptr<pyrScale> data1 = realScaleChannels(I1, it, channels, input,
+                                                   plan, nTypes);
 
-        imgWrap **data1 = chns->data;
+    //If we say that I is equal to I1 then we can't free I1 in this step, because it will also free I,
+    //wich is needed for the next iteration
+    if(!i_replaced_flag1)
+        chnFree(input, I1);
 
-        wrFree(I2-misalign);
+    return data1;
+}
 
-        nTypes = chns->nTypes;
+/*
+ * Smooths and pads the channels of a scale. Every channel type is written at
+ * its final offset in one buffer per scale, so concatenating them is free:
+ * with concat the first imgWrap holds all the channels, otherwise every type
+ * has its own imgWrap, all but the first being views into that buffer. The
+ * input channels are left untouched.
+ */
+static shared_ptr<pyrScale> finishScale(const pyrScale &chns,
+                                        pyrInput *input)
+{
+    int misalign = 1;
+    int nTypes = chns.nTypes();
+    int shrink = input->shrink;
+    int downSample = 1; // WARNING : This is the default by dollar
+    int s = downSample;
 
-        if (i == isR[0]){
-            /*
-         * This is checking the size of each transformation. By design only
-         * the H channel will have the correct dimensions.
-         */
-            for (int j = 0; j < nTypes; j++){
-                shr[j] = data1[j]->height;
-                shr[j] = newHeight / shr[j];
+    int height = chns[0]->height;
+    int width = chns[0]->width;
+    int layout = chns[0]->layout;
 
-                if (shr[j] > shrink || (int)shr[j] % 1 > 0){
-                    cout << "Something went wrong with the shrinking."
-                         << endl << "Source code line: " << __FILE__ << " @ "
-                         << __LINE__ << endl;
-                    return NULL; //This should never happen
-                }
+    int padTB = input->pad[0] / shrink,
+            padLR = input->pad[1] / shrink;
+    bool padded = padTB > 0 || padLR > 0;
+    int newHeight = height + padTB * 2;
+    int newWidth = width + padLR * 2;
 
-                shr[j]=shr[j]/shrink;
-            }
-        }
+    int totalChannels = 0, maxChannels = 0;
+    for (int j = 0; j < nTypes; j++){
+        totalChannels += chns[j]->channels;
+        maxChannels = max(maxChannels, chns[j]->channels);
+    }
 
-        for(int j = 0; j < nTypes; j++){
-            if (shr[j] == 1)
-                continue;
+    float *slab = chnAlloc(input, newHeight*newWidth*totalChannels);
+    chnPool *pool = input->pool.get();
 
-            int nH = newHeight*shr[j],
-                    nW = newWidth*shr[j],
-                    chnsTransform = data1[j]->channels;
+    // Smoothed channels before the padding, shared by all the types
+    float *S = NULL;
+    if (padded)
+        S = chnAlloc(input, height*width*maxChannels);
 
-            float *chnTypeData = (float*) wrCalloc(nH*nW*channels + misalign,
-                                                   sOfF) + misalign;
+    shared_ptr<pyrScale> data = make_shared<pyrScale>(nTypes, input->pool);
+    pyrScale &finished = *data;
 
-            //TODO :: WARNING :: Hardcoded value :: 1.f
-            resample(data1[j]->image, chnTypeData, newHeight, nH, newWidth, nW,
-                     chnsTransform, 1.f
-                     );
+    int offset = 0;
+    for (int j = 0; j < nTypes; j++){
+        int channel = chns[j]->channels;
+        float *T = slab + offset;
 
-            data1[j]->height = nH;
-            data1[j]->width = nW;
+        /*
+      * Smoothing Channels, then padding according to the scale
+      */
+        convTriIntoL(chns[j]->image, padded ? S : T, height, width, channel,
+                     input->smoothChns, s, layout);
 
-            wrFree(data1[j]->image - misalign);
-            data1[j]->image = chnTypeData;
-        }
+        if (padded)
+            imPadL(S, T, height, width, channel, padTB, padLR, layout);
+
+        if (!input->concat)
+            finished[j] = new imgWrap(T, newWidth, newHeight, channel,
+                                      misalign, layout, j == 0, pool);
+
+        offset += newHeight*newWidth*channel;
+    }
+
+    if (input->concat)
+        finished[0] = new imgWrap(slab, newWidth, newHeight, totalChannels,
+                                  misalign, layout, true, pool);
 
-        data[i] = data1;
-        delete chns;
+    if (S != NULL)
+        chnFree(input, S);
 
-        //If we say that I is equal to I1 then we can't free I1 in this step, because it will also free I,
-        //wich is needed for the next iteration
-        if(!i_replaced_flag1)
-            wrFree(I1-misalign);
+    return data;
+}
 
+/*
+ * Builds the pyramid one real scale at a time: each real scale is computed,
+ * then every scale approximated from it (see isN) is finished and, if there
+ * is a consumer, handed to it and freed.
+ */
+static bool buildPyramid(float *image, pyrInput *input,
+                         pyrScaleConsumer *consumer, pyrOutput &output)
+{
+    // The buffers of the last pyramid are recycled for this one
+    output.clear();
+
+    /*
+ * Declaring variables
+ */
+    int height = input->sz[0],
+            width = input->sz[1],
+            channels = input->sz[2];
+
+    int misalign = 1;
+    int layout = input->layout;
+
+    /*
+ * Get default parameters pPyramid
+ */
+    if ( !input->complete ){
+        if(input->nApprox<0)
+            input->nApprox = input->nPerOct - 1;
+
+        input->pchns->pGradHist->binSize = input->shrink;
+        input->pad[0] = round(input->pad[0]/input->shrink) * input->shrink;
+        input->pad[1] = round(input->pad[1]/input->shrink) * input->shrink;
+        input->minDs[0] = max(input->minDs[0], input->shrink * 4);
+        input->minDs[1] = max(input->minDs[1], input->shrink * 4);
+
+        input->complete = true;
     }
+    
 
+    /*
+ * Convert I to appropriate color space (or simply normalize)
+ */
+    int cs = input->pchns->pColor->colorSpace;
 
-    // In case I changed it when scale = 0.5f
-    height = heightO;
-    width = widthO;
+    pyrSource src;
+    src.I = rgbConvert(image, height*width, channels, cs, 1.0f);  //espaco luv
+    src.height = height;
+    src.width = width;
+    src.replaced = false;
+    src.input = input;
+    //  input->pchns->pColor->colorSpace = orig;
 
+    /*
+ * Get scales at which to compute features and list of real/approx scales.
+ * They only depend on the image size and on the parameters, so they come
+ * from a cached plan.
+ */
+    scaleKey key;
+    key.height = height;
+    key.width = width;
+    key.nPerOct = input->nPerOct;
+    key.nOctUp = input->nOctUp;
+    key.nApprox = input->nApprox;
+    key.minDs[0] = input->minDs[0];
+    key.minDs[1] = input->minDs[1];
+    key.shrink = input->shrink;
+    key.pad[0] = input->pad[0];
+    key.pad[1] = input->pad[1];
+    key.layout = layout;
+    key.bandHeight = max(input->bandHeight, 0);
+    key.bandMargin = (input->bandHeight > 0) ? bandMargin(input) : 0;
+    key.tileWidth = (input->cache != NULL) ? key.bandHeight : 0;
+
+    shared_ptr<const scalePlan> planPtr = scalePlan::get(key);
+    const scalePlan &plan = *planPtr;
+
+    pyrChannelCache *cache = input->cache.get();
+    if (cache != NULL)
+        cache->beginFrame(src.I, height, width, channels, planPtr);
+
+    int nScales = plan.nScales;
+    const float *scales = &plan.scales[0];
+    const vector<int> &isR = plan.isR;
+    const vector<int> &isN = plan.isN;
+    int countIsR = isR.size();
+
+    int nTypes = 0;
+
+    // Real scales before smoothing, only while they are needed. Whatever is
+    // still held when a step fails is freed on the way out.
+    vector< unique_ptr<pyrScale> > real(nScales);
+    vector<pyrScalePtr> data(nScales);
 
     /*
- * If lambdas not specified compute image specific lambdas
+ * If lambdas not specified compute image specific lambdas. This needs two
+ * real scales before any scale is approximated.
  */
     int nApprox = input->nApprox;
-    float *lambdas = input->lambdas;
+    const float *lambdas = input->lambdas.empty() ? NULL : &input->lambdas[0];
+    vector<float> estimated;
+    int nReal = 0;
     if ( nApprox > 0 && lambdas==NULL){
         cout << "Computing lambdas!" << endl;
-        int nOctUp = input->nOctUp;
-        int nPerOct = input->nPerOct;
 
         //TODO :: WARNING :: Yet again I start at 0.
         // The is Vector :: is=1 + nOctUp*nPerOct:nApprox+1:nScales;
-        int countIs = 0;
-
-        int *isTemp = new int[nScales];
-        for (int i = nOctUp*nPerOct; i < nScales; i += nApprox + 1){
-            isTemp[countIs] = i;
-            countIs++;
-        }
+        int isTemp[2] = { plan.lambdaScales[0], plan.lambdaScales[1] };
 
-        if (countIs > 2){
-            isTemp[0] = isTemp[1];
-            isTemp[1] = isTemp[2];
-        }else{
+        if (isTemp[0] < 0){
             cout << "Couldn't calculate lambdas. Not enough scales to use."
                  << endl << "Source code line: " << __FILE__ << " @ "
                  << __LINE__ << endl;
-            return NULL;
+            return false;
         }
 
+        for (; nReal < countIsR && isR[nReal] <= isTemp[1]; nReal++){
+            real[isR[nReal]] = computeRealScale(src, nReal, channels, input,
+                                                plan, nTypes);
+            if (!real[isR[nReal]])
+                return false;
+        }
 
-        float *f0 = new float[nTypes];
-        float *f1 = new float[nTypes];
+        vector<float> f0(nTypes), f1(nTypes);
 
-        imgWrap **d0 = data[isTemp[0]];
-        imgWrap **d1 = data[isTemp[1]];
+        const pyrScale &d0 = *real[isTemp[0]];
+        const pyrScale &d1 = *real[isTemp[1]];
 
         for (int i = 0; i < nTypes; i++){
             float numElem = (float)
@@ -376,164 +701,162 @@ pyrOutput* chnsPyramid(float *image, pyrInput *input)
         }
 
 
-        lambdas = new float[nTypes];
+        estimated.resize(nTypes);
         float lambdaValue = log2(scales[isTemp[0]] / scales[isTemp[1]]);
         for (int i = 0; i < nTypes; i++)
-            lambdas[i] = -log2(f0[i] / f1[i]) / lambdaValue;
+            estimated[i] = -log2(f0[i] / f1[i]) / lambdaValue;
+        lambdas = &estimated[0];
+
+        /*
+     * Average the estimates of the first lambdaFrames frames and keep them
+     */
+        if (input->lambdaFrames > 0){
+            input->lambdaSum.resize(nTypes, 0.f);
+
+            for (int i = 0; i < nTypes; i++)
+                input->lambdaSum[i] += estimated[i];
+            input->lambdaCount++;
+
+            if (input->lambdaCount >= input->lambdaFrames){
+                input->lambdas.resize(nTypes);
+                for (int i = 0; i < nTypes; i++)
+                    input->lambdas[i] = input->lambdaSum[i] /
+                            input->lambdaCount;
+            }
+        }
     }
 
     /*
- * Compute image pyramid [approximated scales]
+ * Compute image pyramid, one real scale and the scales approximated from it
+ * at a time
  */
-    shrink = input->shrink;
-    for (int it = 0, i = isA[0]; it < countIsA; it++, i=isA[it])
-    {
-        int iR = isN[i];
-
-        float scale = scales[i];
+    int nChannels = 0;
+    for (int it = 0, i = 0; it < countIsR; it++){
+        int iR = isR[it];
+
+        // Nothing changed for this real scale, so neither did its scales
+        bool reuseGroup = cache != NULL && it >= nReal &&
+                cache->groupReusable(it, lambdas);
+
+        if (reuseGroup){
+            nTypes = cache->channelTypes();
+
+            bool replaced;
+            if (plan.replacesSource[it])
+                realScaleImage(src, it, channels, plan, replaced);
+        }else if (it >= nReal){
+            real[iR] = computeRealScale(src, it, channels, input, plan,
+                                        nTypes);
+            if (!real[iR])
+                return false;
+        }
 
-        //TODO :: WARNING :: The value height may have been modified to half of
-        //                   it, hence using heightOriginal (width)
-        int newHeight = round((float) heightOriginal * (float) scale /
-                              (float) shrink);
-        int newWidth = round((float) widthOriginal * (float) scale /
-                             (float) shrink);
+        const pyrScale *dataImgR = real[iR].get();
 
-        float scaleRatio = (scale / scales[iR]);
-        float *rs = new float[nTypes];
+        for (; i < nScales && isN[i] == iR; i++){
+            if (reuseGroup){
+                cache->countScale(true);
 
-        for (int j = 0; j < nTypes; j++)
-            rs[j] = pow(scaleRatio, -lambdas[j] );
+                // Shared with the cache, not copied
+                data[i] = cache->finishedChannels(i);
+            }else if (i == iR){
+                data[i] = finishScale(*dataImgR, input);
+            }else{
+                /*
+             * Approximated scale
+             */
+                float scale = scales[i];
 
-        imgWrap **dataImgA = (imgWrap **) wrCalloc(nTypes, sizeof(imgWrap*));
-        imgWrap **dataImgR = data[iR];
+                int newHeight = plan.chnHeight[i];
+                int newWidth = plan.chnWidth[i];
 
-        for (int j = 0; j < nTypes; j++){
-            int ijChannels = dataImgR[j]->channels;
+                float scaleRatio = (scale / scales[iR]);
 
-            float *isAimage = (float*) wrCalloc(newHeight*newWidth*ijChannels +
-                                                misalign, sOfF) + misalign;
+                // Resampled from the real scale into buffers of the pool,
+                // which go back to it once the scale is finished
+                pyrScale dataImgA(nTypes, input->pool);
 
-            //TODO :: WARNING :: Hardcoded value
-            resample(dataImgR[j]->image, isAimage, dataImgR[j]->height,
-                     newHeight, dataImgR[j]->width, newWidth, ijChannels, rs[j]);
+                for (int j = 0; j < nTypes; j++){
+                    const imgWrap *chnR = (*dataImgR)[j];
+                    int ijChannels = chnR->channels;
+                    float rs = pow(scaleRatio, -lambdas[j] );
 
-            dataImgA[j] = new imgWrap(isAimage, newWidth, newHeight,ijChannels, misalign);
-        }
+                    float *isAimage = chnAlloc(input, newHeight*newWidth*
+                                               ijChannels);
 
-        data[i] = dataImgA;
-        delete [] rs;
-    }
+                    //TODO :: WARNING :: Hardcoded value
+                    resampleL(chnR->image, isAimage, chnR->height, newHeight,
+                              chnR->width, newWidth, ijChannels, rs, plan);
 
-    /*
- * Smooth channels, optionally pad and concatenate channels
- */
-    int downSample = 1; // WARNING : This is the default by dollar
-    int s = downSample;
+                    dataImgA[j] = new imgWrap(isAimage, newWidth, newHeight,
+                                              ijChannels, misalign, layout,
+                                              true, input->pool.get());
+                }
 
-    for (int i = 0; i < nScales; i++){
-        for (int j = 0; j < nTypes; j++){
-            float *S;
-            int height = data[i][j]->height;
-            int width = data[i][j]->width;
-            int channel = data[i][j]->channels;
-
-            /*
-          * Smoothing Channels
-          */
-            convTriAux(data[i][j]->image, S, misalign, height, width, channel,
-                       input->smoothChns, s
-                       );
-
-            wrFree(data[i][j]->image - misalign);
-
-            /*
-         * Padding according to the scale. Then change the shrink value.
-         */
-            int padTB = input->pad[0] / shrink,
-                    padLR = input->pad[1] / shrink;
-            if (padTB > 0 || padLR > 0){
-                int newHeight = height + padTB * 2;
-                int newWidth = width + padLR * 2;
-                float *P = (float*) wrCalloc(newHeight*newWidth*channel +
-                                             misalign, sOfF) + misalign;
-                imPad(S, P, height, width, channel, padTB, padTB, padLR, padLR,
-                      1, 0.f
-                      );
-                wrFree(S - misalign);
-                data[i][j]->height = newHeight;
-                data[i][j]->width = newWidth;
-                S = P;
+                data[i] = finishScale(dataImgA, input);
             }
-            data[i][j]->image = S;
-        }
-    }
-
-    /*
- * Concatenate.
- */
-    int totalChannels = 0;
-    for (int j = 0; j < nTypes; j++)
-        totalChannels += data[0][j]->channels;
-
-    if(input->concat){
-        int chnsArr[nTypes];
-
-        for (int j = 0; j < nTypes; j++)
-            chnsArr[j] = data[0][j]->channels;
-
-        for (int i = 0; i < nScales; i++){
-            int height = data[i][0]->height;
-            int width = data[i][0]->width;
 
-            float *imgC = (float*) wrCalloc(height*width*totalChannels +
-                                            misalign, sOfF) + misalign;
-
-            int totalSize = 0;
-            for (int j = 0; j < nTypes; j++){
-                float *imgO = data[i][j]->image;
-
-                copy(imgO, imgO + height*width*chnsArr[j], imgC + totalSize);
-                totalSize += height*width*chnsArr[j];
+            if (cache != NULL && !reuseGroup){
+                cache->countScale(false);
+                cache->storeFinished(i, data[i], lambdas);
             }
 
-            for (int j=1; j < nTypes; j++){
-                delete data[i][j];
-            }
+            const pyrScale &finished = *data[i];
+            if (nChannels == 0)
+                for (int j = 0; j < nTypes; j++)
+                    nChannels += (finished[j] != NULL) ?
+                                finished[j]->channels : 0;
 
-            wrFree(data[i][0]->image - misalign);
-            data[i][0]->image = imgC;
-            data[i][0]->channels = totalChannels;
+            // The cache may still hold the scale, the pyramid does not
+            if (consumer != NULL){
+                consumer->consumeScale(i, scales[i], finished.data());
+                data[i].reset();
+            }
         }
-    }
 
+        // The cache keeps the real scale for the next frame
+        if (real[iR] && cache != NULL)
+            cache->storeReal(it, move(real[iR]));
+        real[iR].reset();
+    }
 
     /*
  * Create output struct
  */
 
-    pyrOutput *output = new pyrOutput();
-    output->input = input;
-    output->chnsPerScale = data;
-    output->nScales =  nScales;
-    output->scales = scales;
-    output->nChannels = totalChannels;
+    output.input = input;
+    output.chnsPerScale.swap(data);
+    output.nScales =  nScales;
+    output.nTypes = nTypes;
+    output.plan = planPtr;
+    output.scales = &plan.scales[0];
+    output.nChannels = nChannels;
 
     /*
- * Clean Memory
- */
-    delete [] isR;
-    delete [] isA;
-    delete [] isN;
-    delete [] scaleshw;
-    
-    if(!i_replaced_flag2)
-        free(I);
-    else
-        wrFree(I-misalign);
-    /*
  * Output
  */
+    return true;
+}
+
+pyrOutput* chnsPyramid(float *image, pyrInput *input)
+{
+    pyrOutput *output = new pyrOutput();
+
+    if (!buildPyramid(image, input, NULL, *output)){
+        delete output;
+        return NULL;
+    }
+
     return output;
 }
 
+bool chnsPyramid(float *image, pyrInput *input, pyrOutput &output)
+{
+    return buildPyramid(image, input, NULL, output);
+}
+
+bool chnsPyramid(float *image, pyrInput *input, pyrScaleConsumer *consumer)
+{
+    pyrOutput output;
+    return buildPyramid(image, input, consumer, output);
+}
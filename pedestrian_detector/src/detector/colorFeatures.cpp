@@ -1,6 +1,7 @@
 #include "../include/detector/colorFeatures.hpp"
 #include <opencv/highgui.h>
 #include <opencv/cv.h>
+#include <iostream>
 
 using namespace std;
 
@@ -120,3 +121,189 @@ void extractBVT(cv::Mat& inputImage, cv::Mat& bvtHistogram, int bgBins, std::vec
 
 
 }
+
+bvtSpec::bvtSpec() :
+    hBins(10),
+    sBins(10),
+    bgBins(10),
+    blackWeight(2.32),
+    grayWeight(0.36),
+    width(52),
+    height(128) {}
+
+template<typename T>
+static void readOptional(const cv::FileStorage& fs, const char* name, T& value)
+{
+    cv::FileNode node = fs[name];
+    if(!node.empty())
+        node >> value;
+}
+
+bool bvtSpec::load(const std::string& filename)
+{
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if(!fs.isOpened())
+    {
+        std::cout << "There was a problem opening " << filename << std::endl;
+        return false;
+    }
+
+    readOptional(fs, "hBins", hBins);
+    readOptional(fs, "sBins", sBins);
+    readOptional(fs, "bgBins", bgBins);
+    readOptional(fs, "blackWeight", blackWeight);
+    readOptional(fs, "grayWeight", grayWeight);
+
+    std::vector<int> size;
+    readOptional(fs, "templateSize", size);
+    if(size.size() == 2)
+    {
+        width = size[0];
+        height = size[1];
+    }
+
+    std::vector<int> maskSize(1, width);
+    maskSize.push_back(height);
+    readOptional(fs, "maskTemplateSize", maskSize);
+    if(maskSize.size() != 2)
+    {
+        std::cout << "maskTemplateSize in " << filename << " must be [width, height]" << std::endl;
+        return false;
+    }
+    float fx = (float) width/maskSize[0], fy = (float) height/maskSize[1];
+
+    //The masks, in the template
+    const char* names[] = {"headMask", "torsoMask", "legsMask", "feetMask"};
+    partMasks.clear();
+    for(int k = 0; k < 4; k++)
+    {
+        std::vector<int> mask;
+        fs[names[k]] >> mask;
+        if(mask.size() != 4)
+        {
+            std::cout << names[k] << " is missing in " << filename << std::endl;
+            return false;
+        }
+
+        int x0 = cvRound(mask[0]*fx), y0 = cvRound(mask[1]*fy);
+        int x1 = cvRound((mask[0]+mask[2])*fx), y1 = cvRound((mask[1]+mask[3])*fy);
+        partMasks.push_back(cv::Rect(x0, y0, x1-x0, y1-y0) & cv::Rect(0, 0, width, height));
+    }
+
+    prepare();
+    return true;
+}
+
+void bvtSpec::prepare()
+{
+    //Bins of every H, S and V value, as calcHist finds them (H is in [0, 180))
+    hBin.resize(256);
+    sBin.resize(256);
+    vBin.resize(256);
+    for(int v = 0; v < 256; v++)
+    {
+        hBin[v] = std::min(cvFloor(v*(hBins/180.)), hBins-1)*sBins;
+        sBin[v] = cvFloor(v*(sBins/256.));
+        vBin[v] = cvFloor(v*(bgBins/256.));
+    }
+
+    //Parts are normalized by an integer ratio of areas, like extractBVT
+    normalization.clear();
+    grayScale.clear();
+    for(size_t k = 0; k < partMasks.size(); k++)
+    {
+        normalization.push_back((width*height)/std::max(partMasks[k].area(), 1));
+        grayScale.push_back(normalization.back()*grayWeight);
+    }
+}
+
+int bvtSpec::length() const
+{
+    //H-S histogram, black pixels and gray histogram of each part
+    return partMasks.size()*(hBins*sBins + 1 + bgBins);
+}
+
+void bvtHistograms(const cv::Mat& hsv, float* out, const bvtSpec& spec, int* counts)
+{
+    const int nHS = spec.hBins*spec.sBins;
+    const int *hBin = &spec.hBin[0], *sBin = &spec.sBin[0], *vBin = &spec.vBin[0];
+    const float blackWeight = spec.blackWeight;
+
+    for(size_t k = 0; k < spec.partMasks.size(); k++)
+    {
+        const cv::Rect& part = spec.partMasks[k];
+        int *hs = counts;
+        int *gray = counts + nHS;
+        int black = 0;
+        std::fill(counts, counts + nHS + spec.bgBins, 0);
+
+        //Pixels with V > 1 go to both histograms, the black ones (V = 0) are
+        //only counted
+        for(int y = part.y; y < part.y + part.height; y++)
+        {
+            const uchar *p = hsv.ptr<uchar>(y) + 3*part.x;
+            for(int x = 0; x < part.width; x++, p += 3)
+            {
+                if(p[2] > 1)
+                {
+                    hs[hBin[p[0]] + sBin[p[1]]]++;
+                    gray[vBin[p[2]]]++;
+                }else if(p[2] == 0)
+                {
+                    black++;
+                }
+            }
+        }
+
+        //With the products in float, like OpenCV scales a CV_32F Mat
+        float normalizationConstant = spec.normalization[k];
+        float grayScale = spec.grayScale[k];
+
+        for(int b = 0; b < nHS; b++)
+            *out++ = hs[b]*normalizationConstant;
+        *out++ = black*normalizationConstant*blackWeight;
+        for(int b = 0; b < spec.bgBins; b++)
+            *out++ = gray[b]*grayScale;
+    }
+}
+
+bvtBatchExtractor::bvtBatchExtractor(const bvtSpec& spec) :
+    featureSpec(spec),
+    counts(spec.hBins*spec.sBins + spec.bgBins)
+{
+    if(featureSpec.hBin.empty())
+        featureSpec.prepare();
+}
+
+cv::Mat bvtBatchExtractor::compute(const cv::Mat& image, const std::vector<cv::Rect>& boxes)
+{
+    const int n = boxes.size();
+    const int w = featureSpec.width, h = featureSpec.height;
+    const int length = featureSpec.length();
+
+    if(n == 0)
+        return cv::Mat(0, length, CV_32FC1);
+
+    if(crops.rows < n*h)
+    {
+        crops.create(n*h, w, CV_8UC3);
+        hsv.create(n*h, w, CV_8UC3);
+    }
+    if(features.rows < n)
+        features.create(n, length, CV_32FC1);
+
+    //Resize them all, then convert them to HSV with a single call
+    for(int i = 0; i < n; i++)
+    {
+        cv::Mat crop = crops.rowRange(i*h, (i+1)*h);
+        cv::resize(image(boxes[i]), crop, cv::Size(w, h));
+    }
+
+    cv::Mat hsvUsed = hsv.rowRange(0, n*h);
+    cvtColor(crops.rowRange(0, n*h), hsvUsed, CV_BGR2HSV);
+
+    for(int i = 0; i < n; i++)
+        bvtHistograms(hsv.rowRange(i*h, (i+1)*h), features.ptr<float>(i), featureSpec, &counts[0]);
+
+    return features.rowRange(0, n);
+}
@@ -0,0 +1,257 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/gradientFixed.hpp"
+#include <algorithm>
+#include "../include/detector/sse.hpp"
+
+using namespace std;
+
+// Image values are quantized to 13 fractional bits (and clamped to +-2), so
+// twice a gradient fits in 16 bits for images in [0,1] (it saturates beyond)
+static const float qScale = 8192.f;
+static const int qMax = 16383;
+
+// Angles are binary angles, pi = 65536
+static const int atanBits = 10;
+
+// Orientation of (gx,gy) in [0,pi) as a binary angle, a[f*nAtan + t], where
+// t is the rounded ratio of the smaller to the larger component, in 1/2^atanBits
+// units, and bits 0 and 1 of f say if |gy| > |gx| and if gx*gy < 0
+static const int nAtan = (1<<atanBits) + 1;
+
+class atanTable
+{
+public:
+    unsigned short a[4*nAtan];
+
+    atanTable()
+    {
+        for( int t=0; t<nAtan; t++ ) {
+            int b = (int) (atan(t/float(1<<atanBits))*65536/PI + .5f);
+            a[t] = (unsigned short) b;
+            a[nAtan+t] = (unsigned short) (32768-b);
+            a[2*nAtan+t] = (unsigned short) ((65536-b) & 65535);
+            a[3*nAtan+t] = (unsigned short) (32768+b);
+        }
+    }
+};
+
+static const unsigned short* atanLut()
+{
+    static const atanTable table;
+    return table.a;
+}
+
+// quantize n values of I to 16 bits (uses sse)
+static void quantize( const float *I, short *Q, int n )
+{
+    const __m128 _s=SET(qScale), _lo=SET((float)-qMax), _hi=SET((float)qMax);
+    int i=0;
+    for( ; i<=n-8; i+=8 ) {
+        __m128i a=_mm_cvtps_epi32(_mm_max_ps(_lo,_mm_min_ps(_hi,MUL(LDu(I[i]),_s))));
+        __m128i b=_mm_cvtps_epi32(_mm_max_ps(_lo,_mm_min_ps(_hi,MUL(LDu(I[i+4]),_s))));
+        _mm_storeu_si128((__m128i*) (Q+i),_mm_packs_epi32(a,b));
+    }
+    for( ; i<n; i++ )
+        Q[i]=(short) _mm_cvtss_si32(_mm_max_ss(_lo,_mm_min_ss(_hi,_mm_set_ss(I[i]*qScale))));
+}
+
+// keep the gradients (twice those of grad1) of the channel with the largest
+// magnitude for rows [y0,y1) of a column, 8 rows at a time (uses sse)
+static void gradMax8( const short *Ic, const short *Il, const short *Ir, int sx,
+  short *Gx, short *Gy, int *M2, int y0, int y1, bool first )
+{
+    for( int y=y0; y<y1; y+=8 ) {
+        __m128i gx=_mm_sub_epi16(_mm_loadu_si128((const __m128i*) (Ir+y)),
+                                 _mm_loadu_si128((const __m128i*) (Il+y)));
+        if( sx==2 ) gx=_mm_max_epi16(_mm_adds_epi16(gx,gx),_mm_set1_epi16(-32767));
+        __m128i gy=_mm_sub_epi16(_mm_loadu_si128((const __m128i*) (Ic+y+1)),
+                                 _mm_loadu_si128((const __m128i*) (Ic+y-1)));
+        __m128i lo=_mm_unpacklo_epi16(gx,gy), hi=_mm_unpackhi_epi16(gx,gy);
+        __m128i m2lo=_mm_madd_epi16(lo,lo), m2hi=_mm_madd_epi16(hi,hi);
+        __m128i *_M2=(__m128i*) (M2+y), *_Gx=(__m128i*) (Gx+y), *_Gy=(__m128i*) (Gy+y);
+
+        if( !first ) {
+            __m128i olo=_mm_loadu_si128(_M2), ohi=_mm_loadu_si128(_M2+1);
+            __m128i klo=_mm_cmpgt_epi32(m2lo,olo), khi=_mm_cmpgt_epi32(m2hi,ohi);
+            __m128i k=_mm_packs_epi32(klo,khi);
+            m2lo=_mm_or_si128(_mm_and_si128(klo,m2lo),_mm_andnot_si128(klo,olo));
+            m2hi=_mm_or_si128(_mm_and_si128(khi,m2hi),_mm_andnot_si128(khi,ohi));
+            gx=_mm_or_si128(_mm_and_si128(k,gx),_mm_andnot_si128(k,_mm_loadu_si128(_Gx)));
+            gy=_mm_or_si128(_mm_and_si128(k,gy),_mm_andnot_si128(k,_mm_loadu_si128(_Gy)));
+        }
+        _mm_storeu_si128(_M2,m2lo); _mm_storeu_si128(_M2+1,m2hi);
+        _mm_storeu_si128(_Gx,gx); _mm_storeu_si128(_Gy,gy);
+    }
+}
+
+// saturate a doubled one-sided difference as _mm_adds_epi16 (keeping -g in range)
+static inline int sat( int g ) { return max(-32767, min(32767, g)); }
+
+// same as gradMax8 for a single row
+static inline void gradMax1( const short *Ic, const short *Il, const short *Ir,
+  int sx, int h, short *Gx, short *Gy, int *M2, int y, bool first )
+{
+    int gx=sat(sx*(Ir[y]-Il[y])), gy;
+    if( y==0 ) gy=sat(2*(Ic[1]-Ic[0]));
+    else if( y==h-1 ) gy=sat(2*(Ic[h-1]-Ic[h-2]));
+    else gy=sat(Ic[y+1]-Ic[y-1]);
+
+    int m2=gx*gx+gy*gy;
+    if( first || m2>M2[y] ) { M2[y]=m2; Gx[y]=(short) gx; Gy[y]=(short) gy; }
+}
+
+// atanTable index of 8 gradients at a time (uses sse)
+static void orientIndex8( const short *Gx, const short *Gy, int *T, int n )
+{
+    const __m128i _0=_mm_setzero_si128(), _1=_mm_set1_epi16(1);
+    const __m128i _f1=_mm_set1_epi16(nAtan), _f2=_mm_set1_epi16(2*nAtan);
+    const __m128 _t=SET((float)(1<<atanBits)), _half=SET(.5f);
+    for( int i=0; i<=n-8; i+=8 ) {
+        __m128i gx=_mm_loadu_si128((const __m128i*) (Gx+i));
+        __m128i gy=_mm_loadu_si128((const __m128i*) (Gy+i));
+        // orientations are taken modulo pi, so only gy >= 0 is needed
+        __m128i neg=_mm_cmpgt_epi16(_0,gy);
+        gx=_mm_sub_epi16(_mm_xor_si128(gx,neg),neg);
+        gy=_mm_sub_epi16(_mm_xor_si128(gy,neg),neg);
+        __m128i ax=_mm_max_epi16(gx,_mm_sub_epi16(_0,gx));
+        __m128i mn=_mm_min_epi16(ax,gy), mx=_mm_max_epi16(_mm_max_epi16(ax,gy),_1);
+        __m128i f=_mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(gy,ax),_f1),
+                               _mm_and_si128(_mm_cmpgt_epi16(_0,gx),_f2));
+        for( int k=0; k<2; k++ ) {
+            __m128i a=k ? _mm_unpackhi_epi16(mn,_0) : _mm_unpacklo_epi16(mn,_0);
+            __m128i b=k ? _mm_unpackhi_epi16(mx,_0) : _mm_unpacklo_epi16(mx,_0);
+            __m128i c=k ? _mm_unpackhi_epi16(f,_0) : _mm_unpacklo_epi16(f,_0);
+            __m128 t=ADD(_mm_div_ps(MUL(CVT(a),_t),CVT(b)),_half);
+            _mm_storeu_si128((__m128i*) (T+i+4*k),ADD(CVT(t),c));
+        }
+    }
+}
+
+// same as orientIndex8 for a single gradient
+static inline int orientIndex1( int gx, int gy )
+{
+    if( gy<0 ) { gx=-gx; gy=-gy; }
+    int ax=gx<0 ? -gx : gx, mn=min(ax,gy), mx=max(max(ax,gy),1);
+    return (int) (mn*float(1<<atanBits)/mx + .5f) + (gy>ax ? nAtan : 0) +
+           (gx<0 ? 2*nAtan : 0);
+}
+
+void gradMagFixed( float *I, float *M, unsigned short *O, int h, int w, int d,
+  int nOrients )
+{
+    const unsigned short *lut = atanLut();
+    const int h8 = 1 + (h-2)/8*8;
+    // Quantized columns x-1, x and x+1 of every channel, Q[((x%3)*d + c)*h]
+    short *Q = (short*) alMalloc(3*d*h*sizeof(short),16);
+    short *Gx = (short*) alMalloc(h*sizeof(short),16);
+    short *Gy = (short*) alMalloc(h*sizeof(short),16);
+    int *M2 = (int*) alMalloc(h*sizeof(int),16);
+    int *T = (int*) alMalloc(h*sizeof(int),16);
+    const __m128 _mScale=SET(.5f/qScale);
+
+    for( int c=0; c<d; c++ )
+        quantize(I + c*h*w, Q + c*h, h);
+
+    // Twice the gradients of gradMag (central differences are not halved and
+    // one-sided differences at the borders are doubled)
+    for( int x=0; x<w; x++ ) {
+        if( x+1<w ) for( int c=0; c<d; c++ )
+            quantize(I + c*h*w + (x+1)*h, Q + (((x+1)%3)*d + c)*h, h);
+
+        for( int c=0; c<d; c++ ) {
+            const short *Ic = Q + ((x%3)*d + c)*h;
+            const short *Il = (x==0) ? Ic : Q + (((x+2)%3)*d + c)*h;
+            const short *Ir = (x==w-1) ? Ic : Q + (((x+1)%3)*d + c)*h;
+            const int sx = (x==0 || x==w-1) ? 2 : 1;
+
+            gradMax1(Ic,Il,Ir,sx,h,Gx,Gy,M2,0,c==0);
+            gradMax8(Ic,Il,Ir,sx,Gx,Gy,M2,1,h8,c==0);
+            for( int y=h8; y<h; y++ )
+                gradMax1(Ic,Il,Ir,sx,h,Gx,Gy,M2,y,c==0);
+        }
+
+        float *Mx = M + x*h; int y=0;
+        for( ; y<=h-4; y+=4 )
+            STRu(Mx[y],MUL(_mm_sqrt_ps(CVT(_mm_load_si128((__m128i*) (M2+y)))),_mScale));
+        for( ; y<h; y++ )
+            Mx[y] = sqrtf((float) M2[y]) * (.5f/qScale);
+
+        if( O ) {
+            unsigned short *Ox = O + x*h;
+            orientIndex8(Gx,Gy,T,h);
+            for( y=h/8*8; y<h; y++ )
+                T[y] = orientIndex1(Gx[y],Gy[y]);
+            for( y=0; y<h; y++ )
+                Ox[y] = (unsigned short) ((lut[T[y]]*nOrients) >> 8);
+        }
+    }
+
+    alFree(Q); alFree(Gx); alFree(Gy); alFree(M2); alFree(T);
+}
+
+void gradHistFixed( float *M, unsigned short *O, float *H, int h, int w,
+  int bin, int nOrients )
+{
+    const int hb=h/bin, wb=w/bin, h0=hb*bin, nb=wb*hb;
+    // Magnitudes in 1/256 units, capped so that a cell can never overflow
+    const int mMax = 65535/(bin*bin);
+    const float norm = 1.f/256/bin/bin;
+    const __m128 _s=SET(256.f), _half=SET(.5f), _mMax=SET((float)mMax);
+    const __m128i _sign=_mm_set1_epi32(32768), _sign16=_mm_set1_epi16(-32768);
+    const __m128i _1=_mm_set1_epi16(1), _n=_mm_set1_epi16(nOrients);
+    // Accumulators of one column of cells, A[yb*nOrients + o]
+    unsigned short *A = (unsigned short*) alMalloc(nOrients*hb*sizeof(unsigned short),16);
+    unsigned short *M0 = (unsigned short*) alMalloc(h*sizeof(unsigned short),16);
+    unsigned short *M1 = (unsigned short*) alMalloc(h*sizeof(unsigned short),16);
+    unsigned short *O0 = (unsigned short*) alMalloc(h*sizeof(unsigned short),16);
+    unsigned short *O1 = (unsigned short*) alMalloc(h*sizeof(unsigned short),16);
+
+    for( int xb=0; xb<wb; xb++ ) {
+        memset(A,0,nOrients*hb*sizeof(unsigned short));
+
+        for( int x=xb*bin; x<(xb+1)*bin; x++ ) {
+            const float *Mx = M + x*h;
+            const unsigned short *Ox = O + x*h;
+
+            // split the magnitudes between the two nearest orientation bins
+            int y=0;
+            for( ; y<=h0-8; y+=8 ) {
+                __m128i a=CVT(ADD(_mm_min_ps(MUL(LDu(Mx[y]),_s),_mMax),_half));
+                __m128i b=CVT(ADD(_mm_min_ps(MUL(LDu(Mx[y+4]),_s),_mMax),_half));
+                // no unsigned 32 to 16 bit pack in sse2
+                __m128i m=_mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a,_sign),
+                    _mm_sub_epi32(b,_sign)),_sign16);
+                __m128i o=_mm_loadu_si128((const __m128i*) (Ox+y));
+                __m128i m1=_mm_mulhi_epu16(m,_mm_slli_epi16(o,8));
+                __m128i o0=_mm_srli_epi16(o,8), o1=_mm_add_epi16(o0,_1);
+                o1=_mm_andnot_si128(_mm_cmpeq_epi16(o1,_n),o1);
+                _mm_store_si128((__m128i*) (M0+y),_mm_sub_epi16(m,m1));
+                _mm_store_si128((__m128i*) (M1+y),m1);
+                _mm_store_si128((__m128i*) (O0+y),o0);
+                _mm_store_si128((__m128i*) (O1+y),o1);
+            }
+            for( ; y<h0; y++ ) {
+                int m=(int) (min(Mx[y]*256,(float) mMax)+.5f);
+                int m1=(m*(Ox[y]&255))>>8, o0=Ox[y]>>8;
+                M0[y]=m-m1; M1[y]=m1; O0[y]=o0; O1[y]=(o0+1==nOrients) ? 0 : o0+1;
+            }
+
+            unsigned short *Ay = A;
+            for( y=0; y<h0; Ay+=nOrients )
+                for( int y1=0; y1<bin; y1++, y++ ) {
+                    Ay[O0[y]] += M0[y]; Ay[O1[y]] += M1[y];
+                }
+        }
+
+        for( int yb=0; yb<hb; yb++ )
+            for( int o=0; o<nOrients; o++ )
+                H[o*nb + xb*hb + yb] = A[yb*nOrients + o]*norm;
+    }
+
+    alFree(A); alFree(M0); alFree(M1); alFree(O0); alFree(O1);
+}
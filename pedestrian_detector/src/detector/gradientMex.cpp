@@ -62,17 +62,22 @@ void grad2( float *I, float *Gx, float *Gy, int h, int w, int d ) {
 }
 
 // build lookup table a[] s.t. a[dx/2.02*n]~=acos(dx)
-float* acosTable() {
-    int i, n=25000, n2=n/2; float t, ni;
-    static float a[25000]; static bool init=false;
-    if( init ) return a+n2; ni = 2.02f/(float) n;
+// (built once, the first thread to get here builds it for all)
+static bool acosTableInit( float *a, int n ) {
+    int i; float t, ni = 2.02f/(float) n;
     for( i=0; i<n; i++ ) {
         t = i*ni - 1.01f;
         t = t<-1 ? -1 : (t>1 ? 1 : t);
         t = (float) acos( t );
         a[i] = (t <= PI-1e-5f) ? t : 0;
     }
-    init=true; return a+n2;
+    return true;
+}
+
+float* acosTable() {
+    const int n=25000, n2=n/2;
+    static float a[25000]; static const bool init=acosTableInit(a,n);
+    (void) init; return a+n2;
 }
 
 // compute gradient magnitude and orientation at each location (uses sse)
@@ -12,12 +12,16 @@
 #include <stack>
 #include <string>
 #include <sstream>
-//#include <thread>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include <fstream>
+#include <functional>
 
 //ROS Includes
 #include <ros/ros.h>
 #include <sensor_msgs/image_encodings.h>
+#include <std_msgs/Int32.h>
 #include <ros/package.h>
 
 //OpenCV Includes
@@ -30,11 +34,15 @@
 
 //Our detector
 #include "../include/detector/pedestrianDetector.hpp"
+#include "../include/detector/frameQueue.hpp"
+#include "../include/detector/qualityController.hpp"
+#include "../include/detector/stagePool.hpp"
 
 //Our custom messages
 #include <pedestrian_detector/DetectionList.h>
 #include <pedestrian_detector/BoundingBox.h>
 #include <pedestrian_detector/Features.h>
+#include <pedestrian_detector/PipelineStats.h>
 
 #include "../include/detector/colorFeatures.hpp"
 
@@ -46,15 +54,45 @@
 using namespace std;
 using namespace cv;
 
-int movAverageLength=10;
-float currentTime = 0, oldestTime = 0, timesSum = 0;
-std::deque<float> times (movAverageLength,0); //I keep the 10 most recent processing times, to compute a moving average
-int frameCounter = 0;
-
-std::vector<cv::Rect> partMasks;
+int movAverageLength=10;	//frames of the moving averages of every camera
 
 //ofstream myfile;
 
+//Frame going through the stages of the node. They are recycled, so the
+//pyramid buffers and the detection vectors are reused from frame to frame
+struct detectorFrame
+{
+    sensor_msgs::ImageConstPtr msg;
+    cv_bridge::CvImageConstPtr cv_ptr;	//shares the data of msg if it is BGR8
+    pyrOutput pyramid;
+    vector<DetectionWithScore> pedestrians;
+    vector<DetectionWithScore> heads;
+    ros::WallTime received;	//when the callback got it
+    int level;			//quality level it is detected at
+    Mat scaled;			//the image resized for the level, if it has to be
+};
+
+typedef unique_ptr<detectorFrame> framePtr;
+
+//What the visualization draws: the frame and its detections
+struct vizFrame
+{
+    cv_bridge::CvImageConstPtr cv_ptr;
+    vector<DetectionWithScore> pedestrians;	//above the minimum score
+    vector<DetectionWithScore> heads;
+    float fps;
+};
+
+typedef unique_ptr<vizFrame> vizPtr;
+
+//Stages of the pipeline: ingest (ROS callback) -> pyramid -> scan and NMS ->
+//features and publishing. The callback leaves the frames in a mailbox, which
+//only keeps the latest one, and the other stages have a queue in front
+enum { stageIngest, stagePyramid, stageScan, stagePublish, nStages };
+static const char* stageNames[nStages] = {"ingest", "pyramid", "scan", "publish"};
+
+//Detector of one camera. Its stages run in the threads of the node's pool,
+//with the other cameras', and its outputs are in the namespace of nh
 class PedDetector
 {
 
@@ -63,89 +101,351 @@ private:
     ros::NodeHandle nh;
     ros::NodeHandle nPriv;
     image_transport::ImageTransport *it;
+    std::string name;		//of the camera, for the log
+    std::string frameId;	//of the detections (empty = the image's)
     image_transport::Subscriber image_sub;
     image_transport::Publisher image_pub;
     std::string detectorType;
     double minDetectionScore;
 
-    //Our detectors
+    //Our detectors (the classifiers are the node's, shared by the cameras)
     pedestrianDetector *person_detector;
 
     //Detections publisher
     ros::Publisher detectionPublisher;
 
+    //Pipeline: the stages after the ingest are tasks of the pool, which runs
+    //one frame of a stage at a time. Frames are dropped (oldest first) when a
+    //stage is behind. Without it the callback runs every stage itself.
+    bool pipelined;
+    stagePool *pool;
+    frameMailbox<detectorFrame> latest;			//in front of the pyramid
+    unique_ptr< frameQueue<framePtr> > queues[nStages];	//in front of the others
+    unique_ptr< frameQueue<framePtr> > spare;		//frames to recycle
+    stageStats stats[nStages];
+
+    //Moving averages of the time between published frames and of the
+    //latency (callback to publish) of the frames
+    int frameCounter;
+    float timesSum;
+    std::deque<float> times;
+    float latencySum;
+    std::deque<float> latencies;
+
+    //Send the image with the detections. Without it DetectionList.im only
+    //has the header of the frame, for the nodes that have the camera topic.
+    bool embedImage;
+
+    //Color features of the detections, in the publish stage
+    bvtBatchExtractor bvt;
+    vector<cv::Rect> boxes;
+
+    //Visualization (image_out), in the low priority pool, of one frame every
+    //visualizationDecimation while image_out has subscribers
+    stagePool *vizPool;
+    frameMailbox<vizFrame> vizMailbox;
+    int visualizationDecimation;
+
+    //Quality adapted to the latency budget. The level is changed by the
+    //publish stage and read by the pyramid stage for the next frame.
+    qualityController quality;
+    atomic<int> qualityLevelNow;
+    ros::Publisher qualityPublisher;
+
+    //Diagnostics
+    atomic<long> imageCopies;		//copies of frames made by the node
+    atomic<long> detectionBytes;	//serialized size of the detections sent
+    long lastCopies, lastBytes;
+    //Reuse of the pyramid cache, written by the pyramid stage after every
+    //frame (its counters are only touched by that thread)
+    atomic<float> tileReuse, scaleReuse;
+    bool lambdasLogged;			//only used by the pyramid stage
+    ros::Publisher statsPublisher;
+    ros::WallTimer statsTimer;
+    ros::WallTime lastStats;
+    atomic<long> published;
+    long lastBusy[nStages], lastFrames[nStages], lastPublished;
+    ros::WallTime lastPublish;
+    int statsReports;
+
+    framePtr newFrame()
+    {
+        framePtr frame;
+        if(!spare->tryPop(frame))
+            frame.reset(new detectorFrame());
+        return frame;
+    }
+
+    void recycle(framePtr &frame)
+    {
+        if(!frame)
+            return;
+
+        frame->msg.reset();
+        frame->cv_ptr.reset();
+        frame->pyramid.clear();
+        if(!spare->tryPush(frame))
+            frame.reset();
+    }
+
+    //Hands the frame to the next stage
+    void forward(int stage, framePtr &frame)
+    {
+        framePtr dropped;
+        queues[stage]->pushDropOldest(frame, dropped);
+        recycle(dropped);
+        pool->notify();
+    }
+
     //Callback to process the images
     void imageCb(const sensor_msgs::ImageConstPtr& msg)
     {
-        tic();
+        if(!pipelined)
+            tic();
+        ros::WallTime start = ros::WallTime::now();
 
-        cv_bridge::CvImagePtr cv_ptr;
+        framePtr frame = newFrame();
         try
         {
-            cv_ptr = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::BGR8);
+            //No copy, unless the image has to be converted to BGR8
+            frame->cv_ptr = cv_bridge::toCvShare(msg, sensor_msgs::image_encodings::BGR8);
         }
         catch(cv_bridge::Exception& e)
         {
             ROS_ERROR("cv_bridge exception: %s", e.what());
+            if(!pipelined)
+                tocMatteo();
+            recycle(frame);
+            return;
+        }
+        frame->msg = msg;
+        frame->received = start;
+        if(msg->data.empty() || frame->cv_ptr->image.data != &msg->data[0])
+            imageCopies++;
+        stats[stageIngest].add((ros::WallTime::now() - start).toSec());
+
+        if(pipelined)
+        {
+            framePtr replaced;
+            latest.put(frame, replaced);
+            recycle(replaced);
+            pool->notify();
             return;
         }
 
-        cv::Mat image(cv_ptr->image);
+        computePyramid(*frame);
+        scan(*frame);
+        publish(*frame, tocMatteo());
+        recycle(frame);
+    }
 
+    //A frame that fails goes on without detections
+    void computePyramid(detectorFrame &frame)
+    {
+        ros::WallTime start = ros::WallTime::now();
 
+        //Settings of the current quality level
+        frame.level = qualityLevelNow.load();
+        const qualityLevel &settings = quality.levels[frame.level];
+        applyLevel(settings);
 
-        person_detector->runDetector(image);
-        Mat imageDisplay = image.clone();
+        const Mat *image = &frame.cv_ptr->image;
+        if(settings.imageScale < 1)
+        {
+            resize(*image, frame.scaled, Size(), settings.imageScale, settings.imageScale, INTER_AREA);
+            image = &frame.scaled;
+        }
 
+        if(!person_detector->computePyramid(*image, settings.scanStride, frame.pyramid,
+                                            frame.pedestrians, frame.heads))
+            ROS_WARN_THROTTLE(10, "%sThe pyramid of a frame could not be computed", logPrefix());
 
+        pyrChannelCache *cache = person_detector->pInput->cache.get();
+        if(cache != NULL)
+        {
+            tileReuse = cache->stats().tileReuse();
+            scaleReuse = cache->stats().scaleReuse();
+        }
 
-        pedestrian_detector::DetectionList detectionList;
+        //The lambdas estimated over the first lambdaFrames frames, once they are kept
+        const pyrInput *pInput = person_detector->pInput.get();
+        if(!lambdasLogged && !pInput->lambdas.empty() && pInput->lambdaCount > 0)
+        {
+            lambdasLogged = true;
+            std::ostringstream values;
+            for(size_t i = 0; i < pInput->lambdas.size(); i++)
+                values << " " << pInput->lambdas[i];
+            ROS_INFO("%sLambdas estimated on %d frames:%s", logPrefix(), pInput->lambdaCount, values.str().c_str());
+        }
 
-        detectionList.header = msg->header;
-        detectionList.header.frame_id = "l_camera_vision_link";
+        stats[stagePyramid].add((ros::WallTime::now() - start).toSec());
+    }
 
+    void scan(detectorFrame &frame)
+    {
+        ros::WallTime start = ros::WallTime::now();
 
-        //Print rectangles on the image and add them to the detection list
-        //Print detection numbers so that we can initialize the tracker using Rviz
-        //And send a marker with each detection number to Rviz
-        vector<DetectionWithScore>::iterator it;
+        //In banded mode the pyramid stage already scanned the frame
+        if(frame.pyramid.nScales > 0)
+            person_detector->scanPyramid(frame.pyramid, quality.levels[frame.level].scanStride,
+                                         frame.pedestrians, frame.heads);
 
-        if(detectorType.compare("pedestrian") == 0 || detectorType.compare("full") == 0)
+        //The channels are not needed anymore, give them back to the pool
+        frame.pyramid.clear();
+
+        //Back to the coordinates of the frame
+        float imageScale = quality.levels[frame.level].imageScale;
+        if(imageScale < 1)
         {
-            for(it = person_detector->boundingBoxes->begin(); it != person_detector->boundingBoxes->end(); it++){
+            toFrame(frame.pedestrians, imageScale);
+            toFrame(frame.heads, imageScale);
+        }
 
+        stats[stageScan].add((ros::WallTime::now() - start).toSec());
+    }
 
-                if(it->score < minDetectionScore)
-                    continue;
+    //Pyramid settings of a level. nApprox was resolved for the configured
+    //nPerOct, so it is worked out again for the level's.
+    void applyLevel(const qualityLevel &settings)
+    {
+        pyrInput *pInput = person_detector->pInput.get();
+        int nApprox = person_detector->parsed->nApprox;
+        pInput->nPerOct = settings.nPerOct;
+        pInput->nApprox = nApprox < 0 ? settings.nPerOct-1 : min(nApprox, settings.nPerOct-1);
+    }
+
+    static void toFrame(vector<DetectionWithScore> &detections, float imageScale)
+    {
+        for(size_t k = 0; k < detections.size(); k++)
+        {
+            Rect &r = detections[k].bbox;
+            r = Rect(cvRound(r.x/imageScale), cvRound(r.y/imageScale),
+                     cvRound(r.width/imageScale), cvRound(r.height/imageScale));
+        }
+    }
+
+    //Moving average of the latency, and the quality level it asks for
+    void updateQuality(const detectorFrame &frame)
+    {
+        float latency = (ros::WallTime::now() - frame.received).toSec();
+        latencies.push_front(latency);
+        latencySum += latency - latencies.back();
+        latencies.pop_back();
+
+        if(frameCounter < movAverageLength || !quality.update(1000*latencySum/movAverageLength))
+            return;
 
-                Mat person = image(it->bbox);
-                Mat resizedPerson;
-                //Resize it for 52x128
+        qualityLevelNow = quality.level();
 
-                resize(person, resizedPerson, Size(52, 128));
+        std_msgs::Int32 level;
+        level.data = quality.level();
+        qualityPublisher.publish(level);
 
-                Mat bvtHistogram;
+        const qualityLevel &settings = quality.settings();
+        ROS_INFO("%sQuality level %d (%.0f ms mean latency, budget %.0f ms): image scale %.2f, "
+                 "%d scales per octave, scan stride %d", logPrefix(), quality.level(),
+                 1000*latencySum/movAverageLength, quality.budgetMs,
+                 settings.imageScale, settings.nPerOct, settings.scanStride);
+    }
 
-                extractBVT(resizedPerson, bvtHistogram, 10, partMasks);
+    const char* logPrefix() const
+    {
+        return name.c_str();
+    }
 
-                bvtHistogram.convertTo(bvtHistogram, CV_32FC1);
+    //One frame of a stage, for the pool. False if the stage had none.
+    bool pyramidStep()
+    {
+        framePtr frame;
+        if(!latest.tryTake(frame))
+            return false;
 
+        computePyramid(*frame);
+        forward(stageScan, frame);
+        return true;
+    }
 
-                //Most efficient way to convert a row Mat to std::vector, according to stackoverflow
-                const float* p = bvtHistogram.ptr<float>(0);
+    bool scanStep()
+    {
+        framePtr frame;
+        if(!queues[stageScan]->tryPop(frame))
+            return false;
+
+        scan(*frame);
+        forward(stagePublish, frame);
+        return true;
+    }
+
+    bool publishStep()
+    {
+        framePtr frame;
+        if(!queues[stagePublish]->tryPop(frame))
+            return false;
+
+        //Frame rate of the pipeline, from the time between published frames
+        ros::WallTime now = ros::WallTime::now();
+        float frameTime = lastPublish.isZero() ? 0 : (now - lastPublish).toSec();
+        lastPublish = now;
+
+        publish(*frame, frameTime);
+        recycle(frame);
+        return true;
+    }
+
+    //Extracts the features of the detections and publishes them
+    void publish(detectorFrame &frame, float frameTime)
+    {
+        ros::WallTime start = ros::WallTime::now();
+
+        const Mat &image = frame.cv_ptr->image;
+
+        pedestrian_detector::DetectionList detectionList;
+
+        detectionList.header = frame.msg->header;
+        if(!frameId.empty())
+            detectionList.header.frame_id = frameId;
+
+        //Drawn later by the visualization thread, if anyone is watching
+        bool visualize = image_pub.getNumSubscribers() > 0 &&
+                (frameCounter % visualizationDecimation) == 0;
+        vizPtr viz;
+        if(visualize)
+        {
+            viz.reset(new vizFrame());
+            viz->cv_ptr = frame.cv_ptr;
+            viz->heads = frame.heads;
+        }
+
+
+        //Add the rectangles to the detection list, with the BVT histograms of
+        //all of them computed together
+        vector<DetectionWithScore>::iterator it;
+
+        if(detectorType.compare("pedestrian") == 0 || detectorType.compare("full") == 0)
+        {
+            boxes.clear();
+            for(it = frame.pedestrians.begin(); it != frame.pedestrians.end(); it++)
+                if(it->score >= minDetectionScore)
+                    boxes.push_back(it->bbox);
+
+            Mat bvtHistograms = bvt.compute(image, boxes);
+
+            int k = 0;
+            for(it = frame.pedestrians.begin(); it != frame.pedestrians.end(); it++){
+
+
+                if(it->score < minDetectionScore)
+                    continue;
 
-                // Copy data to a vector.  Note that (p + mat.cols) points to the
-                // end of the row.
-                std::vector<float> vec(p, p + bvtHistogram.cols);
+                //One row per detection
+                const float* p = bvtHistograms.ptr<float>(k++);
 
                 pedestrian_detector::Features colorFeatures;
 
-                colorFeatures.features = vec;
+                colorFeatures.features.assign(p, p + bvtHistograms.cols);
 
-                rectangle(imageDisplay, it->bbox, Scalar_<int>(0,255,0), 3);
-                stringstream sss;
-                sss << it->score;
-                putText(imageDisplay, sss.str(), it->bbox.tl(), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
+                if(visualize)
+                    viz->pedestrians.push_back(*it);
 
                 pedestrian_detector::BoundingBox bb;
                 bb.x = it->bbox.x;
@@ -160,74 +460,280 @@ private:
 
         //Compute processing time
         frameCounter++;
-        currentTime=tocMatteo();
+        float currentTime=frameTime;
         times.push_front(currentTime); //Insert a new time in the list
-        oldestTime = times.back(); //Read the oldest time from the list
+        float oldestTime = times.back(); //Read the oldest time from the list
         times.pop_back(); //Remove the oldest time from the list
         //Update the moving average sum
         timesSum+=currentTime;
         timesSum-=oldestTime;
-        if(frameCounter>=10)
+
+        updateQuality(frame);
+
+        if(visualize)
         {
-            //          cout<<"Processing time = "<<timesSum/float(movAverageLength)<<". FPS="<<float(movAverageLength)/timesSum<<std::endl;
-            stringstream ss;
-            ss << float(movAverageLength)/timesSum;
-            putText(imageDisplay, ss.str(), Point(0, 30), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
+            viz->fps = frameCounter>=10 ? float(movAverageLength)/timesSum : 0;
+
+            vizPtr replaced;
+            vizMailbox.put(viz, replaced);
+            vizPool->notify();
         }
 
-        //Number of detections, fps
-        //        myfile << person_detector->headBoundingBoxes->size() << " " << float(movAverageLength)/timesSum << endl;
+        //Publish the detections (I will also publish the features associated to each detection)
+        if(embedImage)
+        {
+            detectionList.im = *frame.msg;
+            imageCopies++;
+        }else
+        {
+            detectionList.im.header = frame.msg->header;
+        }
+        detectionPublisher.publish(detectionList);
+        detectionBytes += ros::serialization::serializationLength(detectionList);
+
+        stats[stagePublish].add((ros::WallTime::now() - start).toSec());
+        published++;
 
+    }
+
+    //Draws the detections of the latest frame handed to it and publishes the
+    //image. The pool runs it at the lowest priority, so it only takes idle
+    //CPU time.
+    bool visualizationStep()
+    {
+        vizPtr viz;
+        if(!vizMailbox.tryTake(viz))
+            return false;
+
+        Mat imageDisplay = viz->cv_ptr->image.clone();
+        imageCopies++;
+
+        //Print rectangles on the image
+        //Print detection numbers so that we can initialize the tracker using Rviz
+        vector<DetectionWithScore>::iterator it;
+        for(it = viz->pedestrians.begin(); it != viz->pedestrians.end(); it++)
+        {
+            rectangle(imageDisplay, it->bbox, Scalar_<int>(0,255,0), 3);
+            stringstream sss;
+            sss << it->score;
+            putText(imageDisplay, sss.str(), it->bbox.tl(), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
+        }
+
+        if(viz->fps > 0)
+        {
+            stringstream ss;
+            ss << viz->fps;
+            putText(imageDisplay, ss.str(), Point(0, 30), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
+        }
 
         if(detectorType.compare("headandshoulders") == 0 || detectorType.compare("full") == 0)
         {
-            for(it = person_detector->headBoundingBoxes->begin(); it != person_detector->headBoundingBoxes->end(); it++)
+            for(it = viz->heads.begin(); it != viz->heads.end(); it++)
             {
                 rectangle(imageDisplay, it->bbox, Scalar_<int>(0,0,255), 3);
             }
         }
 
-        //Publish the resulting image for now. Later I might publish only the detections for another node to process
+        //Publish the resulting image
         sensor_msgs::ImagePtr out_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", imageDisplay).toImageMsg();
         image_pub.publish(out_msg);
+        imageCopies++;
+        return true;
+    }
 
+    //Mean time of every stage per frame, queue depths and drops since the last report
+    void statsCb(const ros::WallTimerEvent&)
+    {
+        ros::WallTime now = ros::WallTime::now();
+        double elapsed = (now - lastStats).toSec();
+        lastStats = now;
 
+        pedestrian_detector::PipelineStats msg;
+        msg.header.stamp = ros::Time::now();
 
+        long nPublished = published.load() - lastPublished;
+        msg.fps = elapsed > 0 ? nPublished / elapsed : 0;
+        lastPublished += nPublished;
 
+        stringstream log;
+        log << "Pipeline: " << msg.fps << " fps";
 
-        //Publish the detections (I will also publish the features associated to each detection)
-        detectionList.im = *msg;
-        detectionPublisher.publish(detectionList);
+        for(int k = 0; k < nStages; k++)
+        {
+            long busy = stats[k].busyMicroseconds(), frames = stats[k].frames();
+            float meanMs = frames > lastFrames[k] ?
+                        (busy - lastBusy[k]) / 1000.f / (frames - lastFrames[k]) : 0;
+            lastBusy[k] = busy;
+            lastFrames[k] = frames;
+
+            msg.stages.push_back(stageNames[k]);
+            msg.meanMs.push_back(meanMs);
+            if(k == stagePyramid && pipelined)
+            {
+                msg.queueDepth.push_back(latest.size());
+                msg.dropped.push_back(latest.dropped());
+            }else
+            {
+                msg.queueDepth.push_back(queues[k] ? queues[k]->size() : 0);
+                msg.dropped.push_back(queues[k] ? queues[k]->dropped() : 0);
+            }
 
+            log << ", " << stageNames[k] << " " << meanMs << " ms";
+            if(pipelined && k != stageIngest)
+                log << " (" << msg.queueDepth.back() << " queued, "
+                    << msg.dropped.back() << " dropped)";
+        }
+
+        //Copies of the image and bandwidth of the detections
+        long copies = imageCopies.load(), bytes = detectionBytes.load();
+        msg.imageCopiesPerFrame = nPublished > 0 ? (float) (copies - lastCopies) / nPublished : 0;
+        msg.detectionsKBps = elapsed > 0 ? (bytes - lastBytes) / 1024. / elapsed : 0;
+        lastCopies = copies;
+        lastBytes = bytes;
+
+        log << ", " << msg.imageCopiesPerFrame << " image copies per frame, "
+            << msg.detectionsKBps << " KB/s of detections";
+
+        if(person_detector->pInput->cache)
+            log << ", " << 100*tileReuse.load() << "% of the pyramid tiles and "
+                << 100*scaleReuse.load() << "% of the scales reused";
+
+        msg.qualityLevel = qualityLevelNow.load();
+        if(quality.budgetMs > 0)
+            log << ", quality level " << msg.qualityLevel;
+
+        statsPublisher.publish(msg);
+
+        //Every 10 s (not ROS_INFO_THROTTLE, the cameras share its timer)
+        if(++statsReports % 10 == 0)
+            ROS_INFO("%s%s", logPrefix(), log.str().c_str());
     }
 
 public:
-    PedDetector(ros::NodeHandle & nh_,string conf_pedestrians, string conf_heads): nh(nh_), nPriv("~")
+    //The stages are added to pool and vizPool, which the node starts once
+    //every camera is made
+    PedDetector(ros::NodeHandle & nh_, image_transport::ImageTransport &input,
+                const std::string &imageTopic, const std::string &cameraName, const std::string &cameraFrame,
+                const shared_ptr<const detectorModel> &model, const bvtSpec &bvtFeatures,
+                stagePool &pool_, stagePool &vizPool_):
+        nh(nh_), nPriv("~"), frameId(cameraFrame), pool(&pool_), bvt(bvtFeatures), vizPool(&vizPool_), quality(1)
     {
         //Initialization
-
+        if(!cameraName.empty())
+            name = "[" + cameraName + "] ";
 
         nPriv.param<std::string>("detector_type", detectorType, "full");
         nPriv.param<double>("min_score", minDetectionScore, 30);
 
-        stringstream ss;
-        ss << ros::package::getPath("pedestrian_detector");
-        person_detector = new pedestrianDetector(conf_pedestrians, conf_heads, detectorType, ss.str());
+        person_detector = new pedestrianDetector(model, detectorType);
+
+        //Channel layout of the pyramid (OpenCV's row-major or the toolbox's column-major)
+        bool rowMajorChannels;
+        nPriv.param<bool>("row_major_channels", rowMajorChannels, CHNS_DEFAULT_LAYOUT == rowMajor);
+        person_detector->pInput->layout = rowMajorChannels ? rowMajor : colMajor;
+
+        //Rows per band of the pyramid's real scales (0 computes them on the whole image)
+        int bandHeight;
+        nPriv.param<int>("pyramid_band_height", bandHeight, 0);
+        person_detector->pInput->bandHeight = bandHeight;
+
+        //Reuse the channels of the pyramid tiles that did not change since the last frame (static camera)
+        bool pyramidCache;
+        nPriv.param<bool>("pyramid_cache", pyramidCache, false);
+        if(pyramidCache)
+        {
+            double threshold;
+            nPriv.param<double>("pyramid_cache_threshold", threshold, 0.01);
+            person_detector->pInput->cache.reset(new pyrChannelCache());
+            person_detector->pInput->cache->threshold = threshold;
+        }
+
+        //Latency budget per frame (0 disables it): above it the detector steps
+        //down to cheaper settings, below lower_ratio of it back up
+        quality = qualityController(person_detector->parsed->nPerOct);
+        double budget, lowerRatio;
+        nPriv.param<double>("quality_budget_ms", budget, 0);
+        nPriv.param<double>("quality_lower_ratio", lowerRatio, 0.6);
+        nPriv.param<int>("quality_hold_frames", quality.holdFrames, 10);
+        quality.budgetMs = budget;
+        quality.lowerRatio = lowerRatio;
+        qualityLevelNow = 0;
+
+        //Run the stages in their own threads, with queue_size frames in front of each one
+        int queueSize;
+        nPriv.param<bool>("pipeline", pipelined, true);
+        nPriv.param<int>("pipeline_queue_size", queueSize, 2);
+        queueSize = max(queueSize, 1);
+
+        nPriv.param<bool>("embed_image", embedImage, true);
+        nPriv.param<int>("visualization_decimation", visualizationDecimation, 1);
+        visualizationDecimation = max(visualizationDecimation, 1);
+
+        frameCounter = 0;
+        timesSum = latencySum = 0;
+        times.assign(movAverageLength, 0);
+        latencies.assign(movAverageLength, 0);
+
+        published = 0;
+        imageCopies = 0;
+        detectionBytes = 0;
+        lastPublished = lastCopies = lastBytes = 0;
+        statsReports = 0;
+        tileReuse = scaleReuse = 0;
+        lambdasLogged = false;
+        for(int k = 0; k < nStages; k++)
+            lastBusy[k] = lastFrames[k] = 0;
+
+        spare.reset(new frameQueue<framePtr>(nStages*(queueSize+1)));
+        if(pipelined)
+        {
+            for(int k = stageScan; k < nStages; k++)
+                queues[k].reset(new frameQueue<framePtr>(queueSize));
+
+            pool->add(std::bind(&PedDetector::pyramidStep, this));
+            pool->add(std::bind(&PedDetector::scanStep, this));
+            pool->add(std::bind(&PedDetector::publishStep, this));
+        }
+        vizPool->add(std::bind(&PedDetector::visualizationStep, this));
+
         it = new image_transport::ImageTransport(nh);
 
         //Advertise
         image_pub = it->advertise("image_out", 1);
         detectionPublisher = nh.advertise<pedestrian_detector::DetectionList>("detections", 1);
+        statsPublisher = nh.advertise<pedestrian_detector::PipelineStats>("pipeline_stats", 1);
+        qualityPublisher = nh.advertise<std_msgs::Int32>("quality_level", 1, true);
+        std_msgs::Int32 level;
+        level.data = 0;
+        qualityPublisher.publish(level);
+
+        lastStats = ros::WallTime::now();
+        statsTimer = nh.createWallTimer(ros::WallDuration(1.0), &PedDetector::statsCb, this);
+
+        //Subscribe to the camera (relative topics are in the node's namespace)
+        image_sub = input.subscribe(imageTopic, 1, &PedDetector::imageCb, this);
+    }
 
-        //Subscribe to vizzy's left camera
-        //Change this later
-        image_sub = it->subscribe("/vizzy/l_camera/image_rect_color", 1, &PedDetector::imageCb, this);
-        //image_sub = it->subscribe("/vizzy/l_camera/image_raw", 1, &PedDetector::imageCb, this);
-        //image_sub = it->subscribe("image_in", 1, &PedDetector::imageCb, this);
+    //No more frames. The node stops the pools after this, before deleting
+    //the detector.
+    void shutdown()
+    {
+        image_sub.shutdown();
+        statsTimer.stop();
     }
 
     ~PedDetector()
     {
+        shutdown();
+
+        //Frames still queued hold channels of the detector's pool
+        framePtr left;
+        latest.tryTake(left);
+        left.reset();
+        for(int k = 0; k < nStages; k++)
+            queues[k].reset();
+        spare.reset();
+
         delete person_detector;
         delete it;
     }
@@ -235,6 +741,80 @@ public:
 
 };
 
+//The node: the cameras share one model (the classifiers are loaded once) and
+//one pool of threads, which runs the stages of all of them in turns
+class DetectorNode
+{
+private:
+    ros::NodeHandle nh;
+    ros::NodeHandle nPriv;
+    image_transport::ImageTransport input;
+    shared_ptr<const detectorModel> model;
+    stagePool pool;		//the stages of every camera
+    stagePool vizPool;		//their visualization, at the lowest priority
+    vector< unique_ptr<PedDetector> > cameras;
+
+public:
+    DetectorNode(ros::NodeHandle & nh_, string conf_pedestrians, string conf_heads, const bvtSpec &bvtFeatures):
+        nh(nh_), nPriv("~"), input(nh_)
+    {
+        //One topic per camera. With more than one, the outputs of each camera
+        //are in a namespace of its own (camera_names, camera0, camera1... by
+        //default), and the detections keep the frame of their images unless
+        //camera_frames says otherwise.
+        vector<std::string> topics, names, frames;
+        nPriv.param("image_topics", topics, vector<std::string>(1, "/vizzy/l_camera/image_rect_color"));
+        nPriv.param("camera_names", names, vector<std::string>());
+        nPriv.param("camera_frames", frames, vector<std::string>());
+        if(topics.empty())
+            topics.push_back("/vizzy/l_camera/image_rect_color");
+
+        for(size_t k = names.size(); k < topics.size(); k++)
+        {
+            stringstream name;
+            if(topics.size() > 1)
+                name << "camera" << k;
+            names.push_back(name.str());
+        }
+        for(size_t k = frames.size(); k < topics.size(); k++)
+            frames.push_back(topics.size() == 1 ? "l_camera_vision_link" : "");
+
+        stringstream ss;
+        ss << ros::package::getPath("pedestrian_detector");
+        model = make_shared<const detectorModel>(conf_pedestrians, conf_heads, ss.str());
+
+        for(size_t k = 0; k < topics.size(); k++)
+        {
+            ros::NodeHandle cameraNh(nh, names[k]);
+            cameras.push_back(unique_ptr<PedDetector>(
+                new PedDetector(cameraNh, input, topics[k], names[k], frames[k], model,
+                                bvtFeatures, pool, vizPool)));
+            ROS_INFO("Camera %s: detecting on %s", names[k].empty() ? "0" : names[k].c_str(),
+                     topics[k].c_str());
+        }
+
+        //Threads of the pool (0 = one per stage of every camera, up to the cores)
+        int threads;
+        nPriv.param<int>("worker_threads", threads, 0);
+        if(threads <= 0)
+            threads = min<int>((nStages-1)*cameras.size(), max(std::thread::hardware_concurrency(), 1u));
+        threads = min<int>(threads, max<int>(pool.tasks(), 1));
+
+        pool.start(threads);
+        vizPool.start(1, 19);
+    }
+
+    ~DetectorNode()
+    {
+        //No more frames, then stop the stages, then the cameras
+        for(size_t k = 0; k < cameras.size(); k++)
+            cameras[k]->shutdown();
+        pool.stop();
+        vizPool.stop();
+        cameras.clear();
+    }
+};
+
 
 int main(int argc, char** argv)
 {
@@ -258,32 +838,13 @@ int main(int argc, char** argv)
     ss3 << ros::package::getPath("pedestrian_detector");
     ss3 << "/partMasks.yaml";
 
-    FileStorage fs(ss3.str(), FileStorage::READ);
-
-    std::vector<int> headVect;
-    std::vector<int> torsoVect;
-    std::vector<int> legsVect;
-    std::vector<int> feetVect;
-
-    fs["headMask"] >> headVect;
-    fs["torsoMask"] >> torsoVect;
-    fs["legsMask"] >> legsVect;
-    fs["feetMask"] >> feetVect;
-
-    cv::Rect headMask(headVect[0], headVect[1], headVect[2], headVect[3]);
-    cv::Rect torsoMask(torsoVect[0], torsoVect[1], torsoVect[2], torsoVect[3]);
-    cv::Rect legsMask(legsVect[0], legsVect[1], legsVect[2], legsVect[3]);
-    cv::Rect feetMask(feetVect[0], feetVect[1], feetVect[2], feetVect[3]);
-
-    fs.release();
-
-    partMasks.push_back(headMask);
-    partMasks.push_back(torsoMask);
-    partMasks.push_back(legsMask);
-    partMasks.push_back(feetMask);
+    //Parameters of the color features, and the part masks
+    bvtSpec bvtFeatures;
+    if(!bvtFeatures.load(ss3.str()))
+        return -1;
 
 
-    PedDetector detector(n, ss.str(), ss2.str());
+    DetectorNode detector(n, ss.str(), ss2.str(), bvtFeatures);
 
     ros::spin();
     //    myfile.close();
@@ -69,6 +69,24 @@ float* convertFromMat(const Mat& data, int height, int width, int channels,
     return output;
 };
 
+float* convertFromMatRowMajor(const Mat& bgr, int misalign){
+    int height = bgr.rows, width = bgr.cols, channels = bgr.channels();
+    int planeSize = height*width;
+    float* output = (float*) wrCalloc(planeSize*channels + misalign,
+	    sizeof(float)) + misalign;
+
+    std::vector<Mat> planes;
+    split(bgr, planes);
+
+    // BGR -> RGB by writing the planes in reverse order
+    for(int c=0; c < channels; c++){
+	Mat plane(height, width, CV_32FC1, output + (channels-1-c)*planeSize);
+	planes[c].convertTo(plane, CV_32F, 1/255.0, 0);
+    }
+
+    return output;
+};
+
 void writeToMatlab(const float* data, int height, int width, int channels,
 		int misalign, string filename, string name){
     std::ofstream myfile;
@@ -32,6 +32,16 @@ void rapidxml::parse_error_handler(const char *what, void *where){
 }
 //*/
 
+/*
+ * Attributes added after the first configuration files, so they are optional
+ */
+static const char* optionalAttribute(rapidxml::xml_node<> *node,
+                                     const char *name, const char *value)
+{
+    rapidxml::xml_attribute<> *attribute = node->first_attribute(name);
+    return attribute ? attribute->value() : value;
+}
+
 //*/
 helperXMLParser::helperXMLParser(string filename, std::string class_path){
     // Read the source file
@@ -62,7 +72,34 @@ helperXMLParser::helperXMLParser(string filename, std::string class_path){
     // Pyramid node
     rapidxml::xml_node<> *pyramidN = root_node->first_node("pyramid");
     nrChannels = atoll(pyramidN->first_attribute("nrChannels")->value());
-    nrScales = atoll(pyramidN->first_attribute("nrScales")->value());
+    nPerOct = atoll(optionalAttribute(pyramidN, "nPerOct", "8"));
+    nApprox = atoll(optionalAttribute(pyramidN, "nApprox", "-1"));
+    nOctUp = atoll(optionalAttribute(pyramidN, "nOctUp", "0"));
+    lambdaFrames = atoll(optionalAttribute(pyramidN, "lambdaFrames", "0"));
+    smoothIm = atof(optionalAttribute(pyramidN, "smoothIm", "1"));
+    smoothChns = atof(optionalAttribute(pyramidN, "smoothChns", "1"));
+    shrink = atoll(optionalAttribute(pyramidN, "shrink", "4"));
+    fixedPointGradients =
+        atoll(optionalAttribute(pyramidN, "fixedPointGradients", "0")) != 0;
+
+    // One lambda per channel type (color, gradient magnitude and histogram)
+    string lambdasValue = optionalAttribute(pyramidN, "lambdas",
+                                            "0 0.1105 0.1083");
+    if(lambdasValue.compare("auto") != 0)
+    {
+        stringstream ls(lambdasValue);
+        float lambda;
+        while(ls >> lambda)
+            lambdas.push_back(lambda);
+
+        if(lambdas.size() != 3)
+        {
+            cout << "Expected 3 lambdas in " << filename
+                 << ", they will be estimated instead" << endl;
+            lambdas.clear();
+        }
+    }
+
     minH = atoll(pyramidN->first_attribute("minH")->value());
     minW = atoll(pyramidN->first_attribute("minW")->value());
 
@@ -107,7 +144,15 @@ helperXMLParser::~helperXMLParser(){
 void helperXMLParser::print(){
     cout << "Verbose            : " << verbose          << endl
          << "Nr. channels       : " << nrChannels       << endl
-         << "Nr. scales         : " << nrScales         << endl
+         << "Scales per octave  : " << nPerOct          << endl
+         << "Nr. approx. scales : " << nApprox          << endl
+         << "Upsampled octaves  : " << nOctUp           << endl
+         << "Nr. lambdas        : " << lambdas.size()   << endl
+         << "Lambda frames      : " << lambdaFrames     << endl
+         << "Image smoothing    : " << smoothIm         << endl
+         << "Channel smoothing  : " << smoothChns       << endl
+         << "Pyramid shrink     : " << shrink           << endl
+         << "Fixed-point grads. : " << fixedPointGradients << endl
          << "Minimum height     : " << minH             << endl
          << "Minimum width      : " << minW             << endl
          << "widthOverHeight    : " << widthOverHeight  << endl
@@ -127,194 +172,249 @@ void helperXMLParser::print(){
 }
 
 
-pedestrianDetector::pedestrianDetector(string configuration, string configHeadAndShoulders, string detectorType, std::string class_path)
+detectorModel::detectorModel(string configuration, string configHeadAndShoulders, std::string class_path)
 {
-
-    /*Detector initialization*/
-
-    this->detectorType = detectorType;
-
-    parsed = new helperXMLParser(configuration,class_path);
+    parsed.reset(new helperXMLParser(configuration,class_path));
     if(parsed->verbose)
         parsed->print();
 
 
 
     //Parse HeadAndShoulders
-    parsedHeads = new helperXMLParser(configHeadAndShoulders, class_path);
-
-    pInput = new pyrInput();
-    pInput->nApprox = -1; 								//parse it
-    pInput->lambdas = new float[3];  //parse it
-
-    pInput->lambdas[0] = 0;
-    pInput->lambdas[1] = 0.1105;
-    pInput->lambdas[2] = 0.1083;
+    parsedHeads.reset(new helperXMLParser(configHeadAndShoulders, class_path));
 
     /*
-   * Prepares the Strong Classifier Inputs
+   * Loads the classifiers
    */
     // Rectangles Data
-    rectangles = new ClassRectangles(parsed->rectFile,
-                                     parsed->nrFeatures,
-                                     parsed->nrProp);
+    rectangles.reset(new ClassRectangles(parsed->rectFile,
+                                         parsed->nrFeatures,
+                                         parsed->nrProp));
 
     // Classifier Data
-    classData = new ClassData(parsed->classFile,
-                              parsed->nrClass,
-                              parsed->nrCol);
+    classData.reset(new ClassData(parsed->classFile,
+                                  parsed->nrClass,
+                                  parsed->nrCol));
 
     //HeadsClassifier Data
 
-    classDataHeads = new ClassData(parsedHeads->classFile,
-                                   parsedHeads->nrClass,
-                                   parsedHeads->nrCol);
+    classDataHeads.reset(new ClassData(parsedHeads->classFile,
+                                       parsedHeads->nrClass,
+                                       parsedHeads->nrCol));
+}
+
+
+pedestrianDetector::pedestrianDetector(string configuration, string configHeadAndShoulders, string detectorType, std::string class_path) :
+    pedestrianDetector(make_shared<const detectorModel>(configuration, configHeadAndShoulders, class_path), detectorType)
+{
+}
+
+pedestrianDetector::pedestrianDetector(const shared_ptr<const detectorModel> &_model, string detectorType) :
+    model(_model),
+    parsed(_model->parsed.get()),
+    parsedHeads(_model->parsedHeads.get())
+{
+
+    /*Detector initialization*/
+
+    this->detectorType = detectorType;
+
+    // Both detectors share the pyramid, so it follows the pedestrian configuration
+    pInput.reset(new pyrInput());
+    pInput->nPerOct = parsed->nPerOct;
+    pInput->nApprox = parsed->nApprox;
+    pInput->nOctUp = parsed->nOctUp;
+    pInput->smoothIm = parsed->smoothIm;
+    pInput->smoothChns = parsed->smoothChns;
+    pInput->lambdaFrames = parsed->lambdaFrames;
+    pInput->pchns->pGradHist->fixedPoint = parsed->fixedPointGradients;
+
+    // The detector reads the channels with the classifier's shrink
+    pInput->shrink = parsed->shrinkFactor;
+    if(parsed->shrink != parsed->shrinkFactor)
+        cout << "The pyramid shrink (" << parsed->shrink << ") must be the "
+             << "classifier's shrinkFactor, using " << parsed->shrinkFactor
+             << endl;
+
+    // None = estimated by the pyramid
+    pInput->lambdas = parsed->lambdas;
+
+    /*
+   * Prepares the Strong Classifier Inputs
+   */
     // Setup the classifier
-    sctInput = new classifierInput(classData,
-                                   rectangles,
-                                   parsed->verbose,
-                                   parsed->widthOverHeight,
-                                   parsed->shrinkFactor,
-                                   parsed->theoWWidth,
-                                   parsed->theoWHeight,
-                                   parsed->theoActWWidth,
-                                   parsed->theoActWHeight,
-                                   parsed->nBaseFeatures,
-                                   parsed->nExtraFeatures
-                                   );
+    sctInput.reset(new classifierInput(model->classData.get(),
+                                       model->rectangles.get(),
+                                       parsed->verbose,
+                                       parsed->widthOverHeight,
+                                       parsed->shrinkFactor,
+                                       parsed->theoWWidth,
+                                       parsed->theoWHeight,
+                                       parsed->theoActWWidth,
+                                       parsed->theoActWHeight,
+                                       parsed->nBaseFeatures,
+                                       parsed->nExtraFeatures
+                                       ));
 
     //Setup Heads classifier
-    sctInputHeads = new classifierInput(classDataHeads,
-                                        rectangles,
-                                        parsedHeads->verbose,
-                                        parsedHeads->widthOverHeight,
-                                        parsedHeads->shrinkFactor,
-                                        parsedHeads->theoWWidth,
-                                        parsedHeads->theoWHeight,
-                                        parsedHeads->theoActWWidth,
-                                        parsedHeads->theoActWHeight,
-                                        parsedHeads->nBaseFeatures,
-                                        parsedHeads->nExtraFeatures
-                                        );
+    sctInputHeads.reset(new classifierInput(model->classDataHeads.get(),
+                                            model->rectangles.get(),
+                                            parsedHeads->verbose,
+                                            parsedHeads->widthOverHeight,
+                                            parsedHeads->shrinkFactor,
+                                            parsedHeads->theoWWidth,
+                                            parsedHeads->theoWHeight,
+                                            parsedHeads->theoActWWidth,
+                                            parsedHeads->theoActWHeight,
+                                            parsedHeads->nBaseFeatures,
+                                            parsedHeads->nExtraFeatures
+                                            ));
 
 
     //padding
-    delete [] (pInput->pad);
-    pInput->pad = new int[2];
     pInput->pad[0] = sctInput->theoreticalVerticalPadding;
     pInput->pad[1] = sctInput->theoreticalHorizontalPadding;
 
+    if(runsHeads())
+        sctInputHeads->verticalSuperPadding=12;
+
     boundingBoxes = NULL;
     headBoundingBoxes = NULL;
 }
 
 
 pedestrianDetector::~pedestrianDetector(){
+}
 
-    delete(rectangles);
-    delete(classData);
-    delete(sctInput);
-    delete(pInput);
-    delete(parsed);
-
-
-    delete(parsedHeads);
-    delete(classDataHeads);
-    delete(sctInputHeads);
-
-    if(headBoundingBoxes != NULL)
-        delete(headBoundingBoxes);
-
-    if(boundingBoxes != NULL)
-        delete(boundingBoxes);
+bool pedestrianDetector::runsPedestrians() const
+{
+    return detectorType.compare("pedestrian") == 0 ||
+            detectorType.compare("full") == 0;
+}
 
+bool pedestrianDetector::runsHeads() const
+{
+    return detectorType.compare("headandshoulders") == 0 ||
+            detectorType.compare("full") == 0;
 }
 
 void pedestrianDetector::runDetector(const Mat img_original){
 
-    if(headBoundingBoxes != NULL)
-        delete(headBoundingBoxes);
-
-    if(boundingBoxes != NULL)
-        delete(boundingBoxes);
+    boundingBoxes = runsPedestrians() ? &pedestrians : NULL;
+    headBoundingBoxes = runsHeads() ? &heads : NULL;
 
-    // These are helper variables
-    Mat image, imagef, imageO = img_original;
+    if(!computePyramid(img_original, 1, pyramid, pedestrians, heads))
+    {
+        boundingBoxes = &pedestrians;
+        headBoundingBoxes = &heads;
+        return;
+    }
 
+    scanPyramid(pyramid, 1, pedestrians, heads);
+}
 
+bool pedestrianDetector::computePyramid(const Mat &img_original,
+                                        int scanStride,
+                                        pyrOutput &pyramid,
+                                        vector<DetectionWithScore> &pedestrians,
+                                        vector<DetectionWithScore> &heads){
 
-    /*
-   * Converts Image to RGB
-   * TODO :: This must be remade as image may\may not be in BGR
-   */
-    cvtColor(imageO, image, CV_BGR2RGB);
-    image.convertTo(imagef, CV_32FC3, 1/255.0, 0);
+    // These are helper variables
+    Mat imageO = img_original;
 
     /*
    * Initialize image properties (misalign - controls memory mis-alignment)
    */
-    const int h=imagef.size[0], w=imagef.size[1], misalign=1;
-    int c = image.channels();
+    const int h=imageO.rows, w=imageO.cols, misalign=1;
+    int c = imageO.channels();
 
     /*
-   * Converts Mat image to float*
+   * Converts Mat image to float* (RGB in [0,1])
+   * TODO :: This must be remade as image may\may not be in BGR
    */
     float *img;
-    img = convertFromMat(imagef, h, w, c, misalign);
+    if(pInput->layout == rowMajor)
+    {
+        img = convertFromMatRowMajor(imageO, misalign);
+    }else
+    {
+        Mat image, imagef;
+        cvtColor(imageO, image, CV_BGR2RGB);
+        image.convertTo(imagef, CV_32FC3, 1/255.0, 0);
+        img = convertFromMat(imagef, h, w, c, misalign);
+    }
 
     /*
    * Prepares Pyramid Input
    */
-    int *sz = new int[3];
-
-    sz[0] = h;
-    sz[1] = w;
-    sz[2] = c;
-
     // Image Size
-    delete [] (pInput->sz);
-    pInput->sz = sz;
+    pInput->sz[0] = h;
+    pInput->sz[1] = w;
+    pInput->sz[2] = c;
 
     // Minimum Dimensions
-    delete [] (pInput->minDs);
-    int *minDs = new int[2];
-
-    minDs[0] = parsed->minH;
-    minDs[1] = parsed->minW;
+    pInput->minDs[0] = parsed->minH;
+    pInput->minDs[1] = parsed->minW;
 
-    pInput->minDs = minDs;
+    pedestrians.clear();
+    heads.clear();
 
+    /*
+   * Tiled mode: the real scales are computed in bands and every scale is
+   * scanned as soon as it is ready, so only a few scales are ever alive
+   */
+    if(pInput->bandHeight > 0)
+    {
+        pyramid.clear();
+
+        sctScaleScanner scanner(scanStride);
+        if(runsPedestrians())
+            scanner.addClassifier(sctInput.get());
+        if(runsHeads())
+            scanner.addClassifier(sctInputHeads.get());
+
+        bool ok = chnsPyramid(img, pInput.get(), &scanner);
+        wrFree(img-misalign);
+
+        if(!ok)
+            return false;
+
+        int k = 0;
+        if(runsPedestrians())
+            scanner.detections(k++, pedestrians);
+        if(runsHeads())
+            scanner.detections(k++, heads);
+        return true;
+    }
 
     /*
-   * Calculate Pyramids
+   * Calculate Pyramids, in the buffers of the last pyramid given
    */
-    pyrOutput *pOutput = chnsPyramid(img, pInput); // DEFICIENTE
+    bool ok = chnsPyramid(img, pInput.get(), pyramid);
 
     /*
    * Free img memory
    */
     wrFree(img-misalign);
 
+    return ok;
+}
+
+void pedestrianDetector::scanPyramid(const pyrOutput &pyramid,
+                                     int scanStride,
+                                     vector<DetectionWithScore> &pedestrians,
+                                     vector<DetectionWithScore> &heads){
+
+    // Already scanned by computePyramid
+    if(pyramid.nScales == 0)
+        return;
 
     /*
    * Running the detector
    */
-    vector<DetectionWithScore>* det = NULL;
-    vector<DetectionWithScore>* detHeads = NULL;
-
-
-    if(detectorType.compare("pedestrian") == 0 || detectorType.compare("full") == 0)
-    {
-        det = sctRun(pOutput, sctInput);
-    }
-
-    if(detectorType.compare("headandshoulders") == 0 || detectorType.compare("full") == 0)
-    {
-        sctInputHeads->verticalSuperPadding=12;
-        detHeads = sctRun(pOutput, sctInputHeads);
-    }
+    if(runsPedestrians())
+        sctRun(pyramid, sctInput.get(), scanStride, pedestrians);
 
-    delete pOutput;
-    boundingBoxes = det;
-    headBoundingBoxes = detHeads;
+    if(runsHeads())
+        sctRun(pyramid, sctInputHeads.get(), scanStride, heads);
 }
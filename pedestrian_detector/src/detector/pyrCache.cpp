@@ -0,0 +1,233 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/pyrCache.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+pyrChannelCache::pyrChannelCache() :
+    maskTile(16),
+    threshold(0.01f),
+    maxShift(0.5f),
+    maxAge(30),
+    height(0),
+    width(0),
+    tilesX(0),
+    tilesY(0),
+    nTypes(0),
+    shifted(false) {}
+
+pyrChannelCache::~pyrChannelCache()
+{
+    freeAll();
+}
+
+void pyrChannelCache::freeAll()
+{
+    real.clear();
+    age.clear();
+    finished.clear();
+    lambdas.clear();
+}
+
+void pyrChannelCache::clear()
+{
+    freeAll();
+    plan.reset();
+    previous.clear();
+    external.clear();
+}
+
+void pyrChannelCache::setChangeMask(const vector<unsigned char> &mask)
+{
+    external = mask;
+}
+
+void pyrChannelCache::setEgoShift(float dx, float dy)
+{
+    if (sqrt(dx*dx + dy*dy) > maxShift)
+        shifted = true;
+}
+
+void pyrChannelCache::beginFrame(const float *I, int _height, int _width,
+                                 int channels,
+                                 const shared_ptr<const scalePlan> &_plan)
+{
+    // Another resolution or other parameters, nothing can be reused
+    if (_plan != plan){
+        clear();
+        plan = _plan;
+        height = _height;
+        width = _width;
+        tilesX = (width + maskTile - 1) / maskTile;
+        tilesY = (height + maskTile - 1) / maskTile;
+
+        real.resize(plan->isR.size());
+        age.resize(plan->isR.size());
+        for (size_t it = 0; it < plan->isR.size(); it++)
+            age[it].assign(plan->bands[it].size() * plan->tiles[it].size(), -1);
+        finished.assign(plan->nScales, pyrScalePtr());
+    }
+
+    counters.frames++;
+
+    for (size_t it = 0; it < age.size(); it++)
+        for (size_t k = 0; k < age[it].size(); k++)
+            if (age[it][k] >= 0)
+                age[it][k]++;
+
+    /*
+     * Change mask: the frame difference, unless one was given
+     */
+    int n = height*width;
+    vector<unsigned char> current(n*channels);
+    for (int i = 0; i < n*channels; i++)
+        current[i] = (unsigned char) max(0.f, min(255.f, I[i]*255.f + .5f));
+
+    changed.assign(tilesX*tilesY, 1);
+
+    if (shifted || previous.size() != current.size()){
+        // everything changed
+    }else if (external.size() == changed.size()){
+        changed = external;
+    }else{
+        vector<int> diff(tilesX*tilesY, 0);
+        bool rowMajorLayout = plan->key.layout == rowMajor;
+
+        // Planes are w columns of h rows (colMajor) or h rows of w columns
+        int outer = rowMajorLayout ? height : width;
+        int inner = rowMajorLayout ? width : height;
+
+        for (int c = 0; c < channels; c++)
+            for (int o = 0; o < outer; o++){
+                const unsigned char *a = &current[c*n + o*inner];
+                const unsigned char *b = &previous[c*n + o*inner];
+                int *d = rowMajorLayout ? &diff[(o / maskTile)*tilesX] :
+                                          &diff[o / maskTile];
+                int step = rowMajorLayout ? 1 : tilesX;
+
+                for (int i = 0; i < inner; i++)
+                    d[(i / maskTile)*step] += abs(a[i] - b[i]);
+            }
+
+        for (int ty = 0; ty < tilesY; ty++)
+            for (int tx = 0; tx < tilesX; tx++){
+                int th = min(height, (ty + 1)*maskTile) - ty*maskTile;
+                int tw = min(width, (tx + 1)*maskTile) - tx*maskTile;
+                float mean = diff[ty*tilesX + tx] /
+                        (255.f * th * tw * channels);
+                changed[ty*tilesX + tx] = mean > threshold;
+            }
+    }
+
+    previous.swap(current);
+    external.clear();
+    shifted = false;
+}
+
+bool pyrChannelCache::tileReusable(int it, int b, int t) const
+{
+    if (real.empty() || !real[it])
+        return false;
+
+    int nTiles = plan->tiles[it].size();
+    int a = age[it][b*nTiles + t];
+    if (a < 0 || a >= maxAge)
+        return false;
+
+    // Frame pixels the tile is computed from, with room for the resampling
+    const pyrBand &band = plan->bands[it][b];
+    const pyrTile &tile = plan->tiles[it][t];
+    float fy = (float) height / plan->imgHeight[it];
+    float fx = (float) width / plan->imgWidth[it];
+    int pad = 2 * (int) ceil(max(fx, fy)) + 2;
+
+    int y0 = max(0, (int) floor(band.e0 * fy) - pad);
+    int y1 = min(height, (int) ceil(band.e1 * fy) + pad);
+    int x0 = max(0, (int) floor(tile.e0 * fx) - pad);
+    int x1 = min(width, (int) ceil(tile.e1 * fx) + pad);
+
+    for (int ty = y0 / maskTile; ty <= (y1 - 1) / maskTile; ty++)
+        for (int tx = x0 / maskTile; tx <= (x1 - 1) / maskTile; tx++)
+            if (changed[ty*tilesX + tx])
+                return false;
+
+    return true;
+}
+
+bool pyrChannelCache::groupReusable(int it, const float *_lambdas) const
+{
+    if (real.empty() || !real[it])
+        return false;
+
+    // The approximated scales also depend on the lambdas
+    if (_lambdas == NULL ? !lambdas.empty() :
+            (lambdas.empty() || !equal(lambdas.begin(), lambdas.end(),
+                                       _lambdas)))
+        return false;
+
+    int iR = plan->isR[it];
+    for (int i = 0; i < plan->nScales; i++)
+        if (plan->isN[i] == iR && !finished[i])
+            return false;
+
+    for (size_t b = 0; b < plan->bands[it].size(); b++)
+        for (size_t t = 0; t < plan->tiles[it].size(); t++)
+            if (!tileReusable(it, b, t))
+                return false;
+
+    return true;
+}
+
+const pyrScale* pyrChannelCache::realChannels(int it) const
+{
+    return real.empty() ? NULL : real[it].get();
+}
+
+pyrScalePtr pyrChannelCache::finishedChannels(int i) const
+{
+    return finished.empty() ? pyrScalePtr() : finished[i];
+}
+
+void pyrChannelCache::tileComputed(int it, int b, int t)
+{
+    // The first time, spread the refreshes of the tiles over maxAge frames
+    int k = b*plan->tiles[it].size() + t;
+    age[it][k] = (age[it][k] < 0) ? (it*7 + k*3) % max(maxAge, 1) : 0;
+}
+
+void pyrChannelCache::countTiles(int n, int reused)
+{
+    counters.tiles += n;
+    counters.tilesReused += reused;
+}
+
+void pyrChannelCache::countScale(bool reused)
+{
+    counters.scales++;
+    if (reused)
+        counters.scalesReused++;
+}
+
+void pyrChannelCache::storeReal(int it, unique_ptr<pyrScale> chns)
+{
+    nTypes = chns->nTypes();
+    real[it] = move(chns);
+}
+
+void pyrChannelCache::storeFinished(int i, const pyrScalePtr &chns,
+                                    const float *_lambdas)
+{
+    nTypes = chns->nTypes();
+    finished[i] = chns;
+
+    if (_lambdas == NULL)
+        lambdas.clear();
+    else
+        lambdas.assign(_lambdas, _lambdas + nTypes);
+}
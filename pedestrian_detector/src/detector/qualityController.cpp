@@ -0,0 +1,52 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/qualityController.hpp"
+#include <algorithm>
+
+using namespace std;
+
+qualityController::qualityController(int nPerOct) :
+    budgetMs(0),
+    lowerRatio(0.6f),
+    holdFrames(10),
+    current(0),
+    sinceChange(0)
+{
+    int fewer = min(nPerOct, max(nPerOct*3/4, 1));
+    int fewest = min(nPerOct, 4);
+
+    levels.push_back(qualityLevel(1.f, nPerOct, 1));
+    levels.push_back(qualityLevel(1.f, fewer, 1));
+    levels.push_back(qualityLevel(1.f, fewest, 2));
+    levels.push_back(qualityLevel(.75f, fewest, 2));
+    levels.push_back(qualityLevel(.5f, fewest, 2));
+}
+
+bool qualityController::update(float averageMs)
+{
+    if (budgetMs <= 0){
+        bool changed = current != 0;
+        current = 0;
+        return changed;
+    }
+
+    if (++sinceChange < holdFrames)
+        return false;
+
+    int next = current;
+    if (averageMs > budgetMs)
+        next = min(current + 1, (int) levels.size() - 1);
+    else if (averageMs < budgetMs*lowerRatio)
+        next = max(current - 1, 0);
+
+    if (next == current)
+        return false;
+
+    current = next;
+    sinceChange = 0;
+    return true;
+}
@@ -0,0 +1,214 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/scalePlan.hpp"
+#include "../include/detector/chnsCompute.hpp"
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+bool scaleKey::operator<(const scaleKey &other) const
+{
+    const int a[] = { height, width, nPerOct, nOctUp, nApprox, minDs[0],
+                      minDs[1], shrink, pad[0], pad[1], layout, bandHeight,
+                      bandMargin, tileWidth };
+    const int b[] = { other.height, other.width, other.nPerOct, other.nOctUp,
+                      other.nApprox, other.minDs[0], other.minDs[1],
+                      other.shrink, other.pad[0], other.pad[1], other.layout,
+                      other.bandHeight, other.bandMargin, other.tileWidth };
+
+    return lexicographical_compare(a, a + 14, b, b + 14);
+}
+
+scalePlan::scalePlan(const scaleKey &_key) : key(_key)
+{
+    int height = key.height, width = key.width, shrink = key.shrink;
+
+    /*
+     * Scales (see getScales)
+     */
+    int sz[3] = { height, width, 3 };
+    int minDs[2] = { key.minDs[0], key.minDs[1] };
+    float *s = 0, *shw = 0;
+
+    nScales = getScales(s, shw, key.nPerOct, key.nOctUp, minDs, shrink, sz);
+    scales.assign(s, s + nScales);
+    scaleshw.assign(shw, shw + 2*nScales);
+    delete [] s;
+    delete [] shw;
+
+    /*
+     * Real and approximated scales. As in chnsPyramid() the real scales start
+     * at the first one (Dollar starts at nOctUp*nPerOct).
+     */
+    for (int i = 0; i < nScales; i += key.nApprox + 1)
+        isR.push_back(i);
+
+    for (int i = 0, j = 0; i < nScales; i++){
+        if (j < (int)isR.size() && isR[j] == i)
+            j++;
+        else
+            isA.push_back(i);
+    }
+
+    // Every scale uses the real scale closest to it
+    isN.resize(nScales);
+    int nReal = isR.size();
+    for (int i = 0; i < nReal; i++){
+        int minJ = (i == 0) ? 0 : (isR[i-1] + 1 + isR[i] + 1) / 2;
+        int maxJ = (i == nReal-1) ? nScales : (isR[i] + 1 + isR[i+1] + 1) / 2;
+
+        for (int j = minJ; j < maxJ; j++)
+            isN[j] = isR[i];
+    }
+
+    /*
+     * Sizes
+     */
+    chnHeight.resize(nScales);
+    chnWidth.resize(nScales);
+    padHeight.resize(nScales);
+    padWidth.resize(nScales);
+
+    for (int i = 0; i < nScales; i++){
+        chnHeight[i] = round((float) height * (float) scales[i] / (float) shrink);
+        chnWidth[i] = round((float) width * (float) scales[i] / (float) shrink);
+        padHeight[i] = chnHeight[i] + 2 * (key.pad[0] / shrink);
+        padWidth[i] = chnWidth[i] + 2 * (key.pad[1] / shrink);
+    }
+
+    // The source image is replaced by the half size one (see chnsPyramid)
+    int srcH = height, srcW = width;
+    for (int it = 0; it < nReal; it++){
+        int i = isR[it];
+        int newHeight = chnHeight[i] * shrink;
+        int newWidth = chnWidth[i] * shrink;
+
+        imgHeight.push_back(newHeight);
+        imgWidth.push_back(newWidth);
+        srcHeight.push_back(srcH);
+        srcWidth.push_back(srcW);
+
+        if (srcH != newHeight || srcW != newWidth)
+            addResample(srcH, newHeight, srcW, newWidth);
+
+        // Bands start at multiples of bandHeight (rounded up to the shrink),
+        // so the shrunk rows of every band line up with the whole image
+        int band = (key.bandHeight + shrink - 1) / shrink * shrink;
+        if (band <= 0 || band >= newHeight)
+            band = newHeight;
+
+        bands.push_back(vector<pyrBand>());
+        for (int y0 = 0; y0 < newHeight; y0 += band){
+            pyrBand b;
+            b.y0 = y0;
+            b.y1 = min(newHeight, y0 + band);
+            b.e0 = (band == newHeight) ? 0 : max(0, y0 - key.bandMargin);
+            b.e1 = (band == newHeight) ? newHeight :
+                                         min(newHeight, b.y1 + key.bandMargin);
+            bands.back().push_back(b);
+
+            if (shrink > 1)
+                addResample(b.e1 - b.e0, (b.e1 - b.e0) / shrink, newWidth,
+                            chnWidth[i]);
+        }
+
+        // Tiles split the bands in columns the same way
+        int tile = (key.tileWidth + shrink - 1) / shrink * shrink;
+        if (tile <= 0 || tile >= newWidth)
+            tile = newWidth;
+
+        tiles.push_back(vector<pyrTile>());
+        for (int x0 = 0; x0 < newWidth; x0 += tile){
+            pyrTile t;
+            t.x0 = x0;
+            t.x1 = min(newWidth, x0 + tile);
+            t.e0 = (tile == newWidth) ? 0 : max(0, x0 - key.bandMargin);
+            t.e1 = (tile == newWidth) ? newWidth :
+                                        min(newWidth, t.x1 + key.bandMargin);
+            tiles.back().push_back(t);
+
+            if (shrink > 1 && tile < newWidth)
+                for (size_t k = 0; k < bands.back().size(); k++){
+                    const pyrBand &b = bands.back()[k];
+                    addResample(b.e1 - b.e0, (b.e1 - b.e0) / shrink,
+                                t.e1 - t.e0, (t.e1 - t.e0) / shrink);
+                }
+        }
+
+        bool replaces = scales[i] == 0.5f &&
+                (key.nApprox > 0 || key.nPerOct == 1);
+        replacesSource.push_back(replaces);
+        if (replaces){
+            srcH = newHeight;
+            srcW = newWidth;
+        }
+    }
+
+    for (size_t it = 0; it < isA.size(); it++){
+        int i = isA[it], iR = isN[i];
+        addResample(chnHeight[iR], chnHeight[i], chnWidth[iR], chnWidth[i]);
+    }
+
+    /*
+     * Real scales used to estimate lambdas (see chnsPyramid)
+     */
+    vector<int> isTemp;
+    for (int i = key.nOctUp*key.nPerOct; i < nScales; i += key.nApprox + 1)
+        isTemp.push_back(i);
+
+    // They also have to be real scales of this plan (isR starts at 0)
+    if (isTemp.size() > 2 && isTemp[1] % (key.nApprox + 1) == 0){
+        lambdaScales[0] = isTemp[1];
+        lambdaScales[1] = isTemp[2];
+    }else{
+        lambdaScales[0] = -1;
+        lambdaScales[1] = -1;
+    }
+}
+
+void scalePlan::addResample(int ha, int hb, int wa, int wb)
+{
+    // The kernels resample along the contiguous dimension with pad 4
+    int hPad = (key.layout == rowMajor) ? 0 : 4;
+    int wPad = (key.layout == rowMajor) ? 4 : 0;
+
+    if (hCoefs.find(make_pair(ha, hb)) == hCoefs.end())
+        hCoefs[make_pair(ha, hb)].reset(new resampleCoefs<float>(ha, hb, hPad));
+
+    if (wCoefs.find(make_pair(wa, wb)) == wCoefs.end())
+        wCoefs[make_pair(wa, wb)].reset(new resampleCoefs<float>(wa, wb, wPad));
+}
+
+const resampleCoefs<float>& scalePlan::heightCoefs(int na, int nb) const
+{
+    return *hCoefs.find(make_pair(na, nb))->second;
+}
+
+const resampleCoefs<float>& scalePlan::widthCoefs(int na, int nb) const
+{
+    return *wCoefs.find(make_pair(na, nb))->second;
+}
+
+shared_ptr<const scalePlan> scalePlan::get(const scaleKey &key)
+{
+    // Only a handful of keys are ever used (one per camera resolution and
+    // parameter set), so plans are never evicted
+    static mutex plansMutex;
+    static map< scaleKey, shared_ptr<const scalePlan> > plans;
+
+    lock_guard<mutex> lock(plansMutex);
+
+    map< scaleKey, shared_ptr<const scalePlan> >::iterator it = plans.find(key);
+    if (it != plans.end())
+        return it->second;
+
+    shared_ptr<const scalePlan> plan(new scalePlan(key));
+    plans[key] = plan;
+
+    return plan;
+}
@@ -0,0 +1,98 @@
+/*******************************************************************************
+* Pedestrian Detector v0.3
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include "../include/detector/stagePool.hpp"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+stagePool::stagePool() :
+    running(false),
+    nextRound(0),
+    notifications(0) {}
+
+stagePool::~stagePool()
+{
+    stop();
+}
+
+void stagePool::add(const task &t)
+{
+    unique_ptr<entry> e(new entry());
+    e->run = t;
+    e->busy.store(false);
+    entries.push_back(move(e));
+}
+
+void stagePool::start(int nThreads, int niceness)
+{
+    if (running.load() || entries.empty())
+        return;
+
+    running = true;
+    for (int k = 0; k < max(nThreads, 1); k++)
+        workers.push_back(thread(&stagePool::loop, this, niceness));
+}
+
+void stagePool::stop()
+{
+    {
+        lock_guard<mutex> guard(sleeping);
+        running = false;
+    }
+    wakeup.notify_all();
+    for (size_t k = 0; k < workers.size(); k++)
+        workers[k].join();
+    workers.clear();
+}
+
+void stagePool::notify()
+{
+    {
+        lock_guard<mutex> guard(sleeping);
+        notifications++;
+    }
+    wakeup.notify_one();
+}
+
+bool stagePool::runOne()
+{
+    size_t n = entries.size();
+    size_t first = nextRound.fetch_add(1, memory_order_relaxed);
+
+    for (size_t k = 0; k < n; k++){
+        entry &e = *entries[(first + k) % n];
+        if (e.busy.exchange(true, memory_order_acquire))
+            continue;
+
+        bool worked = e.run();
+        e.busy.store(false, memory_order_release);
+
+        if (worked)
+            return true;
+    }
+    return false;
+}
+
+void stagePool::loop(int niceness)
+{
+    if (niceness > 0)
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), niceness);
+
+    while (running.load()){
+        unsigned long seen = notifications.load();
+        if (runOne())
+            continue;
+
+        // Work handed over after seen was read may have been missed by
+        // runOne, but then notifications changed
+        unique_lock<mutex> guard(sleeping);
+        while (running.load() && notifications.load() == seen)
+            wakeup.wait(guard);
+    }
+}
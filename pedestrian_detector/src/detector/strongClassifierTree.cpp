@@ -24,8 +24,8 @@ int nWeakClassifiers = 0;
 /*
  * Classifier Input constructor
  */
-classifierInput::classifierInput(ClassData *classifier,
-                                 ClassRectangles *rect,
+classifierInput::classifierInput(const ClassData *classifier,
+                                 const ClassRectangles *rect,
                                  bool _verbose,
                                  float _widthOverHeight,
                                  int _shrinkFactor,
@@ -90,18 +90,6 @@ classifierInput::classifierInput(ClassData *classifier,
 }
 
 
-/*
- * Detection Structure for output
- */
-struct Detection
-{
-    double U0;
-    double V0;
-    double U1;
-    double V1;
-    double confidence;
-};
-
 /*
  * Function to compare Detections
  */
@@ -163,24 +151,20 @@ int directionNotSat(int row){
 
 
 /*
- * Strong Classifier Tree (sct)
+ * Runs the cascade on every window of one scale, given all its channels
  */
-vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput)
+void sctScanScale(const chnView &currentScaleData, int scaleId, float scale,
+                  classifierInput *cInput, int scanStride,
+                  list<Detection> &detections)
 {
 	int (*featureLUT)[3]=cInput->featureLUT;
-    /*
-     * Input explicit variables declaration
-     */
-    imgWrap ***pyrData = outputPyr->chnsPerScale;
-
     bool verbose = cInput->verbose;
 
-    classifierData = cInput->classData->classifiers;
-    
-    nWeakClassifiers = cInput->nWeakClassifiers;
+    // Locals, not the globals, so several threads can scan at once
+    const double *classifierData = cInput->classData->classifiers;
+    int nWeakClassifiers = cInput->nWeakClassifiers;
     int nFeatures = cInput->nFeatures;
     int nClassifiers = cInput->nClassifiers;
-    int nBaseFeatures = cInput->nBaseFeatures;
     
     int windowWidth = cInput->windowWidth;
     int windowHeight = cInput->windowHeight;
@@ -188,73 +172,57 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
     float theoreticalActiveWindowHeight = cInput->theoreticalActiveWindowHeight;
     int horizontalSuperPadding = cInput->horizontalSuperPadding;
     int verticalSuperPadding = cInput->verticalSuperPadding;
+    int shrinkFactor = cInput->shrinkFactor;
 
-    int nScales = outputPyr->nScales;
-    int nChannels = outputPyr->nChannels;
-    float *scales = outputPyr->scales;
-
-
-    /*
-     * Variables declaration
-     */
     int row = 0;
     int col = 0;
-    int scaleId = -1;
     int classifierId = -1;
-    int nDetections = 0;
-    float *data;
-    int nRows;
-    int nCols;
-    imgWrap *currentScaleData;
-
-
-    //DEBUG
-    if(verbose){
-	cout<<"**********************************************************"<<endl;
-	cout<<"Initialization:"<<endl;
-	cout<<"nFeatures      = "<<nFeatures   <<endl;
-	cout<<"nScales        = "<<nScales     <<endl;
-	cout<<"windowWidth    = "<<windowWidth <<endl;
-	cout<<"windowHeight   = "<<windowHeight<<endl;
-	cout<<"theoreticalActiveWindowWidth  = "<<theoreticalActiveWindowWidth<<endl;
-	cout<<"theoreticalActiveWindowHeight = "<<theoreticalActiveWindowHeight<<endl;
-	cout<<"windowHorizontalPadding  = "<<cInput->windowHorizontalPadding<<endl;
-	cout<<"windowVerticalPadding = "<<cInput->windowVerticalPadding<<endl;
-	cout<<"nClassifiers   = "<< nClassifiers<<endl;
-	cout<<"**********************************************************"<<endl;
-    }
-
-    //Detections to ouput
-    list<Detection> detections;
     Detection currentDetection;
 
-    /*
-     * Begin cycling through all the scales and running the detector on them.
-     */
-    
-    for(scaleId=0; scaleId<nScales; scaleId++){
-	//For all scales
 	//Get size of the images for this size and the pointer to the data
-
-	//All the channels are concatenated we get the first and only imgWrap.
-	currentScaleData = pyrData[scaleId][0];
-	data = currentScaleData->image; //Get the pointer the data
-	nRows = currentScaleData->height;
-	nCols = currentScaleData->width;
+	float *data = currentScaleData.data; //Get the pointer the data
+	int nRows = currentScaleData.height;
+	int nCols = currentScaleData.width;
 	
 
 	//Only detect when the image is bigger than the detection window
     if((nRows < windowHeight) || (nCols < windowWidth))
-	    continue; //skip this size: it's too small to use our detector
+	    return; //skip this size: it's too small to use our detector
 
 	//*************************************
 	// 1. Run the soft cascade on the data
 	//*************************************
-	
-	
+
+	// Offsets of every feature from the top left corner of the window, for
+	// the layout of this scale. Windows are scanned along the contiguous
+	// direction of the planes.
+	bool rowMajorScale = (currentScaleData.layout == rowMajor);
+	int rowStride = rowMajorScale ? nCols : 1;
+	int colStride = rowMajorScale ? 1 : nRows;
+
+	vector<int> featureOffsets(nFeatures);
+	for(int featureId = 0; featureId < nFeatures; featureId++)
+	    featureOffsets[featureId] = featureLUT[featureId][0]*nRows*nCols +
+		    featureLUT[featureId][2]*rowStride +
+		    featureLUT[featureId][1]*colStride;
+
+	int nOuter = rowMajorScale ? (nRows - windowHeight) : (nCols - windowWidth);
+	int nInner = rowMajorScale ? (nCols - windowWidth) : (nRows - windowHeight);
+
+	int stride = max(scanStride, 1);
+
 	double weakClass = 0;
-	for (col = 0; col<(nCols - windowWidth); col++ ){
-	    for (row = 0; row<(nRows - windowHeight); row++ ){
+	for (int outer = 0; outer<nOuter; outer += stride ){
+	    for (int inner = 0; inner<nInner; inner += stride ){
+		if(rowMajorScale){
+		    row = outer;
+		    col = inner;
+		}else{
+		    col = outer;
+		    row = inner;
+		}
+		const float *window = data + row*rowStride + col*colStride;
+
 		//Run the detector on this window
 		double confidence = 0;
 		for (classifierId = 0; classifierId<nClassifiers; classifierId++){
@@ -266,16 +234,8 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 		    double thresholdValue = classifierData[classifierId*nWeakClassifiers+ 2];
 		    double directionValue = classifierData[classifierId*nWeakClassifiers+ 3];
 		    double featureValue;
-/*		      int x, y, c;
-		      
-			  
-              c = cInput->featureLUT[featureId][0];
-              x = cInput->featureLUT[featureId][1];
-              y = cInput->featureLUT[featureId][2];*/
 
-              
-              featureValue = data[featureLUT[featureId][0]*nRows*nCols+(row+featureLUT[featureId][2])+(col+featureLUT[featureId][1])*nRows]; //acf -> pixel lookup at a scale
-			  
+		    featureValue = window[featureOffsets[featureId]]; //acf -> pixel lookup at a scale
 
 		        if( (featureValue - thresholdValue) * directionValue >=0 ){
 			    // 2. Satisfy leaf
@@ -285,13 +245,7 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 			    double directionValueSat = classifierData[classifierId*nWeakClassifiers+ 7];
 			    double featureValueSat;
 
- /*               int x, y, c;
-				c = cInput->featureLUT[featureIdSat][0];
-				x = cInput->featureLUT[featureIdSat][1];
-				y = cInput->featureLUT[featureIdSat][2];*/
-              
-                featureValueSat = data[featureLUT[featureIdSat][0]*nRows*nCols+(row+featureLUT[featureIdSat][2])+(col+featureLUT[featureIdSat][1])*nRows]; //acf -> pixel lookup at a scale 
-				
+			    featureValueSat = window[featureOffsets[featureIdSat]]; //acf -> pixel lookup at a scale
 
 			    if( (featureValueSat - thresholdValueSat) * directionValueSat >=0 )
 			        weakClass =  1;
@@ -304,13 +258,8 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 			double thresholdValueNotSat = classifierData[classifierId*nWeakClassifiers+ 10];
 			double directionValueNotSat = classifierData[classifierId*nWeakClassifiers+ 11];
 			double featureValueNotSat;
- /*
-			int x, y, c;
-			c = featureLUT[featureIdNotSat][0];
-			x = featureLUT[featureIdNotSat][1];
-			y = featureLUT[featureIdNotSat][2];
-            */
-            featureValueNotSat =  data[featureLUT[featureIdNotSat][0]*nRows*nCols+(row+featureLUT[featureIdNotSat][2])+(col+featureLUT[featureIdNotSat][1])*nRows];
+
+			featureValueNotSat = window[featureOffsets[featureIdNotSat]];
 
 			if( (featureValueNotSat - thresholdValueNotSat) * directionValueNotSat >=0 )
 			    weakClass =  1;
@@ -326,21 +275,19 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 		} //For each classifier
 		
 		if(confidence>0){
-		    nDetections++;
-
 		    //Pre - BMVC
 		    //*/ col and row are the coordinates in the shrinked, padded image
-		    double V0 = ( (double)(row) *4  - verticalSuperPadding) / scales[scaleId] ; //both window and image are padded: this takes care of itself, I don't have to bother
-		    double U0 = ( (double)(col) *4  - horizontalSuperPadding) / scales[scaleId] ; //both window and image are padded: this takes care of itself, I don't have to bother
-		    double V1 = V0 + ( theoreticalActiveWindowHeight/ scales[scaleId] );
-		    double U1 = U0 + ( theoreticalActiveWindowWidth  / scales[scaleId] );
+		    double V0 = ( (double)(row) *shrinkFactor  - verticalSuperPadding) / scale ; //both window and image are padded: this takes care of itself, I don't have to bother
+		    double U0 = ( (double)(col) *shrinkFactor  - horizontalSuperPadding) / scale ; //both window and image are padded: this takes care of itself, I don't have to bother
+		    double V1 = V0 + ( theoreticalActiveWindowHeight/ scale );
+		    double U1 = U0 + ( theoreticalActiveWindowWidth  / scale );
 		    //detections(nDetections,:) = [V0,U0,V1,U1,confidence];
 		    //*/
             
 		    if(verbose)
 			printf("Detection #%d. Scale = %d, scaling = %f, "
 			    "Col = %d, Row = %d, U0 = %f, V0 = %f\n",
-			    nDetections, scaleId, scales[scaleId],
+			    (int) detections.size() + 1, scaleId, scale,
 			    col, row, U0, V0
 			    );
 
@@ -353,12 +300,76 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 		    detections.push_back(currentDetection);
 
 		} //else do nothing, discard the window
-	    } //scan image rows
-	} //scan image columns
-	
+	    } //scan along the contiguous direction
+	} //scan across it
+}
+
+/*
+ * Strong Classifier Tree (sct)
+ */
+vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput)
+{
+    vector<DetectionWithScore> *listDetections = new vector<DetectionWithScore>();
+    sctRun(*outputPyr, cInput, 1, *listDetections);
+    return listDetections;
+}
+
+void sctRun(const pyrOutput &outputPyr, classifierInput *cInput, int scanStride,
+            vector<DetectionWithScore> &listDetections)
+{
+    /*
+     * Input explicit variables declaration
+     */
+    int nScales = outputPyr.nScales;
+    const float *scales = outputPyr.scales;
+
+
+    //DEBUG
+    if(cInput->verbose){
+	cout<<"**********************************************************"<<endl;
+	cout<<"Initialization:"<<endl;
+	cout<<"nFeatures      = "<<cInput->nFeatures   <<endl;
+	cout<<"nScales        = "<<nScales     <<endl;
+	cout<<"windowWidth    = "<<cInput->windowWidth <<endl;
+	cout<<"windowHeight   = "<<cInput->windowHeight<<endl;
+	cout<<"theoreticalActiveWindowWidth  = "<<cInput->theoreticalActiveWindowWidth<<endl;
+	cout<<"theoreticalActiveWindowHeight = "<<cInput->theoreticalActiveWindowHeight<<endl;
+	cout<<"windowHorizontalPadding  = "<<cInput->windowHorizontalPadding<<endl;
+	cout<<"windowVerticalPadding = "<<cInput->windowVerticalPadding<<endl;
+	cout<<"nClassifiers   = "<< cInput->nClassifiers<<endl;
+	cout<<"**********************************************************"<<endl;
     }
-	
-	
+
+    //Detections to ouput
+    list<Detection> detections;
+
+    /*
+     * Begin cycling through all the scales and running the detector on them.
+     */
+    for(int scaleId=0; scaleId<nScales; scaleId++)
+	sctScanScale(outputPyr.scale(scaleId), scaleId, scales[scaleId], cInput,
+		     scanStride, detections);
+
+    sctNms(detections, cInput, listDetections);
+}
+
+/*
+ * Non-maximal suppression of the detections of all scales
+ */
+vector<DetectionWithScore>* sctNms(list<Detection> &detections,
+                                   classifierInput *cInput)
+{
+    vector<DetectionWithScore> *listDetections = new vector<DetectionWithScore>();
+    sctNms(detections, cInput, *listDetections);
+    return listDetections;
+}
+
+void sctNms(list<Detection> &detections, classifierInput *cInput,
+            vector<DetectionWithScore> &listDetections)
+{
+    bool verbose = cInput->verbose;
+    int nDetections = detections.size();
+
     //*************************************
     // 2. Non-Maximal Suppression Part
     //*************************************
@@ -431,7 +442,7 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
 	}
     }
     
-    vector<DetectionWithScore> *listDetections = new vector<DetectionWithScore>();
+    listDetections.clear();
 
     list<Detection>::iterator itDetections;
 
@@ -456,7 +467,36 @@ vector<DetectionWithScore>* sctRun(pyrOutput *outputPyr, classifierInput *cInput
         DetectionWithScore det;
         det.bbox = Rect_<int>(ax, ay, aw, ah);
         det.score = itDetections->confidence;
-        listDetections->push_back(det);
+        listDetections.push_back(det);
     }
-    return listDetections;
+}
+
+void sctScaleScanner::addClassifier(classifierInput *cInput)
+{
+    inputs.push_back(cInput);
+    found.push_back(list<Detection>());
+}
+
+void sctScaleScanner::consumeScale(int scaleId, float scale,
+                                   imgWrap *const *chns)
+{
+    // The other channel types follow the first one (see pyrOutput)
+    for(size_t k = 0; k < inputs.size(); k++)
+        sctScanScale(chns[0]->view(), scaleId, scale, inputs[k], stride, found[k]);
+}
+
+vector<DetectionWithScore>* sctScaleScanner::detections(int k)
+{
+    return sctNms(found[k], inputs[k]);
+}
+
+void sctScaleScanner::detections(int k, vector<DetectionWithScore> &out)
+{
+    sctNms(found[k], inputs[k], out);
+}
+
+void sctScaleScanner::clear()
+{
+    for(size_t k = 0; k < found.size(); k++)
+        found[k].clear();
 }
@@ -0,0 +1,138 @@
+/*******************************************************************************
+* Pedestrian Detector - Assignment benchmark
+*
+* Builds the association costs of synthetic crowds (10 to 500 people walking
+* on the floor at the same density, 90% of them detected, a few false
+* detections, gated at 1000 like associateData does) and solves them with the
+* Munkres solver of the tracker (assignmentoptimal), with the Jonker-Volgenant
+* solver on the whole matrix and with the sparse one (connected components of
+* the gated pairs). Reports the time per frame of each, and checks that the
+* three of them give the same cost to the gated pairs.
+*
+* Usage: assignment_benchmark [frames] [people per square meter]
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+
+#include "../include/tracker/HungarianFunctions.hpp"
+#include "../include/tracker/assignmentSolver.hpp"
+
+using namespace std;
+
+static const double gated = 1000;
+static const double validationGate = 9;         //Squared Mahalanobis distance
+static const double detectionVar = 0.05;        //m^2
+static const double recognitionThreshold = 0.7;
+
+static double wallMs()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec*1000.0 + t.tv_usec/1000.0;
+}
+
+static double uniform()
+{
+    return rand()/(RAND_MAX+1.0);
+}
+
+static double gaussian()
+{
+    return sqrt(-2*log(1-uniform()))*cos(2*M_PI*uniform());
+}
+
+/*Costs of a frame, nDetections x nTracks, column major*/
+
+static void makeFrame(int nTracks, double density, vector<double> &costs, int &nDetections)
+{
+    double side = sqrt(nTracks/density);
+    vector<double> tx(nTracks), ty(nTracks), dx, dy;
+    for(int t = 0; t < nTracks; t++)
+    {
+        tx[t] = uniform()*side;
+        ty[t] = uniform()*side;
+        if(uniform() < 0.9)
+        {
+            dx.push_back(tx[t]+gaussian()*sqrt(detectionVar));
+            dy.push_back(ty[t]+gaussian()*sqrt(detectionVar));
+        }
+    }
+    int nFalse = nTracks/20;
+    for(int k = 0; k < nFalse; k++)
+    {
+        dx.push_back(uniform()*side);
+        dy.push_back(uniform()*side);
+    }
+
+    nDetections = dx.size();
+    costs.resize(nDetections*nTracks);
+    for(int t = 0; t < nTracks; t++)
+        for(int d = 0; d < nDetections; d++)
+        {
+            double ex = tx[t]-dx[d], ey = ty[t]-dy[d];
+            double dist = (ex*ex+ey*ey)/(2*detectionVar);
+            double colorDist = uniform();
+            costs[d+t*nDetections] = dist < validationGate && colorDist <= recognitionThreshold ? colorDist : gated;
+        }
+}
+
+static double gatedCost(const vector<double> &assignment, const vector<double> &costs, int nDetections)
+{
+    double sum = 0;
+    for(int d = 0; d < nDetections; d++)
+        if(assignment[d] >= 0 && costs[d+(int)assignment[d]*nDetections] < gated)
+            sum += costs[d+(int)assignment[d]*nDetections];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    int nFrames = argc > 1 ? atoi(argv[1]) : 20;
+    double density = argc > 2 ? atof(argv[2]) : 0.5;
+    int sizes[] = {10, 20, 50, 100, 200, 500};
+
+    srand(1);
+    AssignmentSolver solver;
+
+    printf("%d frames, %.2f people/m^2, ms per frame\n", nFrames, density);
+    printf("  tracks   munkres        jv    sparse   max |cost diff|\n");
+    for(unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+    {
+        int nTracks = sizes[s];
+        double munkresMs = 0, jvMs = 0, sparseMs = 0, worst = 0;
+
+        for(int frame = 0; frame < nFrames; frame++)
+        {
+            vector<double> costs;
+            int nDetections;
+            makeFrame(nTracks, density, costs, nDetections);
+
+            vector<double> munkres(nDetections), jv(nDetections), sparse(nDetections);
+            double munkresCost, jvCost, sparseCost;
+
+            double start = wallMs();
+            assignmentoptimal(&munkres[0], &munkresCost, &costs[0], nDetections, nTracks);
+            double mid = wallMs();
+            solver.solve(&jv[0], &jvCost, &costs[0], nDetections, nTracks);
+            double end = wallMs();
+            solver.solveSparse(&sparse[0], &sparseCost, &costs[0], nDetections, nTracks, gated);
+            sparseMs += wallMs()-end;
+            munkresMs += mid-start;
+            jvMs += end-mid;
+
+            double reference = gatedCost(munkres, costs, nDetections);
+            worst = max(worst, fabs(munkresCost-jvCost));
+            worst = max(worst, fabs(reference-gatedCost(jv, costs, nDetections)));
+            worst = max(worst, fabs(reference-sparseCost));
+        }
+
+        printf("  %6d %9.3f %9.3f %9.3f   %g\n", nTracks, munkresMs/nFrames, jvMs/nFrames, sparseMs/nFrames, worst);
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*******************************************************************************
+* Pedestrian Detector - offline benchmark
+*
+* Runs the detector over a directory of frames (by default the TUD Stadtmitte
+* sequence in matlab/dataset) once per channel layout, and once more with the
+* tiled pyramid with and without the channel cache, and reports the time per
+* frame and how well the detections of every run agree with the column-major,
+* whole image one. Then it times the BVT color features of those detections,
+* one by one (extractBVT) and in batches, with the spec of partMasks.yaml.
+*
+* Usage: detector_benchmark <package path> [image directory] [passes]
+*                           [band height]
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "../include/detector/pedestrianDetector.hpp"
+#include "../include/detector/colorFeatures.hpp"
+
+using namespace std;
+using namespace cv;
+
+static double wallMs()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec*1000.0 + t.tv_usec/1000.0;
+}
+
+static double overlap(const Rect &a, const Rect &b)
+{
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter/uni : 0;
+}
+
+struct benchmarkRun
+{
+    string name;
+    double msPerFrame;
+    vector< vector<DetectionWithScore> > detections;
+    pyrCacheStats cacheStats;
+};
+
+static benchmarkRun runConfig(const string &packagePath,
+                              const vector<Mat> &frames, int layout,
+                              int bandHeight, bool cache, int passes)
+{
+    benchmarkRun run;
+    run.name = (layout == rowMajor) ? "row-major" : "column-major";
+    if(bandHeight > 0)
+    {
+        stringstream ss;
+        ss << run.name << ", bands of " << bandHeight << " rows";
+        run.name = ss.str();
+    }
+    if(cache)
+        run.name += ", cached";
+
+    pedestrianDetector detector(packagePath + "/configuration.xml",
+                                packagePath + "/configurationheadandshoulders.xml",
+                                "pedestrian", packagePath);
+    detector.pInput->layout = layout;
+    detector.pInput->bandHeight = bandHeight;
+    if(cache)
+        detector.pInput->cache.reset(new pyrChannelCache());
+
+    // Warm up (first frame completes the pyramid parameters)
+    detector.runDetector(frames[0]);
+    if(cache)
+        detector.pInput->cache->resetStats();
+
+    double start = wallMs();
+    for(int p = 0; p < passes; p++)
+    {
+        for(size_t i = 0; i < frames.size(); i++)
+        {
+            detector.runDetector(frames[i]);
+            if(p == 0)
+                run.detections.push_back(*detector.boundingBoxes);
+        }
+    }
+    run.msPerFrame = (wallMs() - start) / (passes*frames.size());
+
+    if(cache)
+        run.cacheStats = detector.pInput->cache->stats();
+
+    return run;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        cout << "Usage: " << argv[0]
+             << " <package path> [image directory] [passes] [band height]"
+             << endl;
+        return -1;
+    }
+
+    string packagePath = argv[1];
+    string imageDir = argc > 2 ? argv[2] :
+            packagePath + "/matlab/dataset/cvpr10_tud_stadtmitte";
+    int passes = argc > 3 ? atoi(argv[3]) : 1;
+    int bandHeight = argc > 4 ? atoi(argv[4]) : 128;
+
+    vector<String> files;
+    glob(imageDir + "/*.png", files);
+
+    vector<Mat> frames;
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        Mat frame = imread(files[i]);
+        if(!frame.empty())
+            frames.push_back(frame);
+    }
+
+    if(frames.empty())
+    {
+        cout << "No frames found in " << imageDir << endl;
+        return -1;
+    }
+
+    cout << "Frames: " << frames.size() << " (" << frames[0].cols << "x"
+         << frames[0].rows << "), passes: " << passes << endl;
+
+    const int nRuns = 4;
+    benchmarkRun runs[nRuns] = {
+        runConfig(packagePath, frames, colMajor, 0, false, passes),
+        runConfig(packagePath, frames, rowMajor, 0, false, passes),
+        runConfig(packagePath, frames, colMajor, bandHeight, false, passes),
+        runConfig(packagePath, frames, colMajor, bandHeight, true, passes) };
+
+    for(int r = 0; r < nRuns; r++)
+    {
+        cout << runs[r].name << ": " << runs[r].msPerFrame << " ms/frame ("
+             << 1000.0/runs[r].msPerFrame << " fps)" << endl;
+
+        if(runs[r].cacheStats.frames > 0)
+            cout << "  reused " << 100*runs[r].cacheStats.tileReuse()
+                 << "% of the tiles and " << 100*runs[r].cacheStats.scaleReuse()
+                 << "% of the scales" << endl;
+    }
+
+    // Agreement with the first run: greedy matching at 0.9 IoU
+    for(int r = 1; r < nRuns; r++)
+    {
+        int matched = 0, onlyRef = 0, onlyRun = 0;
+        double maxScoreDiff = 0;
+        for(size_t i = 0; i < frames.size(); i++)
+        {
+            const vector<DetectionWithScore> &a = runs[0].detections[i];
+            const vector<DetectionWithScore> &b = runs[r].detections[i];
+            vector<bool> used(b.size(), false);
+
+            for(size_t j = 0; j < a.size(); j++)
+            {
+                int best = -1;
+                double bestOverlap = 0.9;
+                for(size_t k = 0; k < b.size(); k++)
+                {
+                    double o = overlap(a[j].bbox, b[k].bbox);
+                    if(!used[k] && o >= bestOverlap)
+                    {
+                        best = k;
+                        bestOverlap = o;
+                    }
+                }
+
+                if(best < 0)
+                {
+                    onlyRef++;
+                    continue;
+                }
+
+                used[best] = true;
+                matched++;
+                maxScoreDiff = max(maxScoreDiff, fabs(a[j].score - b[best].score));
+            }
+
+            for(size_t k = 0; k < b.size(); k++)
+                if(!used[k])
+                    onlyRun++;
+        }
+
+        cout << runs[r].name << " vs " << runs[0].name
+             << ": matched detections: " << matched
+             << ", only " << runs[0].name << ": " << onlyRef
+             << ", only " << runs[r].name << ": " << onlyRun
+             << ", max score difference: " << maxScoreDiff << endl;
+    }
+
+    // Color features of the detections of the first run (extractBVT only
+    // takes bgBins and the masks, the rest of the spec must be the default)
+    bvtSpec spec;
+    if(!spec.load(packagePath + "/partMasks.yaml"))
+        return -1;
+
+    bvtBatchExtractor batch(spec);
+    long nDetections = 0;
+    double singleMs = 0, batchMs = 0;
+    float maxFeatureDiff = 0;
+    for(int p = 0; p < passes; p++)
+    {
+        for(size_t i = 0; i < frames.size(); i++)
+        {
+            vector<Rect> boxes;
+            for(size_t j = 0; j < runs[0].detections[i].size(); j++)
+            {
+                Rect box = runs[0].detections[i][j].bbox & Rect(0, 0, frames[i].cols, frames[i].rows);
+                if(box.area() > 0)
+                    boxes.push_back(box);
+            }
+
+            double start = wallMs();
+            vector<Mat> single(boxes.size());
+            for(size_t j = 0; j < boxes.size(); j++)
+            {
+                Mat resized;
+                resize(frames[i](boxes[j]), resized, Size(spec.width, spec.height));
+                extractBVT(resized, single[j], spec.bgBins, spec.partMasks);
+            }
+            singleMs += wallMs() - start;
+
+            start = wallMs();
+            Mat features = batch.compute(frames[i], boxes);
+            batchMs += wallMs() - start;
+
+            for(size_t j = 0; j < boxes.size(); j++)
+                for(int k = 0; k < features.cols; k++)
+                    maxFeatureDiff = max(maxFeatureDiff, (float) fabs(features.at<float>(j, k) -
+                                                                      single[j].at<float>(0, k)));
+            nDetections += boxes.size();
+        }
+    }
+
+    if(nDetections > 0)
+        cout << "BVT features of " << nDetections << " detections: "
+             << 1000*singleMs/nDetections << " us/detection one by one, "
+             << 1000*batchMs/nDetections << " us/detection in batches, "
+             << "max difference: " << maxFeatureDiff << endl;
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*******************************************************************************
+* Pedestrian Detector - MMAE benchmark
+*
+* Runs a number of tracks through the MMAE filter bank of the tracker (the
+* constant position, velocity and acceleration models), on synthetic walks,
+* the way PersonList does: all of them in a TrackBatch with one prediction per
+* frame (Phi and Q of the whole frame in closed form). The reference is a
+* cv::KalmanFilter bank (MMAEFilterBank) per track predicted delta_t/T times.
+* Reports the time per frame of both and the largest difference of their
+* estimates, and exits with 1 if the states, covariances or model
+* probabilities differ by more than tolerance (relative, or absolute below 1)
+* in any frame.
+*
+* Usage: mmae_benchmark [tracks] [frames]
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "../include/tracker/mmae.hpp"
+#include "../include/tracker/trackBatch.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const double T = 0.01;
+static const double positionVar = 0.1;
+static const double velocityVar = 1.0;
+static const double accelerationVar = 10.0;
+
+//Both keep the covariances of the models symmetric, so the rounding differences are forgotten
+//as the filters converge instead of growing: 20 tracks stay within 1e-11 for 400 frames and
+//2.5e-11 for 1000
+static const double tolerance = 1e-9;
+
+static double wallMs()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec*1000.0 + t.tv_usec/1000.0;
+}
+
+/*Same matrices as the bank of PersonModel*/
+
+static MMAEFilterBank *makeBank(double x, double y)
+{
+    double R[] = {0.4421, 0.3476, 0.3476, 0.2747};
+
+    KalmanFilter constantPosition(2, 2, 0, CV_64F);
+    constantPosition.transitionMatrix = Mat::eye(2, 2, CV_64F);
+    constantPosition.measurementMatrix = Mat::eye(2, 2, CV_64F);
+    constantPosition.processNoiseCov = Mat::eye(2, 2, CV_64F)*pow(T, 2)*positionVar;
+    constantPosition.measurementNoiseCov = Mat(2, 2, CV_64F, R).clone();
+    constantPosition.errorCovPost = Mat::eye(2, 2, CV_64F)*100;
+
+    KalmanFilter constantVelocity(4, 2, 0, CV_64F);
+    constantVelocity.transitionMatrix = (Mat_<double>(4, 4) << 1, 0, T, 0, 0, 1, 0, T, 0, 0, 1, 0, 0, 0, 0, 1);
+    constantVelocity.measurementMatrix = (Mat_<double>(2, 4) << 1, 0, 0, 0, 0, 1, 0, 0);
+    constantVelocity.processNoiseCov = (Mat_<double>(4, 4) << pow(T,4)/4, 0, pow(T,3)/2, 0, 0, pow(T,4)/4, 0, pow(T,3)/2, pow(T,3)/2, 0, pow(T,2), 0, 0, pow(T,3)/2, 0, pow(T,2));
+    constantVelocity.processNoiseCov = constantVelocity.processNoiseCov*velocityVar;
+    constantVelocity.measurementNoiseCov = Mat(2, 2, CV_64F, R).clone();
+    constantVelocity.errorCovPost = Mat::eye(4, 4, CV_64F)*100;
+
+    KalmanFilter constantAcceleration(6, 2, 0, CV_64F);
+    constantAcceleration.transitionMatrix = (Mat_<double>(6, 6) << 1, 0, T, 0, pow(T, 2)/2, 0, 0, 1, 0, T, 0, pow(T, 2)/2, 0, 0, 1, 0, T, 0, 0, 0, 0, 1, 0, T, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1);
+    constantAcceleration.measurementMatrix = (Mat_<double>(2, 6) << 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0);
+    constantAcceleration.processNoiseCov = (Mat_<double>(6, 6) << pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6, 0, 0, pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6, pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2, 0, 0, pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2, pow(T, 3)/6, 0, pow(T, 2)/2, 0, T, 0, 0, pow(T, 3)/6, 0, pow(T, 2)/2, 0, T);
+    constantAcceleration.processNoiseCov = constantAcceleration.processNoiseCov*accelerationVar;
+    constantAcceleration.measurementNoiseCov = Mat(2, 2, CV_64F, R).clone();
+    constantAcceleration.errorCovPost = Mat::eye(6, 6, CV_64F)*100;
+
+    vector<KalmanFilter> kalmanBank;
+    kalmanBank.push_back(constantPosition);
+    kalmanBank.push_back(constantVelocity);
+    kalmanBank.push_back(constantAcceleration);
+
+    vector< vector<int> > indexList(3);
+    for(int i = 0; i < 3; i++)
+        for(int k = 0; k < 2*(i+1); k++)
+            indexList[i].push_back(k);
+
+    double states[] = {x, y, 0, 0, 0, 0};
+    return new MMAEFilterBank(kalmanBank, indexList, false, false, Mat(6, 1, CV_64F, states).clone(), CV_64F);
+}
+
+static double difference(double value, double reference)
+{
+    double d = fabs(value - reference)/max(fabs(reference), 1.0);
+    return d == d ? d : HUGE_VAL;               //NaN is as far as it gets
+}
+
+/*Walk of a track, with a measurement missing now and then*/
+
+static bool measurement(int track, int step, double &x, double &y)
+{
+    double t = step*T;
+    x = track + 0.8*t + 0.3*sin(0.5*t + track);
+    y = 0.5*track + 0.2*t*t/(1 + t) + 0.05*sin(7.0*t);
+    return (step + track) % 10 != 0;
+}
+
+/*The tracks of PersonList: all of them in a TrackBatch, one prediction per frame, against a
+  cv::KalmanFilter bank per track predicted delta_t/T times (as PersonList used to). Returns
+  whether they agree*/
+
+static bool checkBatch(int nTracks, int nFrames)
+{
+    TrackBatch batch(T);
+    batch.setProcessNoise(positionVar, velocityVar, accelerationVar);
+
+    vector<MMAEFilterBank*> reference;
+    for(int k = 0; k < nTracks; k++)
+    {
+        double x, y;
+        measurement(k, 0, x, y);
+        batch.add(k, x, y);
+        reference.push_back(makeBank(x, y));
+    }
+
+    double batchMs = 0, referenceMs = 0, worst = 0, t = 0;
+    Mat z(2, 1, CV_64F), none;
+    for(int f = 0; f < nFrames; f++)
+    {
+        //Frames 50 to 250 ms apart
+        double delta_t = 0.05 + 0.2*((f*37) % 11)/10.0;
+        int times = delta_t/T;
+        int step = (int) ((t += delta_t)/T);
+
+        double start = wallMs();
+        batch.predict(times);
+        for(int k = 0; k < nTracks; k++)
+        {
+            double x, y;
+            if(measurement(k, step, x, y))
+                batch.setMeasurement(batch.slot(k), x, y);
+        }
+        batch.correct();
+        double mid = wallMs();
+        for(int k = 0; k < nTracks; k++)
+        {
+            for(int i = 0; i < times; i++)
+                reference[k]->predict();
+            bool seen = measurement(k, step, z.at<double>(0, 0), z.at<double>(1, 0));
+            reference[k]->correct(seen ? z : none);
+        }
+        batchMs += mid - start;
+        referenceMs += wallMs() - mid;
+
+        for(int k = 0; k < nTracks; k++)
+        {
+            int slot = batch.slot(k);
+            Mat cov = batch.mixtureCovariance(slot);
+            for(int i = 0; i < TrackBatch::nStates; i++)
+            {
+                worst = max(worst, difference(batch.state(slot, i), reference[k]->xMMAE.at<double>(i, 0)));
+                for(int j = 0; j < TrackBatch::nStates; j++)
+                    worst = max(worst, difference(cov.at<double>(i, j), reference[k]->stateCovMMAE.at<double>(i, j)));
+            }
+            for(int i = 0; i < TrackBatch::nModels; i++)
+                worst = max(worst, difference(batch.probability(slot, i), reference[k]->probabilities[i]));
+        }
+    }
+
+    printf("%d tracks, %d frames 50 to 250 ms apart\n", nTracks, nFrames);
+    printf("  TrackBatch, one prediction per frame: %8.4f ms/frame\n", batchMs/nFrames);
+    printf("  cv::KalmanFilter banks, delta_t/T predictions: %8.4f ms/frame (max difference %g, tolerance %g)\n", referenceMs/nFrames, worst, tolerance);
+
+    for(int k = 0; k < nTracks; k++)
+        delete reference[k];
+
+    return worst <= tolerance;
+}
+
+int main(int argc, char **argv)
+{
+    int nTracks = argc > 1 ? atoi(argv[1]) : 20;
+    int nFrames = argc > 2 ? atoi(argv[2]) : 200;
+
+    if(!checkBatch(nTracks, nFrames))
+    {
+        printf("TrackBatch and the cv::KalmanFilter banks differ by more than %g\n", tolerance);
+        return 1;
+    }
+    return 0;
+}
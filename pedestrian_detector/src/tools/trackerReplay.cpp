@@ -0,0 +1,497 @@
+/*******************************************************************************
+* Pedestrian Detector - Tracker replay
+*
+* Runs a recording of what the tracker node receives (the detections of every
+* frame, with the camera transform of the frame and the odometry between
+* frames) through PersonList, without ROS, the same calls trackingCallback
+* makes. Writes the tracks detected in every frame in the MOTChallenge format
+* of matlab/mot/res/data and scores them against a MOTChallenge ground truth
+* (the gt/gt.txt of a sequence, the one matlab/mot/evaluateTracking.m reads)
+* with the CLEAR MOT metrics of matlab/mot/utils/CLEAR_MOT_HUN.m: a track and
+* a person match if their boxes overlap by 0.5 or more (intersection over
+* union), the matches of the last frame are kept while they still overlap and
+* the rest are assigned optimally. Prints the frames and track updates per
+* second of the tracker and the mean and worst time of each of its stages.
+*
+* The recording is a text file, one record per line, comma separated (# starts
+* a comment):
+*
+*   K,fx,fy,cx,cy                   camera intrinsics, optional
+*   F,frame,stamp[,T00,...,T33]     next frame: number (the one of gt.txt),
+*                                   time in s and, optional, the base_footprint
+*                                   to camera transform, 4x4 row major
+*   O,angle,tx,ty[,Rxx,Rxy,Ryy]     odometry, rotation and translation of the
+*                                   robot (and their noise on the floor)
+*   D,left,top,width,height,x,y,z,h1,...,hn
+*                                   detection of the frame: bounding box,
+*                                   position in base_footprint (what the
+*                                   camera model gives) and BVT histogram
+*
+* With K and the transform the detections get the measurement statistics of
+* computeMeasurementStatistics, otherwise no bias and its fixed covariance.
+*
+* Usage: tracker_replay recording.csv [gt.txt|-] [results.txt|-] [threads]
+*
+* Licensed under the Simplified BSD License [see external/bsd.txt]
+*******************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include "../include/tracker/personMotionModel.hpp"
+#include "../include/tracker/assignmentSolver.hpp"
+#include "../include/tracker/utils.hpp"
+
+using namespace std;
+
+//As in config/tracker_params.yaml
+static const int medianWindow = 3;
+static const int framesBeforeDestruction = 60;
+static const int framesBeforeDestructionLocked = 60;
+static const double creationThreshold = 0.5;
+static const double validationGate = 1000000;
+static const double metricWeight = 0.8;
+static const double recognitionThreshold = 0.6;
+static const double colorLearningRate = 0.8;
+static const double positionVar = 0.5, velocityVar = 0.5, accelerationVar = 0.5;
+
+static const double overlapThreshold = 0.5;     //td of CLEAR_MOT_HUN
+static const double gated = 1000;
+
+enum { KILL = PersonList::nStages, TOTAL, nTimes };
+static const char *timeNames[nTimes] = {"predict", "costs", "assignment", "update", "deletion", "total"};
+
+struct Box
+{
+    int id;
+    double left, top, width, height;
+};
+
+typedef map<int, vector<Box> > BoxesByFrame;
+
+struct Frame
+{
+    int number;
+    double stamp;
+    Mat transform;                              //Empty if the recording has none
+    vector<Rect_<int> > rects;
+    vector<Point3d> coords;
+    vector<Mat> features;
+};
+
+static double wallMs()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec*1000.0 + t.tv_usec/1000.0;
+}
+
+static vector<double> splitNumbers(const string &line, size_t from)
+{
+    vector<double> values;
+    const char *p = line.c_str()+from;
+    while(*p)
+    {
+        char *end;
+        double value = strtod(p, &end);
+        if(end == p)
+            break;
+        values.push_back(value);
+        p = end;
+        while(*p == ',' || *p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+    }
+    return values;
+}
+
+/*boxiou of matlab/mot/utils*/
+
+static double overlap(const Box &a, const Box &b)
+{
+    double horizontal = min(a.left+a.width, b.left+b.width)-max(a.left, b.left);
+    double vertical = min(a.top+a.height, b.top+b.height)-max(a.top, b.top);
+    if(horizontal <= 0 || vertical <= 0)
+        return 0;
+    double intersection = horizontal*vertical;
+    return intersection/(a.width*a.height+b.width*b.height-intersection);
+}
+
+/*MOTChallenge file: frame,id,left,top,width,height,flag,... Rows flagged 0 (the ignored ones of
+  MOT16) are left out*/
+
+static bool readBoxes(const char *path, BoxesByFrame &boxes, int &lastFrame)
+{
+    ifstream file(path);
+    if(!file.is_open())
+        return false;
+
+    lastFrame = 0;
+    string line;
+    while(getline(file, line))
+    {
+        vector<double> values = splitNumbers(line, 0);
+        if(values.size() < 6 || (values.size() > 6 && values[6] == 0))
+            continue;
+
+        Box box = {(int) values[1], values[2], values[3], values[4], values[5]};
+        boxes[(int) values[0]].push_back(box);
+        lastFrame = max(lastFrame, (int) values[0]);
+    }
+    return true;
+}
+
+class Replay
+{
+
+public:
+    PersonList tracker;
+    Mat K;                                      //Empty if the recording has none
+    FILE *results;
+    BoxesByFrame tracked;
+    int frames, detections, updates;
+    double times[nTimes], worst[nTimes];
+
+    Replay(int threads, FILE *results) :
+        tracker(medianWindow, framesBeforeDestruction, framesBeforeDestructionLocked, creationThreshold, validationGate, metricWeight, recognitionThreshold, colorLearningRate, positionVar, velocityVar, accelerationVar),
+        results(results), frames(0), detections(0), updates(0), lastStamp(-1)
+    {
+        tracker.pool.setThreads(threads);
+        for(int i = 0; i < nTimes; i++)
+            times[i] = worst[i] = 0;
+    }
+
+    void odometry(const vector<double> &values)
+    {
+        double angle = values[0];
+        Mat rotation = (Mat_<double>(2, 2) << cos(angle), -sin(angle), sin(angle), cos(angle));
+        Mat translation = (Mat_<double>(2, 1) << values[1], values[2]);
+        Mat noise = Mat::zeros(2, 2, CV_64F);
+        if(values.size() >= 6)
+            noise = (Mat_<double>(2, 2) << values[3], values[4], values[4], values[5]);
+
+        tracker.tracks.moveFrame(rotation, translation, noise);
+    }
+
+    void track(Frame &frame)
+    {
+        double delta_t = lastStamp < 0 ? tracker.tracks.period() : frame.stamp-lastStamp;
+        lastStamp = frame.stamp;
+
+        vector<Mat> means, covariances;
+        statistics(frame, means, covariances);
+
+        double start = wallMs();
+        tracker.updateDeltaT(delta_t);
+        tracker.associateData(frame.coords, frame.rects, frame.features, means, covariances);
+        int nTracks = tracker.personList.size();
+        double killStart = wallMs();
+        tracker.trackletKiller();
+        double end = wallMs();
+
+        double frameTimes[nTimes];
+        for(int i = 0; i < PersonList::nStages; i++)
+            frameTimes[i] = tracker.stageTime[i];
+        frameTimes[KILL] = end-killStart;
+        frameTimes[TOTAL] = end-start;
+        for(int i = 0; i < nTimes; i++)
+        {
+            times[i] += frameTimes[i];
+            worst[i] = max(worst[i], frameTimes[i]);
+        }
+
+        frames++;
+        detections += frame.coords.size();
+        updates += nTracks;
+
+        //Only the tracks with a detection in this frame have a box of it
+        vector<PersonModel*> valid = tracker.getValidTrackerPosition();
+        for(vector<PersonModel*>::iterator it = valid.begin(); it != valid.end(); it++)
+        {
+            if((*it)->deadReckoning)
+                continue;
+
+            Box box = {(*it)->id+1, (double) (*it)->rect.x, (double) (*it)->rect.y, (double) (*it)->rect.width, (double) (*it)->rect.height};
+            tracked[frame.number].push_back(box);
+
+            if(results)
+            {
+                Point3d position = (*it)->getPositionEstimate();
+                fprintf(results, "%d,%d,%d,%d,%d,%d,-1,%.3f,%.3f,%.3f\n", frame.number, box.id, (*it)->rect.x, (*it)->rect.y, (*it)->rect.width, (*it)->rect.height, position.x, position.y, position.z);
+            }
+        }
+    }
+
+private:
+    double lastStamp;
+
+    void statistics(const Frame &frame, vector<Mat> &means, vector<Mat> &covariances)
+    {
+        if(!K.empty() && !frame.transform.empty())
+        {
+            //lambda of a point on the floor is 1/depth of the point in the camera
+            const Mat &T = frame.transform;
+            vector<double> lambdas;
+            for(size_t i = 0; i < frame.coords.size(); i++)
+            {
+                double depth = T.at<double>(2, 0)*frame.coords[i].x+T.at<double>(2, 1)*frame.coords[i].y+T.at<double>(2, 3);
+                lambdas.push_back(1/depth);
+            }
+            computeMeasurementStatistics(K, frame.transform, lambdas, frame.coords, frame.rects, means, covariances);
+            return;
+        }
+
+        //The covariance computeMeasurementStatistics gives to every detection
+        for(size_t i = 0; i < frame.coords.size(); i++)
+        {
+            means.push_back(Mat::zeros(2, 1, CV_64F));
+            covariances.push_back((Mat_<double>(2, 2) << 0.4421, 0.3476, 0.3476, 0.2747));
+        }
+    }
+};
+
+/*CLEAR MOT of the tracks of frames 1 to nFrames, as CLEAR_MOT_HUN does it in 2D*/
+
+static void evaluate(BoxesByFrame &truth, BoxesByFrame &tracked, int nFrames)
+{
+    AssignmentSolver solver;
+    map<int, int> previous;                     //Person -> track, in the last frame
+    map<int, int> lastMatch;                    //Person -> track, the last time it was matched
+    map<int, int> lastTracked;                  //Person -> last frame it was matched
+    map<int, int> present, trackedFrames;       //Per person
+    map<int, bool> previousTruth;
+
+    int nTruth = 0, matches = 0, falsePositives = 0, misses = 0, switches = 0, fragments = 0;
+    double overlaps = 0;
+
+    for(int t = 1; t <= nFrames; t++)
+    {
+        const vector<Box> &people = truth[t];
+        const vector<Box> &tracks = tracked[t];
+
+        map<int, int> trackIndex, personIndex;
+        for(size_t k = 0; k < tracks.size(); k++)
+            trackIndex[tracks[k].id] = k;
+        for(size_t k = 0; k < people.size(); k++)
+            personIndex[people[k].id] = k;
+
+        //Matches of the last frame that still hold
+        map<int, int> current;
+        map<int, bool> used;
+        for(size_t k = 0; k < people.size(); k++)
+        {
+            map<int, int>::iterator last = previous.find(people[k].id);
+            if(last == previous.end())
+                continue;
+            map<int, int>::iterator track = trackIndex.find(last->second);
+            if(track != trackIndex.end() && overlap(people[k], tracks[track->second]) >= overlapThreshold)
+            {
+                current[people[k].id] = last->second;
+                used[last->second] = true;
+            }
+        }
+
+        //The others, optimally
+        vector<int> rows, cols;
+        for(size_t k = 0; k < people.size(); k++)
+            if(!current.count(people[k].id))
+                rows.push_back(k);
+        for(size_t k = 0; k < tracks.size(); k++)
+            if(!used.count(tracks[k].id))
+                cols.push_back(k);
+
+        if(!rows.empty() && !cols.empty())
+        {
+            int nRows = rows.size(), nCols = cols.size();
+            vector<double> costs(nRows*nCols), assignment(nRows), cost(nRows);
+            for(int c = 0; c < nCols; c++)
+                for(int r = 0; r < nRows; r++)
+                {
+                    double distance = 1-overlap(people[rows[r]], tracks[cols[c]]);
+                    costs[r+c*nRows] = distance > overlapThreshold ? gated : distance;
+                }
+
+            solver.solveSparse(&assignment[0], &cost[0], &costs[0], nRows, nCols, gated);
+            for(int r = 0; r < nRows; r++)
+                if(assignment[r] != -1)
+                    current[people[rows[r]].id] = tracks[cols[(int) assignment[r]]].id;
+        }
+
+        map<int, bool> truthNow;
+        for(size_t k = 0; k < people.size(); k++)
+        {
+            int person = people[k].id;
+            truthNow[person] = true;
+            present[person]++;
+
+            map<int, int>::iterator match = current.find(person);
+            if(match == current.end())
+                continue;
+
+            matches++;
+            trackedFrames[person]++;
+            overlaps += overlap(people[k], tracks[trackIndex[match->second]]);
+
+            //A different track than the last time, and the person was there in the last frame
+            if(previousTruth.count(person) && lastMatch.count(person) && lastMatch[person] != match->second)
+                switches++;
+            //Tracked again after a gap
+            if(lastTracked.count(person) && lastTracked[person] != t-1)
+                fragments++;
+
+            lastMatch[person] = match->second;
+            lastTracked[person] = t;
+        }
+
+        nTruth += people.size();
+        falsePositives += tracks.size()-(current.size());
+        misses += people.size()-current.size();
+
+        previous.swap(current);
+        previousTruth.swap(truthNow);
+    }
+
+    int mostlyTracked = 0, partiallyTracked = 0, mostlyLost = 0;
+    for(map<int, int>::iterator it = present.begin(); it != present.end(); it++)
+    {
+        double ratio = trackedFrames[it->first]/(double) it->second;
+        if(ratio >= 0.8)
+            mostlyTracked++;
+        else if(ratio < 0.2)
+            mostlyLost++;
+        else
+            partiallyTracked++;
+    }
+
+    double recall = nTruth ? 100.0*matches/nTruth : 0;
+    double precision = matches+falsePositives ? 100.0*matches/(matches+falsePositives) : 0;
+    double mota = nTruth ? 100*(1-(misses+falsePositives+switches)/(double) nTruth) : 0;
+    double motp = matches ? 100*overlaps/matches : 0;
+
+    printf("\nCLEAR MOT, 2D (bounding box overlap >= %.1f), %d frames\n", overlapThreshold, nFrames);
+    printf("  Rcll  Prcn   GT   MT   PT   ML     FP     FN  IDs   FM  MOTA  MOTP\n");
+    printf("%6.1f%6.1f%5d%5d%5d%5d%7d%7d%5d%5d%6.1f%6.1f\n", recall, precision, (int) present.size(), mostlyTracked, partiallyTracked, mostlyLost,
+           falsePositives, misses, switches, fragments, mota, motp);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: %s recording.csv [gt.txt|-] [results.txt|-] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    const char *truthPath = argc > 2 && string(argv[2]) != "-" ? argv[2] : NULL;
+    const char *resultsPath = argc > 3 && string(argv[3]) != "-" ? argv[3] : NULL;
+    int threads = argc > 4 ? atoi(argv[4]) : 1;
+
+    ifstream recording(argv[1]);
+    if(!recording.is_open())
+    {
+        printf("Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *results = NULL;
+    if(resultsPath && !(results = fopen(resultsPath, "w")))
+    {
+        printf("Can't write %s\n", resultsPath);
+        return 1;
+    }
+
+    Replay replay(threads, results);
+    Frame frame;
+    bool haveFrame = false;
+
+    string line;
+    int lineNumber = 0;
+    while(getline(recording, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if(comment != string::npos)
+            line.erase(comment);
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == string::npos)
+            continue;
+
+        char record = line[first];
+        size_t comma = line.find(',', first);
+        vector<double> values = comma == string::npos ? vector<double>() : splitNumbers(line, comma+1);
+
+        if(record == 'K' && values.size() >= 4)
+        {
+            replay.K = (Mat_<double>(3, 3) << values[0], 0, values[2], 0, values[1], values[3], 0, 0, 1);
+        }
+        else if(record == 'F' && values.size() >= 2)
+        {
+            if(haveFrame)
+                replay.track(frame);
+
+            frame = Frame();
+            frame.number = (int) values[0];
+            frame.stamp = values[1];
+            if(values.size() >= 18)
+                frame.transform = Mat(4, 4, CV_64F, &values[2]).clone();
+            haveFrame = true;
+        }
+        else if(record == 'O' && values.size() >= 3)
+        {
+            //Between the frames before and after it
+            if(haveFrame)
+                replay.track(frame);
+            haveFrame = false;
+            replay.odometry(values);
+        }
+        else if(record == 'D' && values.size() >= 8 && haveFrame)
+        {
+            frame.rects.push_back(Rect_<int>((int) values[0], (int) values[1], (int) values[2], (int) values[3]));
+            frame.coords.push_back(Point3d(values[4], values[5], values[6]));
+            vector<float> histogram(values.begin()+7, values.end());
+            frame.features.push_back(Mat(histogram).clone());
+        }
+        else
+        {
+            printf("Line %d ignored\n", lineNumber);
+        }
+    }
+    if(haveFrame)
+        replay.track(frame);
+
+    if(results)
+        fclose(results);
+
+    if(replay.frames == 0)
+    {
+        printf("No frames in %s\n", argv[1]);
+        return 1;
+    }
+
+    double seconds = replay.times[TOTAL]/1000;
+    printf("%d frames, %d detections, %d track updates, %d threads\n", replay.frames, replay.detections, replay.updates, replay.tracker.pool.threads());
+    printf("%.1f frames/s, %.0f track updates/s\n\n", replay.frames/seconds, replay.updates/seconds);
+    printf("stage         mean ms    max ms\n");
+    for(int i = 0; i < nTimes; i++)
+        printf("%-12s%9.4f%10.4f\n", timeNames[i], replay.times[i]/replay.frames, replay.worst[i]);
+
+    if(truthPath)
+    {
+        BoxesByFrame truth;
+        int lastFrame;
+        if(!readBoxes(truthPath, truth, lastFrame))
+        {
+            printf("Can't open %s\n", truthPath);
+            return 1;
+        }
+        evaluate(truth, replay.tracked, lastFrame);
+    }
+
+    return 0;
+}
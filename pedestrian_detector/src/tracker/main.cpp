@@ -128,6 +128,11 @@ private:
     double const_pos_var;
     double const_vel_var;
     double const_accel_var;
+    int tracker_threads;
+    int reid_capacity;
+    int reid_time_to_live;
+    int reid_candidates;
+    double reid_height_tolerance;
 
     // Odometry auxiliars
     nav_msgs::Odometry last_odom_msg;
@@ -297,33 +302,8 @@ public:
         cv::Mat R(2, 3, CV_64F);
         R=J*control_noise*J.t();
 
-        for(std::vector<PersonModel>::iterator it = personList->personList.begin(); it!=personList->personList.end(); it++)
-        {
-
-            //Update the fused state
-            for(std::vector<KalmanFilter>::iterator it_mmae=it->mmaeEstimator->filterBank.begin(); it_mmae!=it->mmaeEstimator->filterBank.end(); it_mmae++)
-            {
-                it_mmae->statePost(cv::Range(0,2),cv::Range(0,1)) = odom_trans + odom_rot*it_mmae->statePost(cv::Range(0,2),cv::Range(0,1));
-
-
-                // Get number of blocks
-                int row_blocks=it_mmae->errorCovPost.rows%2;
-                int col_blocks=it_mmae->errorCovPost.cols%2;
-
-                // For each block (position, velocity, acceleration
-                for(int i=0;i<row_blocks;++i)
-                {
-                    for(int j=0;i<col_blocks;++i)
-                    {
-                        // Rotate covariance matrix
-                        it_mmae->errorCovPost(cv::Range(i*2,(i+1)*2),cv::Range(j*2,(j+1)*2)) = (odom_rot*it_mmae->errorCovPost(cv::Range(i*2,(i+1)*2),cv::Range(j*2,(j+1)*2))*odom_rot.t());
-                    }
-                }
-
-                // Add noise (xy position only, no velocities for now)
-                it_mmae->errorCovPost(cv::Range(0,2),cv::Range(0,2))+=R;
-            }
-        }
+        //Update the state of all the models of every track (xy position only, no velocities for now)
+        personList->tracks.moveFrame(odom_rot, odom_trans, R);
     }
 
     void drawCovariances()
@@ -386,7 +366,7 @@ public:
     {
 
 
-        vector<PersonModel> list = personList->getValidTrackerPosition();
+        vector<PersonModel*> list = personList->getValidTrackerPosition();
 
         ros::Time currentTime = ros::Time::now();
 
@@ -409,10 +389,10 @@ public:
                 double best = 100000000000000;
                 int personID=-1;
 
-                for(vector<PersonModel>::iterator it = list.begin(); it != list.end(); it++)
+                for(vector<PersonModel*>::iterator it = list.begin(); it != list.end(); it++)
                 {
 
-                    Point3d position = (*it).getPositionEstimate();
+                    Point3d position = (*it)->getPositionEstimate();
 
                     //WARNING!
                     //Assuming the position is relative to base_footprint. Avoiding tf's for computational purposes.
@@ -421,7 +401,7 @@ public:
                     if(dist < best)
                     {
                         best = dist;
-                        personID = it-> id;
+                        personID = (*it)->id;
                     }
                 }
 
@@ -434,16 +414,16 @@ public:
         if(personNotChosenFlag)
         {
 
-            for(vector<PersonModel>::iterator it = list.begin(); it != list.end(); it++)
+            for(vector<PersonModel*>::iterator it = list.begin(); it != list.end(); it++)
             {
                 stringstream description, name;
-                name << "person " << (*it).id;
-                description << "Detection " << (*it).id;
+                name << "person " << (*it)->id;
+                description << "Detection " << (*it)->id;
                 int_marker.header.stamp=currentTime;
                 int_marker.name = name.str();
                 int_marker.description = description.str();
 
-                Point3d position = (*it).getPositionEstimate();
+                Point3d position = (*it)->getPositionEstimate();
 
                 int_marker.controls.at(0).markers.at(0).color.r = 0;
                 int_marker.controls.at(0).markers.at(0).color.g = 1;
@@ -468,16 +448,16 @@ public:
             int_marker.header.stamp=currentTime;
             int_marker.header.frame_id=filtering_frame_id;
 
-            for(vector<PersonModel>::iterator it = list.begin(); it != list.end(); ++it)
+            for(vector<PersonModel*>::iterator it = list.begin(); it != list.end(); ++it)
             {
-                Point3d position = (*it).getPositionEstimate();
+                Point3d position = (*it)->getPositionEstimate();
 
-                if((*it).id == targetId)
+                if((*it)->id == targetId)
                 {
                     //Start looking at that person. Even if we have to turn the base to avoid obstacles, we will still try to see
                     // our target
 
-                    it->lockedOnce = true;
+                    (*it)->lockedOnce = true;
 
                     int_marker.controls.at(0).markers.at(0).color.r = 1;
                     int_marker.controls.at(0).markers.at(0).color.g = 0;
@@ -488,8 +468,8 @@ public:
                     int_marker.pose.position.y = position.y;
 
                     stringstream description, name;
-                    name << "person " << (*it).id;
-                    description << "Objective: Detection " << (*it).id;
+                    name << "person " << (*it)->id;
+                    description << "Objective: Detection " << (*it)->id;
 
                     int_marker.name = name.str();
                     int_marker.description = description.str();
@@ -523,7 +503,7 @@ public:
                         fixationGoal.fixation_point.header.frame_id=filtering_frame_id;
                         fixationGoal.fixation_point.point.x = position.x;
                         fixationGoal.fixation_point.point.y = position.y;
-                        fixationGoal.fixation_point.point.z = it->personHeight/2;
+                        fixationGoal.fixation_point.point.z = (*it)->personHeight/2;
                         fixationGoal.fixation_point_error_tolerance = fixation_tolerance;
 
 
@@ -531,7 +511,7 @@ public:
                         ac.sendGoal(fixationGoal);
                         ROS_INFO("Gaze Action server started, sending goal.");
 
-                        lastFixationPoint = Point3d(position.x, position.y, it->personHeight/2);
+                        lastFixationPoint = Point3d(position.x, position.y, (*it)->personHeight/2);
 
                     }
 
@@ -545,7 +525,7 @@ public:
                     int_marker.controls.at(0).markers.at(0).color.g = 1;
                     int_marker.controls.at(0).markers.at(0).color.b = 0;
 
-                    Point3d position = (*it).getPositionEstimate();
+                    Point3d position = (*it)->getPositionEstimate();
 
                     geometry_msgs::PointStamped personInBase;
                     try
@@ -571,8 +551,8 @@ public:
 
                     stringstream description, name;
 
-                    name << "person " << (*it).id;
-                    description << "Detection " << (*it).id;
+                    name << "person " << (*it)->id;
+                    description << "Detection " << (*it)->id;
 
                     int_marker.name = name.str();
                     int_marker.description = description.str();
@@ -604,22 +584,30 @@ public:
         double delta_t = sampleTime.toSec();
         personList->updateDeltaT(delta_t);
 
+        //The detector may send only the header of the frame (embed_image false),
+        //then there is nothing to draw on
+        bool haveImage = !detection->im.data.empty();
         cv_bridge::CvImagePtr cv_ptr;
 
-        try
-        {
-            cv_ptr = cv_bridge::toCvCopy(detection->im, sensor_msgs::image_encodings::BGR8);
-        }
-        catch (cv_bridge::Exception& e)
+        if(haveImage)
         {
-            ROS_ERROR("cv_bridge exception: %s", e.what());
-            return;
+            try
+            {
+                cv_ptr = cv_bridge::toCvCopy(detection->im, sensor_msgs::image_encodings::BGR8);
+            }
+            catch (cv_bridge::Exception& e)
+            {
+                ROS_ERROR("cv_bridge exception: %s", e.what());
+                return;
+            }
         }
 
         //Get transforms
         tf::StampedTransform transform;
 
-        Mat lastImage = cv_ptr->image;
+        Mat lastImage;
+        if(haveImage)
+            lastImage = cv_ptr->image;
 
         ros::Time currentTime = ros::Time::now();
 
@@ -794,7 +782,8 @@ public:
 
                 int ind = 0;
                 Point2d barBase(trackedBB.tl().x, trackedBB.br().y); //Bottom left corner of the bb
-                for(std::vector<double>::iterator pr = it->mmaeEstimator->probabilities.begin(); pr != it->mmaeEstimator->probabilities.end(); pr++)
+                std::vector<double> probabilities = it->getModelProbabilities();
+                for(std::vector<double>::iterator pr = probabilities.begin(); haveImage && pr != probabilities.end(); pr++)
                 {
                     Point2d tl = barBase-Point2d(0, maxBarSize*(*pr));
                     rectangle(lastImage, tl, barBase + Point2d(step, 0), cores[ind], CV_FILLED);
@@ -811,11 +800,13 @@ public:
 
                 if(it->id == targetId)
                 {
-                    rectangle(lastImage, trackedBB, Scalar(0, 0, 255), 2);
+                    if(haveImage)
+                        rectangle(lastImage, trackedBB, Scalar(0, 0, 255), 2);
                     convert << "id: " << it->id << " | H = " << head.z;
 
                 }else{
-                    rectangle(lastImage, trackedBB, Scalar(0, 255, 0), 2);
+                    if(haveImage)
+                        rectangle(lastImage, trackedBB, Scalar(0, 255, 0), 2);
                     convert << "id: " << it->id;
                 }
 
@@ -829,7 +820,8 @@ public:
 
                 listOfBBs.bbVector.push_back(bBoxWithId);
 
-                putText(lastImage, convert.str(), trackedBB.tl(), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
+                if(haveImage)
+                    putText(lastImage, convert.str(), trackedBB.tl(), CV_FONT_HERSHEY_SIMPLEX, 1, Scalar_<int>(255,0,0), 2);
 
             }
         }
@@ -837,8 +829,11 @@ public:
         /*Draw boxes and probabilities on an image*/
         //cv::Mat visualizationImage;
         //visualizationImage =  personList->plotReprojectionAndProbabilities(targetId, baseFootprintToCameraTransform, cameramodel, lastImage);
-        sensor_msgs::ImagePtr msgImage = cv_bridge::CvImage(std_msgs::Header(), "bgr8", lastImage).toImageMsg();
-        image_pub.publish(msgImage);
+        if(haveImage)
+        {
+            sensor_msgs::ImagePtr msgImage = cv_bridge::CvImage(std_msgs::Header(), "bgr8", lastImage).toImageMsg();
+            image_pub.publish(msgImage);
+        }
 
         listOfBBs.header = detection->header;
         trackerPublisher.publish(listOfBBs);
@@ -874,6 +869,11 @@ public:
         nPriv.param("const_pos_var", const_pos_var, 0.5);
         nPriv.param("const_vel_var", const_vel_var, 0.5);
         nPriv.param("const_accel_var", const_accel_var, 0.5);
+        nPriv.param("tracker_threads", tracker_threads, 0);
+        nPriv.param("reid_capacity", reid_capacity, 100);
+        nPriv.param("reid_time_to_live", reid_time_to_live, 300);
+        nPriv.param("reid_candidates", reid_candidates, 3);
+        nPriv.param("reid_height_tolerance", reid_height_tolerance, 0.2);
 
         nPriv.param("alpha_1",alpha_1, 0.05);
         nPriv.param("alpha_2",alpha_2, 0.001);
@@ -900,6 +900,12 @@ public:
 
 
         personList = new PersonList(median_window, numberOfFramesBeforeDestruction, numberOfFramesBeforeDestructionLocked, creation_threshold, validation_gate, metric_weight, recognition_threshold, c_learning_rate, const_pos_var, const_vel_var, const_accel_var);
+        //Threads for the tracks (0 is one per core). Small scenes run in this thread anyway
+        personList->pool.setThreads(tracker_threads);
+        //Lost tracks kept to give their ids back (time to live in frames)
+        personList->gallery.setLimits(reid_capacity, reid_time_to_live);
+        personList->reid_candidates = reid_candidates;
+        personList->reid_height_tolerance = reid_height_tolerance;
         personNotChosenFlag = true;
         automatic = false;
 
@@ -1,4 +1,4 @@
-#include "../include/HungarianFunctions.hpp"
+#include "../include/tracker/HungarianFunctions.hpp"
 
 void step2b(double *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim)
 {
@@ -0,0 +1,335 @@
+#include "../include/tracker/assignmentSolver.hpp"
+#include <algorithm>
+#include <limits>
+
+void AssignmentSolver::solve(double *assignment, double *cost, const double *distMatrixIn, int nOfRows, int nOfColumns)
+{
+    *cost = 0;
+    for(int row = 0; row < nOfRows; row++)
+        assignment[row] = -1.0;
+    if(nOfRows == 0 || nOfColumns == 0)
+        return;
+
+    int n = std::max(nOfRows, nOfColumns);
+    c.assign(n*n, 0.0);
+    for(int row = 0; row < nOfRows; row++)
+        for(int col = 0; col < nOfColumns; col++)
+            c[row*n+col] = distMatrixIn[row+nOfRows*col];
+
+    lapjv(n);
+
+    for(int row = 0; row < nOfRows; row++)
+        if(rowsol[row] < nOfColumns)
+        {
+            assignment[row] = rowsol[row];
+            *cost += distMatrixIn[row+nOfRows*rowsol[row]];
+        }
+}
+
+void AssignmentSolver::solveSparse(double *assignment, double *cost, const double *distMatrixIn, int nOfRows, int nOfColumns, double gate)
+{
+    *cost = 0;
+    for(int row = 0; row < nOfRows; row++)
+        assignment[row] = -1.0;
+
+    //Connected components of the gated pairs: rows are 0..nOfRows-1, columns come after them
+    int nVertices = nOfRows+nOfColumns;
+    parent.resize(nVertices);
+    for(int i = 0; i < nVertices; i++)
+        parent[i] = i;
+
+    for(int col = 0; col < nOfColumns; col++)
+        for(int row = 0; row < nOfRows; row++)
+            if(distMatrixIn[row+nOfRows*col] < gate)
+            {
+                int a = find(row), b = find(nOfRows+col);
+                if(a != b)
+                    parent[a] = b;
+            }
+
+    label.assign(nVertices, -1);
+    int nComponents = 0;
+    for(int i = 0; i < nVertices; i++)
+    {
+        int root = find(i);
+        if(label[root] < 0)
+            label[root] = nComponents++;
+    }
+
+    //Vertices sorted by component (rows first inside every component)
+    start.assign(nComponents+1, 0);
+    for(int i = 0; i < nVertices; i++)
+        start[label[find(i)]+1]++;
+    for(int k = 0; k < nComponents; k++)
+        start[k+1] += start[k];
+    members.resize(nVertices);
+    for(int i = 0; i < nVertices; i++)
+        members[start[label[find(i)]]++] = i;
+    for(int k = nComponents; k > 0; k--)
+        start[k] = start[k-1];
+    start[0] = 0;
+
+    for(int k = 0; k < nComponents; k++)
+    {
+        rows.clear();
+        cols.clear();
+        for(int m = start[k]; m < start[k+1]; m++)
+        {
+            if(members[m] < nOfRows)
+                rows.push_back(members[m]);
+            else
+                cols.push_back(members[m]-nOfRows);
+        }
+        //A row or a column without gated pairs
+        if(rows.empty() || cols.empty())
+            continue;
+
+        int nRows = rows.size(), nCols = cols.size();
+        int n = std::max(nRows, nCols);
+        c.assign(n*n, 0.0);
+        for(int i = 0; i < nRows; i++)
+            for(int j = 0; j < nCols; j++)
+                c[i*n+j] = distMatrixIn[rows[i]+nOfRows*cols[j]];
+
+        lapjv(n);
+
+        for(int i = 0; i < nRows; i++)
+        {
+            int j = rowsol[i];
+            if(j < nCols && c[i*n+j] < gate)
+            {
+                assignment[rows[i]] = cols[j];
+                *cost += c[i*n+j];
+            }
+        }
+    }
+}
+
+int AssignmentSolver::find(int i)
+{
+    while(parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/*Square problem of size n in c. Leaves the column of every row in rowsol*/
+
+void AssignmentSolver::lapjv(int n)
+{
+    const double big = std::numeric_limits<double>::max();
+
+    rowsol.assign(n, -1);
+    colsol.assign(n, -1);
+    v.resize(n);
+    d.resize(n);
+    matches.assign(n, 0);
+    freeRows.resize(n);
+    collist.resize(n);
+    pred.resize(n);
+
+    if(n == 1)
+    {
+        rowsol[0] = 0;
+        colsol[0] = 0;
+        return;
+    }
+
+    /* column reduction */
+    for(int j = n-1; j >= 0; j--)
+    {
+        double min = c[j];
+        int imin = 0;
+        for(int i = 1; i < n; i++)
+            if(c[i*n+j] < min)
+            {
+                min = c[i*n+j];
+                imin = i;
+            }
+        v[j] = min;
+
+        if(++matches[imin] == 1)
+        {
+            rowsol[imin] = j;
+            colsol[j] = imin;
+        }
+        else
+            colsol[j] = -1;
+    }
+
+    /* reduction transfer */
+    int numfree = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(matches[i] == 0)
+            freeRows[numfree++] = i;
+        else if(matches[i] == 1)
+        {
+            int j1 = rowsol[i];
+            double min = big;
+            for(int j = 0; j < n; j++)
+                if(j != j1 && c[i*n+j]-v[j] < min)
+                    min = c[i*n+j]-v[j];
+            v[j1] -= min;
+        }
+    }
+
+    /* augmenting row reduction, twice. A row is only taken again a bounded number of times,
+       with costs that are almost equal the prices could keep going down by tiny steps */
+    int reductions = 0;
+    for(int loop = 0; loop < 2; loop++)
+    {
+        int k = 0;
+        int prvnumfree = numfree;
+        numfree = 0;
+        while(k < prvnumfree)
+        {
+            int i = freeRows[k++];
+
+            /* find the minimum and the second minimum reduced cost of the row */
+            double umin = c[i*n]-v[0], usubmin = big;
+            int j1 = 0, j2 = 0;
+            for(int j = 1; j < n; j++)
+            {
+                double h = c[i*n+j]-v[j];
+                if(h < usubmin)
+                {
+                    if(h >= umin)
+                    {
+                        usubmin = h;
+                        j2 = j;
+                    }
+                    else
+                    {
+                        usubmin = umin;
+                        umin = h;
+                        j2 = j1;
+                        j1 = j;
+                    }
+                }
+            }
+
+            int i0 = colsol[j1];
+            if(umin < usubmin)
+                v[j1] -= usubmin-umin;
+            else if(i0 > -1)
+            {
+                /* the minimum column is taken, use the second one */
+                j1 = j2;
+                i0 = colsol[j2];
+            }
+
+            rowsol[i] = j1;
+            colsol[j1] = i;
+
+            if(i0 > -1)
+            {
+                rowsol[i0] = -1;
+                if(umin < usubmin && ++reductions < n*n)
+                    freeRows[--k] = i0;
+                else
+                    freeRows[numfree++] = i0;
+            }
+        }
+    }
+
+    /* augment the solution from every free row, shortest augmenting paths */
+    for(int f = 0; f < numfree; f++)
+    {
+        int freerow = freeRows[f];
+        for(int j = 0; j < n; j++)
+        {
+            d[j] = c[freerow*n+j]-v[j];
+            pred[j] = freerow;
+            collist[j] = j;
+        }
+
+        int low = 0, up = 0, last = 0, endofpath = -1;
+        double min = 0;
+        bool unassignedfound = false;
+        do
+        {
+            if(up == low)
+            {
+                /* columns at the minimum distance */
+                last = low-1;
+                min = d[collist[up++]];
+                for(int k = up; k < n; k++)
+                {
+                    int j = collist[k];
+                    double h = d[j];
+                    if(h <= min)
+                    {
+                        if(h < min)
+                        {
+                            up = low;
+                            min = h;
+                        }
+                        collist[k] = collist[up];
+                        collist[up++] = j;
+                    }
+                }
+
+                for(int k = low; k < up; k++)
+                    if(colsol[collist[k]] < 0)
+                    {
+                        endofpath = collist[k];
+                        unassignedfound = true;
+                        break;
+                    }
+            }
+
+            if(!unassignedfound)
+            {
+                /* scan the row of a column at the minimum distance */
+                int j1 = collist[low++];
+                int i = colsol[j1];
+                double h = c[i*n+j1]-v[j1]-min;
+
+                for(int k = up; k < n; k++)
+                {
+                    int j = collist[k];
+                    double v2 = c[i*n+j]-v[j]-h;
+                    if(v2 < d[j])
+                    {
+                        pred[j] = i;
+                        if(v2 == min)
+                        {
+                            if(colsol[j] < 0)
+                            {
+                                endofpath = j;
+                                unassignedfound = true;
+                                break;
+                            }
+                            collist[k] = collist[up];
+                            collist[up++] = j;
+                        }
+                        d[j] = v2;
+                    }
+                }
+            }
+        }
+        while(!unassignedfound);
+
+        /* update the prices of the scanned columns */
+        for(int k = 0; k <= last; k++)
+        {
+            int j1 = collist[k];
+            v[j1] += d[j1]-min;
+        }
+
+        /* flip the assignments along the path */
+        int i;
+        do
+        {
+            i = pred[endofpath];
+            colsol[endofpath] = i;
+            int j1 = endofpath;
+            endofpath = rowsol[i];
+            rowsol[i] = j1;
+        }
+        while(i != freerow);
+    }
+}
@@ -0,0 +1,217 @@
+#include "../include/tracker/associationCosts.hpp"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+void AssociationCosts::clear()
+{
+    bins = 0;
+    trackX.clear(); trackY.clear(); trackXX.clear(); trackXY.clear(); trackYY.clear();
+    detX.clear(); detY.clear(); detXX.clear(); detXY.clear(); detYY.clear();
+    trackHist.clear();
+    detHist.clear();
+}
+
+void AssociationCosts::addTracker(double x, double y, double cxx, double cxy, double cyy, const Mat &histogram)
+{
+    trackX.push_back(x);
+    trackY.push_back(y);
+    trackXX.push_back(cxx);
+    trackXY.push_back(cxy);
+    trackYY.push_back(cyy);
+    addHistogram(histogram, trackHist);
+}
+
+void AssociationCosts::addDetection(double x, double y, const Mat &mean, const Mat &cov, const Mat &histogram)
+{
+    //The error of the detection has a mean (the discretization error), so it is taken away here
+    Mat mean64, cov64;
+    mean.convertTo(mean64, CV_64F);
+    cov.convertTo(cov64, CV_64F);
+
+    detX.push_back(x+mean64.at<double>(0, 0));
+    detY.push_back(y+mean64.at<double>(1, 0));
+    detXX.push_back(cov64.at<double>(0, 0));
+    detXY.push_back(cov64.at<double>(0, 1));
+    detYY.push_back(cov64.at<double>(1, 1));
+    addHistogram(histogram, detHist);
+}
+
+/*Appends sqrt(h/sum(h)) as a row: the Bhattacharyya coefficient of two histograms (as
+  compareHist computes it) is then the dot product of their rows*/
+
+int AssociationCosts::appendHistogram(const Mat &histogram, std::vector<float> &rows)
+{
+    Mat values;
+    if(histogram.isContinuous() && (histogram.depth() == CV_32F || histogram.depth() == CV_64F))
+        values = histogram;
+    else
+        histogram.convertTo(values, CV_32F);
+
+    int n = values.total()*values.channels();
+
+    size_t start = rows.size();
+    rows.resize(start+n);
+    float *row = &rows[start];
+
+    double sum = 0;
+    if(values.depth() == CV_32F)
+    {
+        const float *v = values.ptr<float>();
+        for(int k = 0; k < n; k++)
+        {
+            row[k] = v[k];
+            sum += v[k];
+        }
+    }
+    else
+    {
+        const double *v = values.ptr<double>();
+        for(int k = 0; k < n; k++)
+        {
+            row[k] = v[k];
+            sum += v[k];
+        }
+    }
+
+    float scale = sum > DBL_EPSILON ? 1.0/sum : 1.0;
+    for(int k = 0; k < n; k++)
+        row[k] = sqrt(std::max(row[k]*scale, 0.0f));
+    return n;
+}
+
+void AssociationCosts::addHistogram(const Mat &histogram, std::vector<float> &rows)
+{
+    int n = appendHistogram(histogram, rows);
+    if(bins == 0)
+        bins = n;
+    CV_Assert(n == bins);
+}
+
+/*The dot product is split in 8 partial sums so it is done in SIMD registers*/
+
+double AssociationCosts::coefficient(const float *a, const float *b, int bins)
+{
+    float partial[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int k = 0;
+    for(; k+8 <= bins; k += 8)
+        for(int l = 0; l < 8; l++)
+            partial[l] += a[k+l]*b[k+l];
+
+    double sum = 0;
+    for(int l = 0; l < 8; l++)
+        sum += partial[l];
+    for(; k < bins; k++)
+        sum += a[k]*b[k];
+    return sum;
+}
+
+/*Inverse innovation covariances, once per tracker when all the detections have the same
+  covariance*/
+
+void AssociationCosts::computeInverses()
+{
+    int nd = detections(), nt = trackers();
+
+    sameCovariance = true;
+    for(int d = 1; d < nd && sameCovariance; d++)
+        sameCovariance = detXX[d] == detXX[0] && detXY[d] == detXY[0] && detYY[d] == detYY[0];
+    if(!sameCovariance)
+        return;
+
+    invXX.resize(nt);
+    invXY.resize(nt);
+    invYY.resize(nt);
+    for(int t = 0; t < nt; t++)
+    {
+        double sxx = trackXX[t]+detXX[0], sxy = trackXY[t]+detXY[0], syy = trackYY[t]+detYY[0];
+        double det = sxx*syy-sxy*sxy;
+        invXX[t] = syy/det;
+        invXY[t] = -sxy/det;
+        invYY[t] = sxx/det;
+    }
+}
+
+/*Squared Mahalanobis distance*/
+
+double AssociationCosts::mahalanobis(int d, int t) const
+{
+    double ex = trackX[t]-detX[d], ey = trackY[t]-detY[d];
+    if(sameCovariance)
+        return ex*ex*invXX[t]+2*ex*ey*invXY[t]+ey*ey*invYY[t];
+
+    double sxx = trackXX[t]+detXX[d], sxy = trackXY[t]+detXY[d], syy = trackYY[t]+detYY[d];
+    return (ex*ex*syy-2*ex*ey*sxy+ey*ey*sxx)/(sxx*syy-sxy*sxy);
+}
+
+/*Bhattacharyya distance, sqrt(1-coefficient)*/
+
+double AssociationCosts::bhattacharyya(int d, int t) const
+{
+    return sqrt(std::max(1.0-coefficient(&detHist[d*bins], &trackHist[t*bins], bins), 0.0));
+}
+
+static double largestEigenvalue(double xx, double xy, double yy)
+{
+    double half = (xx-yy)/2;
+    return (xx+yy)/2+sqrt(half*half+xy*xy);
+}
+
+void AssociationCosts::compute(double validationGate, double recognitionThreshold, double *costs)
+{
+    int nd = detections(), nt = trackers();
+    for(int i = 0; i < nd*nt; i++)
+        costs[i] = 1000;
+    distances.assign(nd*nt, HUGE_VAL);
+    colorDistances.assign(nd*nt, 1.0);
+    if(nd == 0 || nt == 0)
+        return;
+
+    computeInverses();
+
+    //Pre-gating: e'S^-1e >= |e|^2/lambdaMax(S) and lambdaMax(P+D) <= lambdaMax(P)+lambdaMax(D),
+    //so a detection farther than sqrt(gate*(lambdaMax(P)+lambdaMax(D))) can't be inside the gate
+    double detectionEigenvalue = 0;
+    detectionGrid.clear();
+    for(int d = 0; d < nd; d++)
+    {
+        detectionEigenvalue = std::max(detectionEigenvalue, largestEigenvalue(detXX[d], detXY[d], detYY[d]));
+        detectionGrid.insert(d, detX[d], detY[d]);
+    }
+
+    //Every tracker writes its own column, the chunks of trackers can go in parallel
+    int nChunks = (nt+chunkSize-1)/chunkSize;
+    if((int) candidates.size() < nChunks)
+        candidates.resize(nChunks);
+    if(pool == NULL)
+        computeTrackers(0, nt, validationGate, recognitionThreshold, detectionEigenvalue, costs);
+    else
+        pool->run(nt, chunkSize, [&](int begin, int end) { computeTrackers(begin, end, validationGate, recognitionThreshold, detectionEigenvalue, costs); });
+}
+
+void AssociationCosts::computeTrackers(int begin, int end, double validationGate, double recognitionThreshold, double detectionEigenvalue, double *costs)
+{
+    int nd = detections(), nt = trackers();
+    std::vector<int> &found = candidates[begin/chunkSize];
+
+    for(int t = begin; t < end; t++)
+    {
+        double radius = sqrt(validationGate*(largestEigenvalue(trackXX[t], trackXY[t], trackYY[t])+detectionEigenvalue));
+        detectionGrid.query(trackX[t], trackY[t], radius, found);
+
+        for(size_t k = 0; k < found.size(); k++)
+        {
+            int d = found[k];
+            double dist = mahalanobis(d, t);
+            distances[d*nt+t] = dist;
+            if(dist >= validationGate)
+                continue;
+
+            //Colors too different, it can't be the same person
+            double colorDist = bhattacharyya(d, t);
+            colorDistances[d*nt+t] = colorDist;
+            if(colorDist <= recognitionThreshold)
+                costs[d+t*nd] = colorDist;
+        }
+    }
+}
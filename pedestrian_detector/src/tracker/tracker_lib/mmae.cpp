@@ -160,6 +160,11 @@ void MMAEFilterBank::correct(Mat &measurement)
 
             itFilter->correct(measurement);
 
+            //Kept symmetric, the rounding of P-K*H*P grows along a track otherwise
+            Mat trErrorCov;
+            transpose(itFilter->errorCovPost, trErrorCov);
+            itFilter->errorCovPost = 0.5*(itFilter->errorCovPost+trErrorCov);
+
             //VERIFICAR SE O EXPTERM DA UM ESCALAR OU SE HOUVE ALGUM ERRO!
 
 
@@ -0,0 +1,113 @@
+#include "../include/tracker/parallelFor.hpp"
+#include <algorithm>
+
+ParallelFor::ParallelFor(int nThreads) :
+    body(NULL), size(0), grain(1), nChunks(0), generation(0), active(0), done(0), stopping(false), nextChunk(0)
+{
+    setThreads(nThreads);
+}
+
+ParallelFor::~ParallelFor()
+{
+    stop();
+}
+
+void ParallelFor::setThreads(int nThreads)
+{
+    if(nThreads <= 0)
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    stop();
+    stopping = false;
+    for(int i = 1; i < nThreads; i++)
+        workers.push_back(std::thread(&ParallelFor::loop, this));
+}
+
+void ParallelFor::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+}
+
+void ParallelFor::run(int n, int grain, const std::function<void(int, int)> &body)
+{
+    if(n <= 0)
+        return;
+    grain = std::max(grain, 1);
+    int chunks = (n+grain-1)/grain;
+
+    if(workers.empty() || chunks == 1)
+    {
+        for(int begin = 0; begin < n; begin += grain)
+            body(begin, std::min(begin+grain, n));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->body = &body;
+        this->size = n;
+        this->grain = grain;
+        nChunks = chunks;
+        done = 0;
+        nextChunk = 0;
+        generation++;
+    }
+    wakeup.notify_all();
+
+    work();
+
+    //Also waits for the threads that took the job and found nothing left, so none of them is
+    //still looking at it when the next one starts
+    std::unique_lock<std::mutex> guard(lock);
+    while(done < nChunks || active > 0)
+        finished.wait(guard);
+    this->body = NULL;
+}
+
+void ParallelFor::loop()
+{
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while(true)
+    {
+        while(!stopping && (generation == seen || body == NULL))
+            wakeup.wait(guard);
+        if(stopping)
+            return;
+
+        seen = generation;
+        active++;
+        guard.unlock();
+        work();
+        guard.lock();
+        active--;
+        if(active == 0)
+            finished.notify_all();
+    }
+}
+
+/*Chunks of the current job until there are none left*/
+
+void ParallelFor::work()
+{
+    while(true)
+    {
+        int chunk = nextChunk++;
+        if(chunk >= nChunks)
+            return;
+
+        int begin = chunk*grain;
+        (*body)(begin, std::min(begin+grain, size));
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(++done == nChunks)
+            finished.notify_all();
+    }
+}
@@ -2,9 +2,20 @@
 #include <algorithm>
 #include <vector>
 #include <math.h>
-#include "../include/HungarianFunctions.hpp"
+#include <chrono>
+#include "../include/tracker/HungarianFunctions.hpp"
 #include "../include/tracker/utils.hpp"
 
+/*ms since the last call (or since the start), to time the stages of associateData*/
+
+static double lap(std::chrono::steady_clock::time_point &last)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now-last).count();
+    last = now;
+    return ms;
+}
+
 Mat PersonModel::getBvtHistogram()
 {
     return bvtHistogram;
@@ -41,156 +52,56 @@ double PersonModel::getScoreForAssociation(double height, Point3d detectedPositi
 
 Point3d PersonModel::getPositionEstimate()
 {
-
-    Point3d estimate(mmaeEstimator->xMMAE.at<double>(mmaeEstimator->modelToxMMAEindexes.at(0).at(0), 0), mmaeEstimator->xMMAE.at<double>(mmaeEstimator->modelToxMMAEindexes.at(0).at(1), 0), personHeight);
+    int slot = tracks->slot(id);
+    Point3d estimate(tracks->state(slot, 0), tracks->state(slot, 1), personHeight);
     return estimate;
 }
 
 Mat PersonModel::getCovarianceOfMixture()
 {
-    return mmaeEstimator->stateCovMMAE;
+    return tracks->mixtureCovariance(tracks->slot(id));
 }
 
+std::vector<double> PersonModel::getModelProbabilities()
+{
+    int slot = tracks->slot(id);
+    std::vector<double> probabilities;
+    for(int i = 0; i < TrackBatch::nModels; i++)
+        probabilities.push_back(tracks->probability(slot, i));
+    return probabilities;
+}
 
 void PersonModel::updateModel()
 {
-
-    for(int i=0; i < median_window-1; i++)
-        positionHistory[median_window-1-i] = positionHistory[median_window-1-(i+1)];
-
-    positionHistory[0] = position;
-
+    //Last median_window positions (-1000 when there was no detection)
+    medianX.push(position.x);
+    medianY.push(position.y);
+    medianZ.push(position.z);
 
     position.x = -1000;
     position.y = -1000;
     position.z = 0.95;
 
-    Mat measurement;
-
     cv::Point3d filteredPoint;
 
     filteredPoint = medianFilter();
 
-    if(filteredPoint.x == -1000 || filteredPoint.y == -1000)
-    {
-        measurement = Mat();
-    }
-    else
-    {
-        measurement = Mat(2, 1, CV_64F);
-        measurement.at<double>(0, 0) = filteredPoint.x;
-        measurement.at<double>(1, 0) = filteredPoint.y;
-    }
-    mmaeEstimator->correct(measurement);
+    //The MMAE of all the tracks is corrected together by PersonList::updateList()
+    if(filteredPoint.x != -1000 && filteredPoint.y != -1000)
+        tracks->setMeasurement(tracks->slot(id), filteredPoint.x, filteredPoint.y);
 
     //Correct the person height.
     heightK = heightP/(heightP+heightR);
-    personHeight += heightK*(positionHistory[0].z*2-personHeight);
+    personHeight += heightK*(medianZ.newest()*2-personHeight);
     heightP = (1-heightK)*heightP;
 
 }
 
-PersonModel::PersonModel(Point3d detectedPosition, cv::Rect_<int> bb, int id, int median_window, Mat bvtHistogram)
+PersonModel::PersonModel(Point3d detectedPosition, cv::Rect_<int> bb, int id, int median_window, Mat bvtHistogram, TrackBatch *tracks)
 {
-
-    static const double samplingRate = 100.0;
-    T = 1.0/samplingRate;
-    delta_t = T;  //Initialize delta t for first predict
-
-    //Constant position filter
-
-    KalmanFilter constantPosition(2, 2, 0, CV_64F);
-
-    //Phi
-    constantPosition.transitionMatrix = (Mat_<double>(2, 2) << 1, 0, 0, 1);
-    //H
-    constantPosition.measurementMatrix = (Mat_<double>(2, 2) << 1, 0, 0, 1);
-    //Q
-    constantPosition.processNoiseCov = (Mat_<double>(2, 2) << pow(T, 2), 0, 0, pow(T, 2));  //Q*sigma
-    constantPosition.processNoiseCov  = constantPosition.processNoiseCov*const_pos_var;
-    //R
-    constantPosition.measurementNoiseCov = (Mat_<double>(2, 2) << 0.4421, 0.3476, 0.3476, 0.2747);
-    constantPosition.measurementNoiseCov = constantPosition.measurementNoiseCov*1; //R*sigma
-
-    //P0
-    constantPosition.errorCovPost = Mat::eye(2, 2, CV_64F)*100;
-
-    //Constant velocity filter
-
-    KalmanFilter constantVelocity(4, 2, 0, CV_64F);
-
-    //Phi
-    constantVelocity.transitionMatrix = (Mat_<double>(4, 4) << 1, 0, T, 0, 0, 1, 0, T, 0, 0, 1, 0, 0, 0, 0, 1);
-    //H
-    constantVelocity.measurementMatrix = (Mat_<double>(2, 4) << 1, 0, 0, 0, 0, 1, 0, 0);
-    //Q1
-    constantVelocity.processNoiseCov = (Mat_<double>(4, 4) << pow(T,4)/4, 0, pow(T,3)/2, 0, 0, pow(T,4)/4, 0, pow(T,3)/2, pow(T,3)/2, 0, pow(T,2), 0, 0, pow(T,3)/2, 0, pow(T,2));
-    constantVelocity.processNoiseCov  = constantVelocity.processNoiseCov*const_vel_var;  //Q*sigma
-    //R
-    constantVelocity.measurementNoiseCov = (Mat_<double>(2, 2) << 0.4421, 0.3476, 0.3476, 0.2747);
-    constantVelocity.measurementNoiseCov = constantVelocity.measurementNoiseCov*1; //R*sigma
-
-    //P0
-    constantVelocity.errorCovPost = Mat::eye(4, 4, CV_64F)*100;
-
-    //Constant acceleration filter
-
-    KalmanFilter constantAcceleration(6, 2, 0, CV_64F);
-
-    //Phi
-    constantAcceleration.transitionMatrix = (Mat_<double>(6, 6) << 1, 0, T, 0, pow(T, 2)/2, 0, 0, 1, 0, T, 0, pow(T, 2)/2, 0, 0, 1, 0, T, 0, 0, 0, 0, 1, 0, T, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1 );
-    //H
-    constantAcceleration.measurementMatrix = (Mat_<double>(2, 6) << 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0);
-    //Q
-    constantAcceleration.processNoiseCov = (Mat_<double>(6, 6) << pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6, 0, 0, pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6, pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2, 0, 0, pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2, pow(T, 3)/6, 0, pow(T, 2)/2, 0, T, 0, 0, pow(T, 3)/6, 0, pow(T, 2)/2, 0, T);
-    constantAcceleration.processNoiseCov  = constantAcceleration.processNoiseCov*const_accel_var;  //Q*sigma
-    //R
-    constantAcceleration.measurementNoiseCov = (Mat_<double>(2, 2) << 0.4421, 0.3476, 0.3476, 0.2747);
-    constantAcceleration.measurementNoiseCov = constantAcceleration.measurementNoiseCov*1; //R*sigma
-
-    //P0
-    constantAcceleration.errorCovPost = Mat::eye(6, 6, CV_64F)*100;
-
-    // Put them all in the bank
-    std::vector<KalmanFilter> kalmanBank;
-    kalmanBank.push_back(constantPosition);
-    kalmanBank.push_back(constantVelocity);
-    kalmanBank.push_back(constantAcceleration);
-
-    // Link each of these filters states to the ponderated state
-
-    //State [i] from models corresponds to State indexes[i] in xMMAEx
-
-    /*      With 3 models
- *      int indexes1[] = {0, 3};
-        int indexes2[] = {0, 1, 3, 4};
-        int indexes3[] = {0, 1, 2, 3, 4, 5};*/
-
-    int indexes1[] = {0, 1};
-    int indexes2[] = {0, 1, 2, 3};
-    int indexes3[] = {0, 1, 2, 3, 4, 5};
-
-    std::vector<int> indexes1_(indexes1, indexes1+sizeof(indexes1)/sizeof(int));
-    std::vector<int> indexes2_(indexes2, indexes2+sizeof(indexes2)/sizeof(int));
-    std::vector<int> indexes3_(indexes3, indexes3+sizeof(indexes3)/sizeof(int));
-
-    std::vector<std::vector<int> > indexList;
-    indexList.push_back(indexes1_);
-    indexList.push_back(indexes2_);
-    indexList.push_back(indexes3_);
-
-    //Guess the initial states - a good guess for the position is the measurement we just got!
-
-    //        For 3 models
-    double states[] = {detectedPosition.x, detectedPosition.y, 0, 0, 0, 0};
-    //        double states[] = {0, 0, 0, 0, 0, 0};
-    Mat initialStates = Mat(6, 1, CV_64F, states).clone();
-
-    //        double states[] = {detectedPosition.x, 0, detectedPosition.y, 0};
-    //        Mat initialStates = Mat(4, 1, CV_64F, states).clone();
-
-    //Build the Bank!
-    mmaeEstimator = new MMAEFilterBank(kalmanBank, indexList, false, false, initialStates, CV_64F);
+    //The position filters of the track, initialized at the detection
+    this->tracks = tracks;
+    tracks->add(id, detectedPosition.x, detectedPosition.y);
 
     this->median_window = median_window;
     toBeDeleted = false;
@@ -211,16 +122,13 @@ PersonModel::PersonModel(Point3d detectedPosition, cv::Rect_<int> bb, int id, in
 
     rect = bb;
 
-    positionHistory[0] = detectedPosition;
-
-
-    for(int i=1; i < median_window; i++)
-    {
-        positionHistory[i].x =-1000;
-        positionHistory[i].y = -1000;
-        positionHistory[i].z = 0.95;
-    }
-
+    //The history starts with the detection, and no detections before it
+    medianX.reset(median_window, -1000);
+    medianY.reset(median_window, -1000);
+    medianZ.reset(median_window, 0.95);
+    medianX.push(detectedPosition.x);
+    medianY.push(detectedPosition.y);
+    medianZ.push(detectedPosition.z);
 
     lockedOnce = false;
 
@@ -260,36 +168,11 @@ Point3d PersonModel::getNearestPoint(vector<cv::Point3d> coordsInBaseFrame, Poin
 
 Point3d PersonModel::medianFilter()
 {
-    //Optimize this later
-
-    double x[median_window];
-    double y[median_window];
-    double z[median_window];
-
-    for(int i = 0; i<median_window; i++)
-    {
-        x[i] = positionHistory[i].x;
-        y[i] = positionHistory[i].y;
-        z[i] = positionHistory[i].z;
-    }
-
-    vector<double> x_vect(x, x + sizeof(x)/sizeof(x[0]));
-    vector<double> y_vect(y, y + sizeof(y)/sizeof(y[0]));
-    vector<double> z_vect(z, z + sizeof(z)/sizeof(y[0]));
-
-    std::sort(x_vect.begin(), x_vect.begin() + median_window);
-    std::sort(y_vect.begin(), y_vect.begin() + median_window);
-    std::sort(z_vect.begin(), z_vect.begin() + median_window);
-
-    Point3d medianPoint(x_vect.at((int) (median_window/2)), y_vect.at((int) (median_window/2)), z_vect.at((int) (median_window/2)));
+    Point3d medianPoint(medianX.median(), medianY.median(), medianZ.median());
 
     return medianPoint;
-
 }
 
-
-
-
 PersonList::PersonList(int median_window, int numberOfFramesBeforeDestruction, int numberOfFramesBeforeDestructionLocked, double creation_threshold, double validation_gate, double metric_weight, double recognition_threshold, double c_learning_rate, double const_pos_var, double const_vel_var, double const_accel_var)
 {
     //This will never get reseted. That will make sure that we have a new id for every new detection
@@ -306,38 +189,35 @@ PersonList::PersonList(int median_window, int numberOfFramesBeforeDestruction, i
     this->const_vel_var = const_vel_var;
     this->const_accel_var = const_accel_var;
 
-
+    tracks.setProcessNoise(const_pos_var, const_vel_var, const_accel_var);
+    tracks.setPool(&pool);
+    costs.setPool(&pool);
+    delta_t = tracks.period();
+    trackGrid.setCellSize(creation_threshold);
+    frames = 0;
+    reid_candidates = 3;
+    reid_height_tolerance = 0.2;
+    for(int i = 0; i < nStages; i++)
+        stageTime[i] = 0;
 }
 
 PersonList::~PersonList()
 {
-    for(std::vector<PersonModel>::iterator it = personList.begin(); it!=personList.end(); it++)
-    {
-        if(it->mmaeEstimator != NULL)
-            delete it->mmaeEstimator;
-    }
 }
 
 void PersonList::updateDeltaT(double delta_t)
 {
-
-    for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end();it++)
-    {
-        it->delta_t = delta_t;
-    }
-
+    this->delta_t = delta_t;
 }
 
 void PersonList::predictList()
 {
+    //Predict the right ammount of time to simulate a constant sampling period (the models are
+    //tuned for a period of 10 ms), all the tracks at once
+    tracks.predict((int) (delta_t/tracks.period()));
+
     for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end();it++)
     {
-
-        //Predict the right ammount of times to simulate a constant sampling period
-        int times = it->delta_t/it->T;
-        for(int lol = 0; lol < times; lol++)
-            it->mmaeEstimator->predict();
-
         //Predict the height covariance P_minus. No need to predict the size. We assume
         //its a constant model
         it->heightP += it->heightQ; //
@@ -346,58 +226,99 @@ void PersonList::predictList()
 
 void PersonList::updateList()
 {
-
-    for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end();it++)
+    //Every person only touches itself and its own slot of the filters
+    pool.run(personList.size(), 32, [this](int begin, int end)
     {
-
-        if((*it).position.x != -1000 && (*it).position.y != -1000)
+        for(vector<PersonModel>::iterator it = personList.begin()+begin; it != personList.begin()+end; it++)
         {
-            (*it).noDetection = 0;
-            (*it).deadReckoning = false;
-        }
-        else
-        {
-            (*it).noDetection++;
-            //Dead reckoning
-            (*it).deadReckoning = true;
-        }
-        (*it).updateModel();
 
-        if(((*it).noDetection > numberOfFramesBeforeDestruction && (*it).lockedOnce==false) || ((*it).noDetection > numberOfFramesBeforeDestructionLocked && (*it).lockedOnce==true))
-        {
-            it->toBeDeleted = true;
+            if((*it).position.x != -1000 && (*it).position.y != -1000)
+            {
+                (*it).noDetection = 0;
+                (*it).deadReckoning = false;
+            }
+            else
+            {
+                (*it).noDetection++;
+                //Dead reckoning
+                (*it).deadReckoning = true;
+            }
+            (*it).updateModel();
+
+            if(((*it).noDetection > numberOfFramesBeforeDestruction && (*it).lockedOnce==false) || ((*it).noDetection > numberOfFramesBeforeDestructionLocked && (*it).lockedOnce==true))
+            {
+                it->toBeDeleted = true;
+            }
         }
-    }
+    });
 
+    //With the measurements left by updateModel()
+    tracks.correct();
 }
 
-void PersonList::addPerson(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram)
+void PersonList::addPerson(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram, int id)
 {
-    PersonModel person(pos, rect, nPersons, median_window, bvtHistogram);
-
-    //Initial predict
-    int times = person.delta_t/person.T;
-    for(int lol = 0; lol < times; lol++)
-       person.mmaeEstimator->predict();
+    if(id < 0)
+        id = nPersons++;
+    PersonModel person(pos, rect, id, median_window, bvtHistogram, &tracks);
 
     person.metric_weight = this->metric_weight;
-    person.const_pos_var = this->const_pos_var;
-    person.const_vel_var = this->const_vel_var;
-    person.const_accel_var = this->const_accel_var;
+
+    //Initial predict, of one period
+    tracks.predict(tracks.slot(person.id), 1);
     personList.push_back(person);
-    nPersons++;
 
 }
 
+void PersonList::addPersonIfFree(Point3d pos, cv::Rect_<int> rect, Mat bvtHistogram)
+{
+    //Can't create 2 trackers in the same creation_threshold radius
+    if(trackGrid.anyWithin(pos.x, pos.y, creation_threshold))
+        return;
+
+    //The closest colors of the gallery, the first one of them with the same height (z is
+    //half of it, any height with a tolerance <= 0) is the same person
+    int id = -1;
+    gallery.query(bvtHistogram, reid_candidates, reidMatches);
+    for(size_t k = 0; k < reidMatches.size() && reidMatches[k].distance < recognition_threshold; k++)
+    {
+        if(reid_height_tolerance <= 0 || fabs(reidMatches[k].height-pos.z*2) < reid_height_tolerance)
+        {
+            id = reidMatches[k].id;
+            gallery.remove(id);
+            break;
+        }
+    }
+
+    addPerson(pos, rect, bvtHistogram, id);
+
+    Point3d estimate = personList.back().getPositionEstimate();
+    trackGrid.insert(personList.back().id, estimate.x, estimate.y);
+}
+
 void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rect_<int> > rects, vector<Mat> colorFeaturesList, vector<Mat> means, vector<Mat> covariances)
 {
     //Create distance matrix.
     //Rows represent the detections and columns represent the trackers
 
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    stageTime[STAGE_COSTS] = stageTime[STAGE_ASSIGNMENT] = 0;
+
+    frames++;
+    gallery.expire(frames);
     predictList();
     int nTrackers = personList.size();
     int nDetections = coordsInBaseFrame.size();
 
+    //Where the tracks are, to create new ones only away from them
+    trackGrid.clear();
+    for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
+    {
+        Point3d estimate = it->getPositionEstimate();
+        trackGrid.insert(it->id, estimate.x, estimate.y);
+    }
+    stageTime[STAGE_PREDICT] = lap(last);
+
     if(nTrackers > 0 && nDetections > 0)
     {
 
@@ -415,93 +336,27 @@ void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rec
     */
 
 
-        int row = 0;
+        costs.clear();
 
-        //Each detection -> a row
-        for(vector<Point3d>::iterator itrow = coordsInBaseFrame.begin(); itrow != coordsInBaseFrame.end(); itrow++, row++)
+        //Each tracker -> a column
+        for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
         {
-            //Each tracker -> a column
-            int col = 0;
-            for(vector<PersonModel>::iterator itcolumn = personList.begin(); itcolumn != personList.end(); itcolumn++, col++)
-            {
-
-                //Calculate the distance
-
-                Point3d trackerPos2d = (*itcolumn).getPositionEstimate();
-                Mat trackerColorHist = (*itcolumn).getBvtHistogram();
-                Mat detectionColorHist = colorFeaturesList.at(row);
-
-
-
-                detectionColorHist.convertTo(detectionColorHist, CV_32F);
-                trackerColorHist.convertTo(trackerColorHist, CV_32F);
-
-                Point3d trackerPos;
-
-                trackerPos.x = trackerPos2d.x;
-                trackerPos.y = trackerPos2d.y;
-                trackerPos.z = 0.0;
-
-                Point3d detectionPos = (*itrow);
-
-                //Get x, y State covariance
-
-                Mat aux;
-                itcolumn->getCovarianceOfMixture().copyTo(aux);
-                Mat errorCovPost = aux(cv::Range(0,2),cv::Range(0,2));
-
-                double height = detectionPos.z*2.0;
-
-                detectionPos.z = 0.0;
-
-
-
-                Mat detection2dPos = Mat::zeros(2, 1, CV_32F);
-                detection2dPos.at<float>(0,0) = detectionPos.x;
-                detection2dPos.at<float>(1,0) = detectionPos.y;
-
-                Mat tracker2dPos = Mat::zeros(2, 1, CV_32F);
-                tracker2dPos.at<float>(0,0) = trackerPos.x;
-                tracker2dPos.at<float>(1,0) = trackerPos.y;
-
-                Mat detCov = covariances.at(row);
-
-                //Mean of the discretization error is not 0!
-                Mat meanDiscreteError = means.at(row);
-                meanDiscreteError.convertTo(meanDiscreteError, CV_32F);
-                //double dist = norm(trackerPos-detectionPos); // usar distancia de mahalanobis
-
-                //Mahalanobis
-                Mat innovationCov = errorCovPost+detCov;
-                Mat error = tracker2dPos-detection2dPos;
-                double dist = mahalanobisDist(error, meanDiscreteError, innovationCov);
-
-
-                //Bhattacharya
-                //double dist = hellingerDist(detection2dPos, detCov, tracker2dPos, errorCovPost);
-
-                double colorDist;
-                colorDist = compareHist(detectionColorHist, trackerColorHist, CV_COMP_BHATTACHARYYA);
-
-               // cout << "Number of detections: " << colorFeaturesList.size() << std::endl;
-               // cout << "Color ist of detection " << row << " to tracklet " << (*itcolumn).id << ": " << colorDist << endl;
+            int slot = tracks.slot(it->id);
+            costs.addTracker(tracks.state(slot, 0), tracks.state(slot, 1), tracks.covariance(slot, 0, 0), tracks.covariance(slot, 0, 1), tracks.covariance(slot, 1, 1), it->bvtHistogram);
+        }
 
+        //Each detection -> a row
+        for(int row = 0; row < nDetections; row++)
+            costs.addDetection(coordsInBaseFrame.at(row).x, coordsInBaseFrame.at(row).y, means.at(row), covariances.at(row), colorFeaturesList.at(row));
 
-                if(dist < validation_gate)
-                {
-                    if(colorDist > recognition_threshold)
-                        distMatrixIn[row+col*nDetections] = 1000; //Colors are too different. It cant be the same person...
-                    else
-                        distMatrixIn[row+col*nDetections] = itcolumn->getScoreForAssociation(height, detectionPos, detCov, detectionColorHist, trackerColorHist);
-                }
-                else
-                {
-                    distMatrixIn[row+col*nDetections] = 1000;
-                }
-            }
-        }
+        //Mahalanobis distance inside the validation gate, and Bhattacharyya distance of the colors
+        //(1000 if they are too different, it can't be the same person...)
+        costs.compute(validation_gate, recognition_threshold, distMatrixIn);
+        stageTime[STAGE_COSTS] = lap(last);
 
-        assignmentoptimal(assignment, cost, distMatrixIn, nDetections, nTrackers);
+        //Only the pairs inside the gates, group by group
+        solver.solveSparse(assignment, cost, distMatrixIn, nDetections, nTrackers, 1000);
+        stageTime[STAGE_ASSIGNMENT] = lap(last);
 
         //assignment vector positions represents the detections and the value in each position represents the assigned tracker
         //if there is no possible association, then the value is -1
@@ -516,34 +371,11 @@ void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rec
             if(assignment[i] != -1)
             {
 
-                Point3d detPos(coordsInBaseFrame.at(i).x, coordsInBaseFrame.at(i).y, 0);
-                Point3d trackPos = personList.at(assignment[i]).getPositionEstimate();
-                Mat trackerColorHist = personList.at(assignment[i]).getBvtHistogram();
-                Mat detectionColorHist = colorFeaturesList.at(i);
-                double colorDist = compareHist(detectionColorHist, trackerColorHist, CV_COMP_BHATTACHARYYA);
-                trackPos.z = 0.0;
-
-                Mat x = Mat::zeros(2, 1, CV_64F);
-                x.at<float>(0,0) = detPos.x;
-                x.at<float>(1,0) = detPos.y;
-
-
-
-                Mat u = Mat::zeros(2, 1, CV_64F);
-                u.at<float>(0,0) = trackPos.x;
-                u.at<float>(1,0) = trackPos.y;
-
-                Mat aux;
-                personList.at(assignment[i]).getCovarianceOfMixture().copyTo(aux);
-                Mat S = aux(cv::Range(0,2),cv::Range(0,2));
-
+                int trk = assignment[i];
                 Mat detCov = covariances.at(i);
                 Mat meanDiscreteError = means.at(i);
-                Mat innovationCov = S+detCov;
-                Mat error = x-u;
-                double posDist = mahalanobisDist(error, meanDiscreteError, innovationCov);
 
-                if(posDist < validation_gate && colorDist < recognition_threshold)
+                if(costs.distance(i, trk) < validation_gate && costs.colorDistance(i, trk) < recognition_threshold)
                 {
                     double px = coordsInBaseFrame.at(i).x+meanDiscreteError.at<double>(0,0);
                     double py = coordsInBaseFrame.at(i).y+meanDiscreteError.at<double>(1,0);
@@ -553,9 +385,7 @@ void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rec
 
 
                     //Observation covariance update
-                    personList.at(assignment[i]).mmaeEstimator->filterBank.at(0).measurementNoiseCov = detCov;
-                    personList.at(assignment[i]).mmaeEstimator->filterBank.at(1).measurementNoiseCov = detCov;
-                    personList.at(assignment[i]).mmaeEstimator->filterBank.at(2).measurementNoiseCov = detCov;
+                    tracks.setMeasurementNoise(tracks.slot(personList.at(assignment[i]).id), detCov);
 
                     //Bounding boxes...
                     personList.at(assignment[i]).rect = rects.at(i);
@@ -567,53 +397,13 @@ void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rec
                 {
 
                     //If there isn't, create a new tracker for each one - IF THERE IS NO OTHER TRACKER IN A ... radius
-                    bool existsInRadius = false;
-
-                    Point3d coords = coordsInBaseFrame.at(i);
-                    coords.z = 0.0;
-
-                    for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
-                    {
-                        Point3d posEstimate = it->getPositionEstimate();
-
-                        Point3d testPoint(posEstimate.x, posEstimate.y, 0);
-
-                        if(norm(coords-testPoint) < creation_threshold)
-                        {
-                            existsInRadius = true;
-                            break;
-                        }
-                    }
-                    if(!existsInRadius)
-                    {
-                        addPerson(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
-                    }
+                    addPersonIfFree(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
                 }
             }
             else
             {
                 //If there isn't, create a new tracker for each one - IF THERE IS NO OTHER TRACKER IN A 1.5m radius
-                bool existsInRadius = false;
-
-                Point3d coords = coordsInBaseFrame.at(i);
-                coords.z = 0.0;
-
-                for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
-                {
-                    Point3d posEstimate = it->getPositionEstimate();
-
-                    Point3d testPoint(posEstimate.x, posEstimate.y, 0.0);
-
-                    if(norm(coords-testPoint) < creation_threshold)
-                    {
-                        existsInRadius = true;
-                        break;
-                    }
-                }
-                if(!existsInRadius)
-                {
-                    addPerson(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
-                }
+                addPersonIfFree(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
             }
         }
 
@@ -629,45 +419,27 @@ void PersonList::associateData(vector<Point3d> coordsInBaseFrame, vector<cv::Rec
     {
         //We create a tracker for each detection, and if there are none, we do nothing! - can't create 2 trackers in the same creation_threshold radius
         for(int i=0; i<nDetections; i++)
-        {
-            bool existsInRadius = false;
-
-            Point3d coords = coordsInBaseFrame.at(i);
-            coords.z = 0.0;
-
-            for(vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
-            {
-                Point3d testPoint((*it).positionHistory[0].x, (*it).positionHistory[0].y, 0.0);
-                if(norm(coords-testPoint) < creation_threshold)
-                {
-                    existsInRadius = true;
-                    break;
-                }
-            }
-            if(!existsInRadius)
-            {
-                addPerson(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
-            }
-        }
+            addPersonIfFree(coordsInBaseFrame.at(i), rects.at(i), colorFeaturesList.at(i));
 
     }
     //for each associated tracker we update the detection. For everyone else there is Mastercard. Just kidding... trackers
     //wich have no detections associated will be updated with a -1000, -1000 detection
     updateList();
+    stageTime[STAGE_UPDATE] = lap(last);
 
 }
 
-std::vector<PersonModel> PersonList::getValidTrackerPosition()
+std::vector<PersonModel*> PersonList::getValidTrackerPosition()
 {
 
-    std::vector<PersonModel> validTrackers;
+    std::vector<PersonModel*> validTrackers;
 
     for(std::vector<PersonModel>::iterator it = personList.begin(); it != personList.end(); it++)
     {
         Point3d estimate = it->getPositionEstimate();
         if(estimate.x != -1000 && estimate.y != -1000)
         {
-            validTrackers.push_back(*it);
+            validTrackers.push_back(&(*it));
         }
 
     }
@@ -686,6 +458,8 @@ std::vector<int> PersonList::trackletKiller()
         if(it->toBeDeleted)
         {
             deletedTracklets.push_back(it->id);
+            gallery.add(it->id, it->bvtHistogram, it->personHeight, frames);
+            tracks.remove(it->id);
             it = personList.erase(it);
         }
         else
@@ -759,7 +533,8 @@ cv::Mat PersonList::plotReprojectionAndProbabilities(int targetId, cv::Mat baseF
 
             int ind = 0;
             Point2d barBase(trackedBB.tl().x, trackedBB.br().y); //Bottom left corner of the bb
-            for(std::vector<double>::iterator pr = it->mmaeEstimator->probabilities.begin(); pr != it->mmaeEstimator->probabilities.end(); pr++)
+            std::vector<double> probabilities = it->getModelProbabilities();
+            for(std::vector<double>::iterator pr = probabilities.begin(); pr != probabilities.end(); pr++)
             {
                 Point2d tl = barBase-Point2d(0, maxBarSize*(*pr));
                 rectangle(lastImage, tl, barBase + Point2d(step, 0), cores[ind], CV_FILLED);
@@ -0,0 +1,100 @@
+#include "../include/tracker/reidGallery.hpp"
+#include "../include/tracker/associationCosts.hpp"
+#include <algorithm>
+#include <functional>
+#include <math.h>
+
+ReidGallery::ReidGallery(int capacity, int timeToLive) : bins(0)
+{
+    setLimits(capacity, timeToLive);
+}
+
+void ReidGallery::setLimits(int capacity, int timeToLive)
+{
+    this->capacity = std::max(capacity, 0);
+    this->timeToLive = timeToLive;
+
+    while(size() > this->capacity)
+        erase(std::min_element(lostAt.begin(), lostAt.end())-lostAt.begin());
+    rows.reserve(this->capacity*bins);
+}
+
+void ReidGallery::add(int id, const Mat &histogram, double height, int frame)
+{
+    if(capacity == 0)
+        return;
+
+    remove(id);
+    if(size() == capacity)
+        erase(std::min_element(lostAt.begin(), lostAt.end())-lostAt.begin());
+
+    int n = AssociationCosts::appendHistogram(histogram, rows);
+    if(size() == 0)
+    {
+        bins = n;
+        rows.reserve(capacity*bins);
+    }
+    CV_Assert(n == bins);
+
+    ids.push_back(id);
+    lostAt.push_back(frame);
+    heights.push_back(height);
+}
+
+void ReidGallery::remove(int id)
+{
+    std::vector<int>::iterator it = std::find(ids.begin(), ids.end(), id);
+    if(it != ids.end())
+        erase(it-ids.begin());
+}
+
+void ReidGallery::expire(int frame)
+{
+    for(int row = size()-1; row >= 0; row--)
+        if(frame-lostAt[row] > timeToLive)
+            erase(row);
+}
+
+/*The last row takes its place*/
+
+void ReidGallery::erase(int row)
+{
+    int last = size()-1;
+    if(row != last)
+    {
+        std::copy(rows.begin()+last*bins, rows.begin()+(last+1)*bins, rows.begin()+row*bins);
+        ids[row] = ids[last];
+        lostAt[row] = lostAt[last];
+        heights[row] = heights[last];
+    }
+    rows.resize(last*bins);
+    ids.pop_back();
+    lostAt.pop_back();
+    heights.pop_back();
+}
+
+void ReidGallery::query(const Mat &histogram, int k, std::vector<Match> &matches)
+{
+    matches.clear();
+    if(size() == 0 || k <= 0)
+        return;
+
+    queryRow.clear();
+    int n = AssociationCosts::appendHistogram(histogram, queryRow);
+    CV_Assert(n == bins);
+
+    scores.resize(size());
+    for(int row = 0; row < size(); row++)
+        scores[row] = std::make_pair(AssociationCosts::coefficient(&queryRow[0], &rows[row*bins], bins), row);
+
+    //Only the k best are sorted
+    k = std::min(k, size());
+    std::partial_sort(scores.begin(), scores.begin()+k, scores.end(), std::greater< std::pair<double, int> >());
+
+    for(int i = 0; i < k; i++)
+    {
+        int row = scores[i].second;
+        Match match = {ids[row], sqrt(std::max(1.0-scores[i].first, 0.0)), heights[row]};
+        matches.push_back(match);
+    }
+}
@@ -0,0 +1,159 @@
+#include "../include/tracker/slidingMedian.hpp"
+#include <cmath>
+
+SlidingMedian::SlidingMedian(int window, double initial)
+{
+    reset(window, initial);
+}
+
+void SlidingMedian::reset(int window, double initial)
+{
+    if(window < 1)
+        window = 1;
+
+    values.assign(window, initial);
+    left.assign(window, -1);
+    right.assign(window, -1);
+    sizes.assign(window, 1);
+    priorities.resize(window);
+
+    //Same priorities for every filter, the values decide the shape of the tree
+    unsigned seed = 2463534242u;
+    for(int i = 0; i < window; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        priorities[i] = seed;
+    }
+
+    root = -1;
+    for(int i = 0; i < window; i++)
+        root = insert(root, i);
+    newestSlot = window-1;
+}
+
+void SlidingMedian::push(double value)
+{
+    //A NaN would break the order of the treap
+    if(!std::isfinite(value))
+        return;
+
+    int slot = newestSlot+1 == window() ? 0 : newestSlot+1;
+
+    root = erase(root, slot);
+    values[slot] = value;
+    left[slot] = right[slot] = -1;
+    sizes[slot] = 1;
+    root = insert(root, slot);
+
+    newestSlot = slot;
+}
+
+double SlidingMedian::median() const
+{
+    int k = window()/2;
+    int node = root;
+    while(true)
+    {
+        int lowerSize = size(left[node]);
+        if(k < lowerSize)
+            node = left[node];
+        else if(k == lowerSize)
+            return values[node];
+        else
+        {
+            k -= lowerSize+1;
+            node = right[node];
+        }
+    }
+}
+
+/*Order of the values, ties broken by slot so every node has its own key*/
+
+bool SlidingMedian::less(int a, int b) const
+{
+    return values[a] < values[b] || (values[a] == values[b] && a < b);
+}
+
+void SlidingMedian::update(int node)
+{
+    sizes[node] = 1+size(left[node])+size(right[node]);
+}
+
+/*Nodes before key to lower, the others to upper*/
+
+void SlidingMedian::split(int node, int key, int &lower, int &upper)
+{
+    if(node < 0)
+    {
+        lower = upper = -1;
+        return;
+    }
+
+    if(less(node, key))
+    {
+        split(right[node], key, right[node], upper);
+        lower = node;
+    }
+    else
+    {
+        split(left[node], key, lower, left[node]);
+        upper = node;
+    }
+    update(node);
+}
+
+int SlidingMedian::merge(int lower, int upper)
+{
+    if(lower < 0)
+        return upper;
+    if(upper < 0)
+        return lower;
+
+    if(priorities[lower] > priorities[upper])
+    {
+        right[lower] = merge(right[lower], upper);
+        update(lower);
+        return lower;
+    }
+    left[upper] = merge(lower, left[upper]);
+    update(upper);
+    return upper;
+}
+
+int SlidingMedian::insert(int node, int key)
+{
+    if(node < 0)
+        return key;
+
+    if(priorities[key] > priorities[node])
+    {
+        split(node, key, left[key], right[key]);
+        update(key);
+        return key;
+    }
+
+    if(less(key, node))
+        left[node] = insert(left[node], key);
+    else
+        right[node] = insert(right[node], key);
+    update(node);
+    return node;
+}
+
+int SlidingMedian::erase(int node, int key)
+{
+    if(node < 0)
+        return -1;
+
+    if(node == key)
+        return merge(left[node], right[node]);
+
+    if(less(key, node))
+        left[node] = erase(left[node], key);
+    else
+        right[node] = erase(right[node], key);
+    update(node);
+    return node;
+}
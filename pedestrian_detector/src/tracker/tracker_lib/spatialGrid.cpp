@@ -0,0 +1,144 @@
+#include "../include/tracker/spatialGrid.hpp"
+#include <math.h>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(double cellSize)
+{
+    setCellSize(cellSize);
+}
+
+void SpatialGrid::setCellSize(double cellSize)
+{
+    cell = cellSize > 0 ? cellSize : 1.0;
+    clear();
+}
+
+void SpatialGrid::clear()
+{
+    xs.clear();
+    ys.clear();
+    ids.clear();
+    cellX.clear();
+    cellY.clear();
+    next.clear();
+    if(heads.empty())
+        heads.resize(16);
+    heads.assign(heads.size(), -1);
+}
+
+int SpatialGrid::coordinate(double v) const
+{
+    //Absurd positions share the cells of the border instead of overflowing. v is never NaN here
+    double c = floor(v/cell);
+    if(c > 1e8)
+        return 100000000;
+    if(c < -1e8)
+        return -100000000;
+    return (int) c;
+}
+
+int SpatialGrid::bucket(int cx, int cy) const
+{
+    unsigned h = ((unsigned) cx*73856093u)^((unsigned) cy*19349663u);
+    return h & (heads.size()-1);
+}
+
+void SpatialGrid::rehash(int nBuckets)
+{
+    heads.assign(nBuckets, -1);
+    for(int i = 0; i < size(); i++)
+    {
+        int b = bucket(cellX[i], cellY[i]);
+        next[i] = heads[b];
+        heads[b] = i;
+    }
+}
+
+void SpatialGrid::insert(int id, double x, double y)
+{
+    //A NaN has no cell, and could not be found anyway
+    if(!std::isfinite(x) || !std::isfinite(y))
+        return;
+
+    int cx = coordinate(x), cy = coordinate(y);
+    xs.push_back(x);
+    ys.push_back(y);
+    ids.push_back(id);
+    cellX.push_back(cx);
+    cellY.push_back(cy);
+    next.push_back(-1);
+
+    //At most 2 points per bucket on average
+    if(2*size() > (int) heads.size())
+    {
+        rehash(2*heads.size());
+        return;
+    }
+
+    int b = bucket(cx, cy);
+    next.back() = heads[b];
+    heads[b] = size()-1;
+}
+
+template<class Visitor> bool SpatialGrid::visit(double x, double y, double radius, Visitor &visitor) const
+{
+    if(!std::isfinite(x) || !std::isfinite(y) || std::isnan(radius))
+        return false;
+
+    double r2 = radius*radius;
+
+    double cells = (floor((x+radius)/cell)-floor((x-radius)/cell)+1)*(floor((y+radius)/cell)-floor((y-radius)/cell)+1);
+    if(cells >= size())
+    {
+        for(int i = 0; i < size(); i++)
+        {
+            double dx = xs[i]-x, dy = ys[i]-y;
+            if(dx*dx+dy*dy < r2 && visitor(ids[i]))
+                return true;
+        }
+        return false;
+    }
+
+    int cx0 = coordinate(x-radius), cx1 = coordinate(x+radius);
+    int cy0 = coordinate(y-radius), cy1 = coordinate(y+radius);
+    for(int cx = cx0; cx <= cx1; cx++)
+        for(int cy = cy0; cy <= cy1; cy++)
+            for(int i = heads[bucket(cx, cy)]; i >= 0; i = next[i])
+            {
+                //Another cell in the same bucket
+                if(cellX[i] != cx || cellY[i] != cy)
+                    continue;
+                double dx = xs[i]-x, dy = ys[i]-y;
+                if(dx*dx+dy*dy < r2 && visitor(ids[i]))
+                    return true;
+            }
+    return false;
+}
+
+namespace
+{
+    struct Collect
+    {
+        std::vector<int> &found;
+        Collect(std::vector<int> &found) : found(found) {}
+        bool operator()(int id) { found.push_back(id); return false; }
+    };
+
+    struct Any
+    {
+        bool operator()(int) { return true; }
+    };
+}
+
+void SpatialGrid::query(double x, double y, double radius, std::vector<int> &found) const
+{
+    found.clear();
+    Collect collect(found);
+    visit(x, y, radius, collect);
+}
+
+bool SpatialGrid::anyWithin(double x, double y, double radius) const
+{
+    Any any;
+    return visit(x, y, radius, any);
+}
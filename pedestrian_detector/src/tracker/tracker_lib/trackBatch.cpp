@@ -0,0 +1,452 @@
+#include "../include/tracker/trackBatch.hpp"
+#include <math.h>
+
+TrackBatch::TrackBatch(double T) : T(T), pool(NULL)
+{
+    for(int m = 0; m < nModels; m++)
+    {
+        variances[m] = 0;
+        for(int i = 0; i < nStates; i++)
+            for(int j = 0; j < nStates; j++)
+                stepNoise[m][i][j] = 0;
+    }
+
+    //Same Q as the filters PersonModel used to build for each track
+
+    //Constant position
+    stepNoise[0][0][0] = stepNoise[0][1][1] = pow(T, 2);
+
+    //Constant velocity
+    double cv[4][4] = {{pow(T,4)/4, 0, pow(T,3)/2, 0}, {0, pow(T,4)/4, 0, pow(T,3)/2}, {pow(T,3)/2, 0, pow(T,2), 0}, {0, pow(T,3)/2, 0, pow(T,2)}};
+
+    //Constant acceleration
+    double ca[6][6] = {{pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6, 0}, {0, pow(T, 5)/20, 0, pow(T, 4)/8, 0, pow(T, 3)/6},
+                       {pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2, 0}, {0, pow(T, 4)/8, 0, pow(T, 3)/6, 0, pow(T, 2)/2},
+                       {pow(T, 3)/6, 0, pow(T, 2)/2, 0, T, 0}, {0, pow(T, 3)/6, 0, pow(T, 2)/2, 0, T}};
+
+    for(int i = 0; i < nStates; i++)
+        for(int j = 0; j < nStates; j++)
+        {
+            if(i < 4 && j < 4)
+                stepNoise[1][i][j] = cv[i][j];
+            stepNoise[2][i][j] = ca[i][j];
+        }
+
+    for(int m = 0; m < nModels; m++)
+    {
+        for(int i = 0; i < dim(m); i++)
+        {
+            lanes.push_back(&x[m][i]);
+            for(int j = 0; j < dim(m); j++)
+                lanes.push_back(&P[m][i][j]);
+        }
+        for(int k = 0; k < 3; k++)
+            lanes.push_back(&invA[m][k]);
+        lanes.push_back(&betas[m]);
+        lanes.push_back(&probabilities[m]);
+        lanes.push_back(&densities[m]);
+    }
+    for(int k = 0; k < 3; k++)
+        lanes.push_back(&R[k]);
+    lanes.push_back(&z[0]);
+    lanes.push_back(&z[1]);
+    lanes.push_back(&seen);
+    for(int i = 0; i < nStates; i++)
+    {
+        lanes.push_back(&xMMAE[i]);
+        for(int j = 0; j < nStates; j++)
+            lanes.push_back(&covMMAE[i][j]);
+    }
+}
+
+void TrackBatch::setProcessNoise(double positionVar, double velocityVar, double accelerationVar)
+{
+    variances[0] = positionVar;
+    variances[1] = velocityVar;
+    variances[2] = accelerationVar;
+}
+
+int TrackBatch::add(int id, double x0, double y0)
+{
+    CV_Assert(slots.find(id) == slots.end());
+
+    int s = size();
+    for(std::vector<Lane*>::iterator it = lanes.begin(); it != lanes.end(); it++)
+        (*it)->push_back(0);
+
+    ids.push_back(id);
+    slots[id] = s;
+
+    //Same initial state and covariance for all the models, and the R of PersonModel
+    for(int m = 0; m < nModels; m++)
+    {
+        x[m][0][s] = x0;
+        x[m][1][s] = y0;
+        for(int i = 0; i < dim(m); i++)
+            P[m][i][i][s] = 100;
+        probabilities[m][s] = 1.0/nModels;
+    }
+    R[0][s] = 0.4421;
+    R[1][s] = 0.3476;
+    R[2][s] = 0.2747;
+
+    mix(s, s+1);
+    return s;
+}
+
+void TrackBatch::remove(int id)
+{
+    int s = slot(id);
+    if(s < 0)
+        return;
+
+    //The last track takes the place of the removed one
+    int last = size()-1;
+    for(std::vector<Lane*>::iterator it = lanes.begin(); it != lanes.end(); it++)
+    {
+        (**it)[s] = (**it)[last];
+        (*it)->pop_back();
+    }
+
+    slots.erase(id);
+    if(s != last)
+    {
+        ids[s] = ids[last];
+        slots[ids[s]] = s;
+    }
+    ids.pop_back();
+}
+
+int TrackBatch::slot(int id) const
+{
+    std::unordered_map<int, int>::const_iterator it = slots.find(id);
+    return it == slots.end() ? -1 : it->second;
+}
+
+/*Sum of k^p for k = 0..n-1 (0^0 = 1)*/
+
+static double powerSum(int p, double n)
+{
+    switch(p)
+    {
+    case 0: return n;
+    case 1: return n*(n-1)/2;
+    case 2: return (n-1)*n*(2*n-1)/6;
+    case 3: return pow(n*(n-1)/2, 2);
+    default: return (n-1)*n*(2*n-1)*(3*n*n-3*n-1)/30;
+    }
+}
+
+static double factorial(int p)
+{
+    double f = 1;
+    for(int i = 2; i <= p; i++)
+        f *= i;
+    return f;
+}
+
+/*Phi and Q of n steps of a kinematic model with state [x y vx vy ax ay] (as many derivatives as
+  the state has), from the Q of one step: Phi(nT) = Phi(T)^n, and Q(nT) = sum of Phi(kT)*Q*Phi(kT)'
+  for k = 0..n-1, whose terms are polynomials in k, summed in closed form. Same as predicting n
+  times with Phi(T) and Q(T), since the prediction of cv::KalmanFilter does not add anything else
+  to errorCovPost.*/
+
+static void multiStepModel(const double stepQ[][TrackBatch::nStates], int N, double variance, int n, double T,
+                           double Phi[][TrackBatch::nStates], double Q[][TrackBatch::nStates])
+{
+    for(int a = 0; a < N; a++)
+        for(int b = 0; b < N; b++)
+            Phi[a][b] = Q[a][b] = 0;
+
+    for(int a = 0; a < N; a++)
+        for(int c = a; c < N; c += 2)
+        {
+            int pa = c/2-a/2;
+            Phi[a][c] = pow(n*T, pa)/factorial(pa);
+
+            for(int b = 0; b < N; b++)
+                for(int d = b; d < N; d += 2)
+                {
+                    int pb = d/2-b/2;
+                    Q[a][b] += variance*stepQ[c][d]*pow(T, pa+pb)*powerSum(pa+pb, n)/(factorial(pa)*factorial(pb));
+                }
+        }
+}
+
+void TrackBatch::predict(int steps)
+{
+    if(pool == NULL)
+    {
+        predictRange(steps, 0, size());
+        return;
+    }
+    pool->run(size(), chunkSize, [this, steps](int begin, int end) { predictRange(steps, begin, end); });
+}
+
+void TrackBatch::predict(int slot, int steps)
+{
+    predictRange(steps, slot, slot+1);
+}
+
+/*One prediction of steps periods in one go, as MMAEFilterBank::predict() with Phi(steps*T) and
+  Q(steps*T). Nothing is predicted for less than a period.*/
+
+void TrackBatch::predictRange(int steps, int begin, int end)
+{
+    if(steps < 1 || begin >= end)
+        return;
+
+    double Phi[nStates][nStates], Q[nStates][nStates];
+
+    for(int m = 0; m < nModels; m++)
+    {
+        int N = dim(m);
+        multiStepModel(stepNoise[m], N, variances[m], steps, T, Phi, Q);
+
+        //Phi only mixes a state with its derivatives (the next rows), so x = Phi*x is done in
+        //place from the first row down, and the same for the rows and the columns of P
+        for(int i = 0; i < N; i++)
+            for(int c = i+2; c < N; c += 2)
+            {
+                double f = Phi[i][c];
+                double *xi = &x[m][i][0], *xc = &x[m][c][0];
+                for(int s = begin; s < end; s++)
+                    xi[s] += f*xc[s];
+            }
+
+        for(int j = 0; j < N; j++)
+            for(int i = 0; i < N; i++)
+                for(int c = i+2; c < N; c += 2)
+                {
+                    double f = Phi[i][c];
+                    double *pij = &P[m][i][j][0], *pcj = &P[m][c][j][0];
+                    for(int s = begin; s < end; s++)
+                        pij[s] += f*pcj[s];
+                }
+
+        for(int i = 0; i < N; i++)
+            for(int j = 0; j < N; j++)
+            {
+                double *pij = &P[m][i][j][0];
+                for(int d = j+2; d < N; d += 2)
+                {
+                    double f = Phi[j][d];
+                    double *pid = &P[m][i][d][0];
+                    for(int s = begin; s < end; s++)
+                        pij[s] += f*pid[s];
+                }
+                for(int s = begin; s < end; s++)
+                    pij[s] += Q[i][j];
+            }
+
+        //Innovation covariance A = H*Pminus*H'+R, with Pminus = P+0.003*I (as MMAEFilterBank)
+        double *p00 = &P[m][0][0][0], *p01 = &P[m][0][1][0], *p10 = &P[m][1][0][0], *p11 = &P[m][1][1][0];
+        double *r0 = &R[0][0], *r1 = &R[1][0], *r2 = &R[2][0];
+        double *ia0 = &invA[m][0][0], *ia1 = &invA[m][1][0], *ia2 = &invA[m][2][0], *beta = &betas[m][0];
+        for(int s = begin; s < end; s++)
+        {
+            double a00 = p00[s]+0.003+r0[s], a01 = p01[s]+r1[s], a10 = p10[s]+r1[s], a11 = p11[s]+0.003+r2[s];
+            double det = a00*a11-a01*a10;
+            ia0[s] = a11/det;
+            ia1[s] = -0.5*(a01+a10)/det;
+            ia2[s] = a00/det;
+            beta[s] = 1.0/(2*M_PI*sqrt(det));
+        }
+    }
+}
+
+void TrackBatch::setMeasurementNoise(int slot, const Mat &noise)
+{
+    Mat noise64;
+    noise.convertTo(noise64, CV_64F);
+    R[0][slot] = noise64.at<double>(0, 0);
+    R[1][slot] = noise64.at<double>(0, 1);
+    R[2][slot] = noise64.at<double>(1, 1);
+}
+
+void TrackBatch::setMeasurement(int slot, double mx, double my)
+{
+    z[0][slot] = mx;
+    z[1][slot] = my;
+    seen[slot] = 1;
+}
+
+/*Correction of a model, as cv::KalmanFilter::correct() on Pminus = P+0.003*I. For the tracks
+  without a measurement w = 0, and the state and covariance stay as they were predicted. Also
+  leaves the density of the measurement of each track.*/
+
+template<int N>
+static void correctModel(int begin, int end, double *x[], double *P[][TrackBatch::nStates], const double *ia[3], const double *beta,
+                         const double *R[3], const double *z[2], const double *seen, double *density)
+{
+    for(int s = begin; s < end; s++)
+    {
+        double w = seen[s];
+        double r0 = z[0][s]-x[0][s], r1 = z[1][s]-x[1][s];
+        density[s] = beta[s]*exp(-0.5*(r0*r0*ia[0][s]+2*r0*r1*ia[1][s]+r1*r1*ia[2][s]));
+
+        //H*Pminus
+        double h0[N], h1[N];
+        for(int j = 0; j < N; j++)
+        {
+            h0[j] = P[0][j][s];
+            h1[j] = P[1][j][s];
+        }
+        h0[0] += 0.003;
+        h1[1] += 0.003;
+
+        //Inverse of S = H*Pminus*H'+R with the R of now (it may have changed since the prediction)
+        double s00 = h0[0]+R[0][s], s01 = h0[1]+R[1][s], s10 = h1[0]+R[1][s], s11 = h1[1]+R[2][s];
+        double det = s00*s11-s01*s10;
+        double is00 = s11/det, is01 = -s01/det, is10 = -s10/det, is11 = s00/det;
+
+        for(int i = 0; i < N; i++)
+        {
+            double k0 = is00*h0[i]+is01*h1[i];
+            double k1 = is10*h0[i]+is11*h1[i];
+            x[i][s] += w*(k0*r0+k1*r1);
+            for(int j = 0; j < N; j++)
+                P[i][j][s] += w*((i == j ? 0.003 : 0)-k0*h0[j]-k1*h1[j]);
+        }
+
+        //P-K*H*P drifts from symmetric with the rounding, and the drift grows along a track
+        for(int i = 0; i < N; i++)
+            for(int j = i+1; j < N; j++)
+                P[i][j][s] = P[j][i][s] = 0.5*(P[i][j][s]+P[j][i][s]);
+    }
+}
+
+void TrackBatch::correct()
+{
+    if(pool == NULL)
+    {
+        correctRange(0, size());
+        return;
+    }
+    pool->run(size(), chunkSize, [this](int begin, int end) { correctRange(begin, end); });
+}
+
+void TrackBatch::correctRange(int begin, int end)
+{
+    if(begin >= end)
+        return;
+
+    for(int m = 0; m < nModels; m++)
+    {
+        double *xm[nStates], *Pm[nStates][nStates];
+        for(int i = 0; i < dim(m); i++)
+        {
+            xm[i] = &x[m][i][0];
+            for(int j = 0; j < dim(m); j++)
+                Pm[i][j] = &P[m][i][j][0];
+        }
+        const double *ia[3] = {&invA[m][0][0], &invA[m][1][0], &invA[m][2][0]};
+        const double *r[3] = {&R[0][0], &R[1][0], &R[2][0]};
+        const double *zs[2] = {&z[0][0], &z[1][0]};
+
+        if(m == 0)
+            correctModel<2>(begin, end, xm, Pm, ia, &betas[m][0], r, zs, &seen[0], &densities[m][0]);
+        else if(m == 1)
+            correctModel<4>(begin, end, xm, Pm, ia, &betas[m][0], r, zs, &seen[0], &densities[m][0]);
+        else
+            correctModel<6>(begin, end, xm, Pm, ia, &betas[m][0], r, zs, &seen[0], &densities[m][0]);
+    }
+
+    //We only update the probabilities if there is a measurement and it is not an outlier
+    double *p0 = &probabilities[0][0], *p1 = &probabilities[1][0], *p2 = &probabilities[2][0];
+    double *d0 = &densities[0][0], *d1 = &densities[1][0], *d2 = &densities[2][0];
+    for(int s = begin; s < end; s++)
+    {
+        double sumOfAll = d0[s]*p0[s]+d1[s]*p1[s]+d2[s]*p2[s];
+        bool update = seen[s] != 0 && sumOfAll > 1e-170;
+        double q0 = d0[s]*p0[s]/sumOfAll+0.01, q1 = d1[s]*p1[s]/sumOfAll+0.01, q2 = d2[s]*p2[s]/sumOfAll+0.01;
+        double sumProbs = q0+q1+q2;
+        p0[s] = update ? q0/sumProbs : p0[s];
+        p1[s] = update ? q1/sumProbs : p1[s];
+        p2[s] = update ? q2/sumProbs : p2[s];
+        seen[s] = 0;
+    }
+
+    mix(begin, end);
+}
+
+/*Ponderated state and covariance of the mixture, from the states of the models*/
+
+void TrackBatch::mix(int begin, int end)
+{
+    for(int i = 0; i < nStates; i++)
+    {
+        double *xi = &xMMAE[i][0];
+        for(int s = begin; s < end; s++)
+            xi[s] = 0;
+        for(int m = 0; m < nModels; m++)
+        {
+            if(i >= dim(m))
+                continue;
+            double *p = &probabilities[m][0], *xmi = &x[m][i][0];
+            for(int s = begin; s < end; s++)
+                xi[s] += p[s]*xmi[s];
+        }
+    }
+
+    double *p0 = &probabilities[0][0], *p1 = &probabilities[1][0], *p2 = &probabilities[2][0];
+    for(int i = 0; i < nStates; i++)
+        for(int j = 0; j < nStates; j++)
+        {
+            double *c = &covMMAE[i][j][0], *xi = &xMMAE[i][0], *xj = &xMMAE[j][0];
+            for(int s = begin; s < end; s++)
+                c[s] = -(p0[s]+p1[s]+p2[s])*xi[s]*xj[s];
+
+            for(int m = 0; m < nModels; m++)
+            {
+                if(i >= dim(m) || j >= dim(m))
+                    continue;
+                double *p = &probabilities[m][0], *pij = &P[m][i][j][0], *xmi = &x[m][i][0], *xmj = &x[m][j][0];
+                for(int s = begin; s < end; s++)
+                    c[s] += p[s]*(pij[s]+xmi[s]*xmj[s]);
+            }
+        }
+}
+
+void TrackBatch::moveFrame(const Mat &rotation, const Mat &translation, const Mat &noise)
+{
+    Mat rot, trans, cov;
+    rotation.convertTo(rot, CV_64F);
+    translation.convertTo(trans, CV_64F);
+    noise.convertTo(cov, CV_64F);
+
+    double r00 = rot.at<double>(0, 0), r01 = rot.at<double>(0, 1), r10 = rot.at<double>(1, 0), r11 = rot.at<double>(1, 1);
+    double t0 = trans.at<double>(0, 0), t1 = trans.at<double>(1, 0);
+
+    int n = size();
+    if(n == 0)
+        return;
+
+    for(int m = 0; m < nModels; m++)
+    {
+        double *x0 = &x[m][0][0], *x1 = &x[m][1][0];
+        for(int s = 0; s < n; s++)
+        {
+            double px = x0[s], py = x1[s];
+            x0[s] = t0+r00*px+r01*py;
+            x1[s] = t1+r10*px+r11*py;
+        }
+
+        for(int i = 0; i < 2; i++)
+            for(int j = 0; j < 2; j++)
+            {
+                double *pij = &P[m][i][j][0], added = cov.at<double>(i, j);
+                for(int s = 0; s < n; s++)
+                    pij[s] += added;
+            }
+    }
+}
+
+Mat TrackBatch::mixtureCovariance(int slot) const
+{
+    Mat cov(nStates, nStates, CV_64F);
+    for(int i = 0; i < nStates; i++)
+        for(int j = 0; j < nStates; j++)
+            cov.at<double>(i, j) = covMMAE[i][j][slot];
+    return cov;
+}